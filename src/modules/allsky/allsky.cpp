@@ -64,11 +64,18 @@ Allsky::Allsky(QString name, QString label, QString profile, QVariantMap availab
     getProperty("parms")->addElt("delay", i);
     getEltFloat("parms", "exposure")->setAutoUpdate(false);
 
-    _process = new QProcess(this);
-    connect(_process, &QProcess::readyReadStandardOutput, this, &Allsky::processOutput);
-    connect(_process, &QProcess::readyReadStandardError, this, &Allsky::processError);
-    connect(_process, static_cast<void(QProcess::*)(int, QProcess::ExitStatus)>(&QProcess::finished), this,
-            &Allsky::processFinished);
+    connect(&mTimelapse, &TimelapseEncoder::segmentReady, this, &Allsky::OnTimelapseSegment);
+    connect(&mTimelapse, &TimelapseEncoder::finished, this, &Allsky::OnTimelapseFinished);
+    connect(&mTimelapse, &TimelapseEncoder::message, this, [this](const QString & text)
+    {
+        sendWarning(text);
+    });
+
+    connect(&mWriter, &FrameWriter::failed, this, [this](const QString & text)
+    {
+        sendWarning(text);
+    });
+    connect(&mRetention, &ArchiveRetention::taskDone, this, &Allsky::OnRetentionDone);
 
     mScheduleTimer.setInterval(5000); // every 5s check
     connect(&mScheduleTimer, &QTimer::timeout, this, &Allsky::OnScheduleTimer);
@@ -103,6 +110,7 @@ void Allsky::OnMyExternalEvent(const QString &eventType, const QString  &eventMo
         if (eventType == "afterinit")
         {
             checkArchives();
+            applyRetention();
         }
         foreach(const QString &keyprop, eventData.keys())
         {
@@ -154,6 +162,10 @@ void Allsky::OnMyExternalEvent(const QString &eventType, const QString  &eventMo
                         stopLoop();
                     }
                 }
+                if (keyprop == "retention")
+                {
+                    applyRetention();
+                }
                 if (keyprop == "daily")
                 {
                     if (keyelt == "enable")
@@ -215,34 +227,49 @@ void Allsky::startLoop()
 
 
     _index = 0;
-    mKeog = QImage();
+    mKeogram.reset(1, expectedFrames());
+    mStacker.reset(static_cast<TrailStacker::Mode>(getInt("output", "stackmode")));
+    mAutoExposure.reset();
+    mSkyQuality.reset();
+    mMeteors.reset();
+    mNightStart = QDateTime::currentMSecsSinceEpoch();
+    mNightCoverSum = 0;
+    mNightCovers = 0;
+    mNightClear = 0;
+    mNightMeteors = 0;
+    getProperty("detections")->clearGrid();
     mFolder = QDateTime::currentDateTime().toString("yyyyMMdd-hh-mm-ss");
 
     getProperty("log")->clearGrid();
 
-    QDir dir0(getWebroot() + "/" + getModuleName() + "/" + mFolder + "/", {"*"});
-    for(const QString &filename : dir0.entryList())
-    {
-        dir0.remove(filename);
-    }
-
-    QDir dir;
-    dir.mkdir(getWebroot() + "/" + getModuleName());
-    dir.mkdir(getWebroot() + "/" + getModuleName() + "/" + mFolder);
-    dir.mkdir(getWebroot() + "/" + getModuleName() + "/" + mFolder + "/images");
     connectIndi();
     connectDevice(getString("devices", "camera"));
     setBLOBMode(B_ALSO, getString("devices", "camera").toStdString().c_str(), nullptr);
     enableDirectBlobAccess(getString("devices", "camera").toStdString().c_str(), nullptr);
 
-    if (!requestCapture(getString("devices", "camera"), getFloat("parms", "exposure"), getInt("parms", "gain"), getInt("parms",
-                        "offset")))
+    mCaptureExposure = getFloat("parms", "exposure");
+    mCaptureGain = getInt("parms", "gain");
+    if (!requestCapture(getString("devices", "camera"), mCaptureExposure, mCaptureGain, getInt("parms", "offset")))
     {
         getProperty("actions")->setState(OST::Error);
         mIsLooping = false;
     }
     else
     {
+        /* no night folder nor timelapse while the camera does not answer, the schedule retries every few seconds */
+        QDir dir0(getWebroot() + "/" + getModuleName() + "/" + mFolder + "/", {"*"});
+        for(const QString &filename : dir0.entryList())
+        {
+            dir0.remove(filename);
+        }
+
+        QDir dir;
+        dir.mkdir(getWebroot() + "/" + getModuleName());
+        dir.mkdir(getWebroot() + "/" + getModuleName() + "/" + mFolder);
+        dir.mkdir(getWebroot() + "/" + getModuleName() + "/" + mFolder + "/images");
+        dir.mkdir(getWebroot() + "/" + getModuleName() + "/" + mFolder + "/meteors");
+        mTimelapse.start(getWebroot() + "/" + getModuleName() + "/" + mFolder, 30, getInt("output", "segmentframes"));
+
         mTimer.setInterval(getInt("parms", "delay") * 1000);
         connect(&mTimer, &QTimer::timeout, this, &Allsky::OnTimer);
         mTimer.start();
@@ -263,53 +290,48 @@ void Allsky::stopLoop()
     disconnect(&mTimer, &QTimer::timeout, this, &Allsky::OnTimer);
 
     mIsLooping = false;
-    firstStack = true;
-    startTimelapseBatch();
+    saveStack();
+    saveKeogram();
+    sendMessage("Generating timelapse");
+    mTimelapse.finish();
     getProperty("actions")->setState(OST::Ok);
 }
-void Allsky::startTimelapseBatch()
+void Allsky::OnTimelapseSegment(const QString &path)
 {
-    sendMessage("Generating timelapse");
-    if (_process->state() != 0)
+    /* latest finished segment, so there is something to watch during the night */
+    OST::VideoData v;
+    v.url = getModuleName() + "/" + mFolder + "/" + QFileInfo(path).fileName();
+    getEltVideo("timelapse", "video1")->setValue(v, true);
+}
+void Allsky::OnTimelapseFinished(int exitCode, const QString &folder)
+{
+    /* may be the previous night, still joining when a new one started */
+    QString night = QFileInfo(folder).fileName();
+    if (night == mFolder)
+    {
+        OST::VideoData v;
+        v.url = getModuleName() + "/" + mFolder + "/timelapse.mp4";
+        getEltVideo("timelapse", "video1")->setValue(v, true);
+        if (mIsLooping) return;
+        if (_index == 0)
+        {
+            /* not a single frame came in : nothing worth archiving */
+            QDir(getWebroot() + "/" + getModuleName() + "/" + night).removeRecursively();
+            sendWarning("No frame captured during " + night + ", night discarded");
+            return;
+        }
+    }
+    if (exitCode == 0)
     {
-        qDebug() << "can't start process";
+        QString dropped = mTimelapse.dropped() > 0 ? ", " + QString::number(mTimelapse.dropped()) + " frames dropped" : "";
+        sendMessage("Timelapse " + night + " ready" + dropped);
     }
     else
     {
-        QString program = "ffmpeg";
-        QStringList arguments;
-        arguments << "-framerate" << "30";
-        arguments << "-pattern_type" << "glob";
-        arguments << "-i" << getWebroot() + "/" + getModuleName() + "/" + mFolder +  "/images/*.jpeg";
-        arguments << "-c:v" << "libx264";
-        arguments << "-pix_fmt" << "yuv420p";
-        arguments << "-framerate" << "30";
-        arguments << "-y";
-        arguments << getWebroot() + "/" + getModuleName() + "/" + mFolder + "/timelapse.mp4";
-        qDebug() << "PROCESS ARGS " << arguments;
-        _process->start(program, arguments);
-
+        sendWarning("Timelapse " + night + " failed (" + QString::number(exitCode) + "), night archived without it");
     }
-
-}
-void Allsky::processFinished(int exitCode, QProcess::ExitStatus exitStatus)
-{
-    Q_UNUSED(exitStatus);
-    OST::VideoData v;
-    v.url = getModuleName() + "/" + mFolder + "/timelapse.mp4";
-    getEltVideo("timelapse", "video1")->setValue(v, true);
-    sendMessage("Timelapse ready (" + QString::number(exitCode) + ")");
-    if (!mIsLooping) moveCurrentToArchives();
-}
-void Allsky::processOutput()
-{
-    QString output = _process->readAllStandardOutput();
-    //qDebug() << "PROCESS LOG   " << output;
-}
-void Allsky::processError()
-{
-    QString output = _process->readAllStandardError();
-    qDebug() << "Process log : " + output;
+    mWriter.flush();
+    moveToArchives(night);
 }
 void Allsky::newBLOB(INDI::PropertyBlob pblob)
 {
@@ -325,42 +347,32 @@ void Allsky::newBLOB(INDI::PropertyBlob pblob)
 
         QList<fileio::Record> rec = _image->getRecords();
         stats = _image->getStats();
-        _image->saveAsFITS(getWebroot() + "/" + getModuleName() + QString(pblob.getDeviceName()) + ".FITS", stats,
-                           _image->getImageBuffer(),
-                           FITSImage::Solution(), rec, false);
+        QString fitsPath = getWebroot() + "/" + getModuleName() + QString(pblob.getDeviceName()) + ".FITS";
+        QByteArray fitsData(reinterpret_cast<const char *>(_image->getImageBuffer()),
+                            static_cast<int>(stats.samples_per_channel * stats.channels * stats.bytesPerPixel));
+        FITSImage::Statistic fitsStats = stats;
+        mWriter.post(fitsPath, [fitsPath, fitsStats, fitsData, rec]() mutable
+        {
+            fileio fits;
+            fits.saveAsFITS(fitsPath, fitsStats, reinterpret_cast<uint8_t *>(fitsData.data()), FITSImage::Solution(), rec, false);
+        });
         _index++;
         QImage rawImage = _image->getRawQImage();
         QImage im = rawImage.convertToFormat(QImage::Format_RGB32);
         im.setColorTable(rawImage.colorTable());
         QRect r;
         r.setRect(rawImage.width() / 2, 1, 1, rawImage.height());
-        if (firstStack)
+        mStackWidth = rawImage.width();
+        if (!mStacker.add(stats, _image->getImageBuffer()))
         {
-            imageStacked = im;
-            firstStack = false;
-        }
-        else
-        {
-            for (int y = 0; y < im.height(); ++y)
-            {
-                QRgb *line_current = reinterpret_cast<QRgb*>(im.scanLine(y));
-                QRgb *line_stacked = reinterpret_cast<QRgb*>(imageStacked.scanLine(y));
-                for (int x = 0; x < im.width(); ++x)
-                {
-                    QRgb &rgb_current = line_current[x];
-                    QRgb &rgb_stacked = line_stacked[x];
-                    rgb_stacked = qRgb(
-                                      std::max(qRed(rgb_current), qRed(rgb_stacked)),
-                                      std::max(qGreen(rgb_current), qGreen(rgb_stacked)),
-                                      std::max(qBlue(rgb_current), qBlue(rgb_stacked))
-                                  );
-                }
-            }
+            /* frame format changed (binning, ROI...) : start a new stack */
+            mStacker.reset(mStacker.mode());
+            mStacker.add(stats, _image->getImageBuffer());
         }
-        imageStacked.save(getWebroot() +  "/" + getModuleName() + "/" + mFolder + "/stacked" + ".jpeg", "JPG", 100);
+        int stackEvery = std::max(1, getInt("output", "stackevery"));
+        if (mStacker.count() == 1 || mStacker.count() % stackEvery == 0) saveStack();
+        if (getBool("meteors", "enabled")) detectMeteors(im);
 
-
-        QImage image1 = mKeog;
         QImage image2 = im.copy(r);
 
         // Draw weather data overlay on the 1px band
@@ -413,16 +425,9 @@ void Allsky::newBLOB(INDI::PropertyBlob pblob)
 
         bandPainter.end();
 
-        QImage result(mKeog.width() + 1, rawImage.height(), QImage::Format_RGB32);
-        QPainter painter(&result);
-        painter.drawImage(0, 0, image1);
-        painter.drawImage(mKeog.width(), 0, image2);
-        mKeog = result;
-
-        mKeog.save(getWebroot() +  "/" + getModuleName() + "/" + mFolder + "/keogram" + ".jpeg", "JPG", 100);
-        OST::ImgData keo;
-        keo.mUrlJpeg = getModuleName() + "/" + mFolder + "/keogram" + ".jpeg";
-        getEltImg("keogram", "image1")->setValue(keo, true);
+        mKeogram.addColumn(image2);
+        int every = std::max(1, getInt("output", "keogramevery"));
+        if (mKeogram.count() == 1 || mKeogram.count() % every == 0) saveKeogram();
 
         r.setRect(0, 0, im.width(), im.height() / 10);
         QPainter p;
@@ -467,31 +472,222 @@ void Allsky::newBLOB(INDI::PropertyBlob pblob)
 
 
 
-        im.save(getWebroot() + "/" + getModuleName() + QString(pblob.getDeviceName()) + ".jpeg", "JPG", 100);
+        /* one encode for the live preview and the archived frame when they are the same image */
+        int quality = getInt("output", "jpegquality");
+        int previewWidth = getInt("output", "previewwidth");
+        QString livePath = getWebroot() + "/" + getModuleName() + QString(pblob.getDeviceName()) + ".jpeg";
+        QImage preview = (previewWidth > 0 && im.width() > previewWidth) ? im.scaledToWidth(previewWidth,
+                         Qt::SmoothTransformation) : im;
+        QStringList livePaths = {livePath};
+        /* frames are only needed for archives, the timelapse is fed directly */
+        if (getBool("keepimages", "enable"))
+        {
+            QString _n = QStringLiteral("%1").arg(_index, 10, 10, QLatin1Char('0'));
+            QString framePath = getWebroot() + "/" + getModuleName() + "/" + mFolder + "/images/" + _n + ".jpeg";
+            if (preview.size() == im.size()) livePaths.prepend(framePath);
+            else mWriter.writeJpeg(im, {framePath}, quality);
+        }
+
         OST::ImgData dta = _image->ImgStats();
         dta.mUrlJpeg = getModuleName() + QString(pblob.getDeviceName()) + ".jpeg";
         dta.mAlternates.clear();
         dta.mAlternates.push_front(getModuleName() + "/" + mFolder + "/keogram" + ".jpeg");
         dta.mAlternates.push_front(getModuleName() + "/" + mFolder + "/stacked" + ".jpeg");
-        getEltImg("image", "image")->setValue(dta, true);
+        mWriter.writeJpeg(preview, livePaths, quality, [this, dta]()
+        {
+            getEltImg("image", "image")->setValue(dta, true);
+        });
 
-        QString _n = QStringLiteral("%1").arg(_index, 10, 10, QLatin1Char('0'));
-        im.save(getWebroot() + "/" + getModuleName() + "/" + mFolder + + "/images/" + _n + ".jpeg", "JPG", 100);
+        mTimelapse.addFrame(im);
 
         double tt = QDateTime::currentDateTime().toMSecsSinceEpoch();
         getEltFloat("log", "time")->setValue(tt, false);
         getEltFloat("log", "snr")->setValue(_image->getStats().SNR, true);
-        getProperty("log")->push();
-
-        if (getBool("autoparms", "enabled"))
+        /* with star counts, the line is pushed once extraction is done */
+        if (!findStars(tt))
         {
-            if (getString("autoparms", "measure") == "mean") computeExposureOrGain(_image->getStats().mean[0]);
-            if (getString("autoparms", "measure") == "median") computeExposureOrGain(_image->getStats().median[0]);
+            /* no extraction for this frame : do not repeat the figures of an older one */
+            getEltInt("log", "stars")->setValue(0, false);
+            getEltFloat("log", "cover")->setValue(SkyQuality::NoValue, false);
+            getEltFloat("log", "limit")->setValue(SkyQuality::NoValue, false);
+            getProperty("log")->push();
         }
 
+        if (getBool("autoparms", "enabled")) computeExposureOrGain();
+
     }
 
 
+}
+bool Allsky::findStars(double time)
+{
+    if (!getBool("clouds", "enabled")) return false;
+    /* previous frame still being analysed : skip this one, unless extraction was lost */
+    if (mExtracting)
+    {
+        if (mExtractTimer.elapsed() < 120000) return false;
+        /* the solver must be done with mSkyQuality's buffer before prepare() rewrites it */
+        disconnect(&_solver, &Solver::successSEP, this, &Allsky::OnSucessSEP);
+        disconnect(mSolveFinished);
+        if (_solver.stellarSolver.isRunning()) _solver.stellarSolver.abortAndWait();
+        mExtracting = false;
+        sendWarning("Star extraction lost, restarted");
+    }
+
+    if (!mSkyQuality.prepare(stats, _image->getImageBuffer(), getFloat("clouds", "mask"), getInt("clouds", "width")))
+    {
+        return false;
+    }
+    mExtracting = true;
+    mExtractTimer.start();
+    mExtractTime = time;
+    mExtractSnr = _image->getStats().SNR;
+    mExtractExposure = mCaptureExposure;
+    _solver.ResetSolver(mSkyQuality.stats(), mSkyQuality.buffer());
+    connect(&_solver, &Solver::successSEP, this, &Allsky::OnSucessSEP, Qt::UniqueConnection);
+    disconnect(mSolveFinished);
+    mSolveFinished = connect(&_solver.stellarSolver, &StellarSolver::finished, this, &Allsky::OnSolverFinished);
+    _solver.FindStars(_solver.stellarSolverProfiles[0]);
+    return true;
+}
+void Allsky::OnSolverFinished()
+{
+    disconnect(mSolveFinished);
+    if (!_solver.stellarSolver.failed()) return;
+
+    /* no successSEP will come for this frame : log it without star counts and take the next one */
+    disconnect(&_solver, &Solver::successSEP, this, &Allsky::OnSucessSEP);
+    mExtracting = false;
+    sendWarning("Star extraction failed");
+    getEltFloat("log", "time")->setValue(mExtractTime, false);
+    getEltFloat("log", "snr")->setValue(mExtractSnr, false);
+    getEltInt("log", "stars")->setValue(0, false);
+    getEltFloat("log", "cover")->setValue(SkyQuality::NoValue, false);
+    getEltFloat("log", "limit")->setValue(SkyQuality::NoValue, false);
+    getProperty("log")->push();
+}
+void Allsky::OnSucessSEP()
+{
+    disconnect(&_solver, &Solver::successSEP, this, &Allsky::OnSucessSEP);
+    mExtracting = false;
+    mSkyQuality.measure(_solver.stars, mExtractExposure);
+
+    static const char *names[SkyQuality::Sectors] = {"Zenith", "Top", "Right", "Bottom", "Left"};
+    QVariantList sectors;
+    getProperty("sky")->clearGrid();
+    for (int s = 0; s < SkyQuality::Sectors; s++)
+    {
+        double cover = mSkyQuality.cover(s) == SkyQuality::NoValue ? SkyQuality::NoValue : 100 * mSkyQuality.cover(s);
+        getEltString("sky", "sector")->setValue(names[s], false);
+        getEltInt("sky", "stars")->setValue(mSkyQuality.count(s), false);
+        getEltFloat("sky", "limit")->setValue(mSkyQuality.limitingMag(s), false);
+        getEltFloat("sky", "cover")->setValue(cover, false);
+        getProperty("sky")->push();
+
+        QVariantMap sector;
+        sector["sector"] = names[s];
+        sector["stars"] = mSkyQuality.count(s);
+        sector["limit"] = mSkyQuality.limitingMag(s);
+        sector["cover"] = cover;
+        sectors.append(sector);
+    }
+
+    double cover = mSkyQuality.cover() == SkyQuality::NoValue ? SkyQuality::NoValue : 100 * mSkyQuality.cover();
+    if (cover != SkyQuality::NoValue)
+    {
+        mNightCoverSum += cover;
+        mNightCovers++;
+        if (cover < 20) mNightClear++;
+    }
+    getEltFloat("log", "time")->setValue(mExtractTime, false);
+    getEltFloat("log", "snr")->setValue(mExtractSnr, false);
+    getEltInt("log", "stars")->setValue(mSkyQuality.count(), false);
+    getEltFloat("log", "cover")->setValue(cover, false);
+    getEltFloat("log", "limit")->setValue(mSkyQuality.limitingMag(0), true);
+    getProperty("log")->push();
+
+    /* for any module that has to pause on clouds */
+    QVariantMap eventData;
+    eventData["time"] = mExtractTime;
+    eventData["stars"] = mSkyQuality.count();
+    eventData["cover"] = cover;
+    eventData["limit"] = mSkyQuality.limitingMag(0);
+    eventData["sectors"] = sectors;
+    emit moduleEvent("skyquality", getModuleName(), "", eventData);
+}
+void Allsky::detectMeteors(const QImage &frame)
+{
+    mMeteors.sigma = getFloat("meteors", "sigma");
+    mMeteors.minLength = getInt("meteors", "minlength");
+    mMeteors.maxWidth = getInt("meteors", "width");
+    const std::vector<MeteorDetector::Detection> &detections = mMeteors.process(stats, _image->getImageBuffer());
+
+    QString folder = getWebroot() + "/" + getModuleName() + "/" + mFolder + "/meteors";
+    QString now = QDateTime::currentDateTime().toString("yyyy-MM-dd hh:mm:ss");
+    /* frame is the preview, not full resolution */
+    const double sx = stats.width > 0 ? frame.width() / double(stats.width) : 1.0;
+    const double sy = stats.height > 0 ? frame.height() / double(stats.height) : 1.0;
+    for (size_t k = 0; k < detections.size(); k++)
+    {
+        const MeteorDetector::Detection &d = detections[k];
+        QString type = d.moving ? "satellite/plane" : "meteor";
+        QString name = QStringLiteral("%1-%2").arg(_index, 10, 10, QLatin1Char('0')).arg(k);
+
+        /* streak bounding box with some sky around it, detections are in sensor pixels */
+        QRect box = QRectF(QPointF(d.x1 * sx, d.y1 * sy), QPointF(d.x2 * sx, d.y2 * sy)).normalized().toAlignedRect();
+        box = box.adjusted(-32, -32, 32, 32).intersected(frame.rect());
+        mWriter.writeJpeg(frame.copy(box), {folder + "/" + name + ".jpeg"}, getInt("output", "jpegquality"));
+
+        QString line = QString("%1;%2;%3;%4;%5;%6;%7;%8;%9;%10\n").arg(now, name, type).arg(d.x1, 0, 'f', 0).arg(d.y1, 0, 'f', 0)
+                       .arg(d.x2, 0, 'f', 0).arg(d.y2, 0, 'f', 0).arg(d.length, 0, 'f', 0).arg(d.points).arg(d.brightness, 0, 'f', 0);
+        QString csv = folder + "/meteors.csv";
+        mWriter.post(csv + "#" + name, [csv, line]()
+        {
+            QFile file(csv);
+            bool header = !file.exists();
+            if (!file.open(QIODevice::Append | QIODevice::Text)) return;
+            if (header) file.write("time;frame;type;x1;y1;x2;y2;length;points;brightness\n");
+            file.write(line.toUtf8());
+        });
+
+        getEltString("detections", "time")->setValue(now, false);
+        getEltString("detections", "type")->setValue(type, false);
+        getEltFloat("detections", "length")->setValue(d.length, false);
+        OST::ImgData crop;
+        crop.mUrlJpeg = getModuleName() + "/" + mFolder + "/meteors/" + name + ".jpeg";
+        getEltImg("detections", "image")->setValue(crop, false);
+        getProperty("detections")->push();
+        if (!d.moving) mNightMeteors++;
+        sendMessage("Streak detected (" + type + ", " + QString::number(d.length, 'f', 0) + " px)");
+    }
+}
+void Allsky::saveStack()
+{
+    if (mStacker.count() == 0) return;
+    mWriter.writeJpeg(mStacker.preview(mStackWidth), {getWebroot() +  "/" + getModuleName() + "/" + mFolder + "/stacked" + ".jpeg"},
+                      getInt("output", "jpegquality"));
+}
+void Allsky::saveKeogram()
+{
+    if (mKeogram.isEmpty()) return;
+    OST::ImgData keo;
+    keo.mUrlJpeg = getModuleName() + "/" + mFolder + "/keogram" + ".jpeg";
+    /* view() shares the buffer the next columns are written to : the writer needs its own copy */
+    mWriter.writeJpeg(mKeogram.view().copy(), {getWebroot() +  "/" + getModuleName() + "/" + mFolder + "/keogram" + ".jpeg"},
+                      getInt("output", "jpegquality"), [this, keo]()
+    {
+        getEltImg("keogram", "image1")->setValue(keo, true);
+    });
+}
+int Allsky::expectedFrames()
+{
+    /* length of the coming session from the schedule, 12h when open ended */
+    int seconds = 12 * 3600;
+    QTime now = QDateTime::currentDateTime().time();
+    if (getBool("type", "fixed")) seconds = now.secsTo(getTime("daily", "end"));
+    if (getBool("type", "sunset")) seconds = now.secsTo(getTime("coming", "sunrise"));
+    if (seconds <= 0) seconds += 24 * 3600;
+    return seconds / std::max(1, getInt("parms", "delay")) + 1;
 }
 void Allsky::updateProperty(INDI::Property property)
 {
@@ -572,8 +768,9 @@ void Allsky::updateProperty(INDI::Property property)
 void Allsky::OnTimer()
 {
     if (getBool("actions", "abort") || getBool("actions", "pause")) return;
-    if (!requestCapture(getString("devices", "camera"), getFloat("parms", "exposure"), getInt("parms", "gain"), getInt("parms",
-                        "offset")))
+    mCaptureExposure = getFloat("parms", "exposure");
+    mCaptureGain = getInt("parms", "gain");
+    if (!requestCapture(getString("devices", "camera"), mCaptureExposure, mCaptureGain, getInt("parms", "offset")))
     {
         getProperty("actions")->setState(OST::Error);
     }
@@ -666,89 +863,154 @@ void Allsky::OnScheduleTimer()
 
 
 }
-void Allsky::computeExposureOrGain(double fromValue)
+void Allsky::computeExposureOrGain(void)
 {
     QString elt = "";
     if (getString("autoparms", "expgain") == "exp") elt = "exposure";
     if (getString("autoparms", "expgain") == "gain") elt = "gain";
-    double target = getFloat("autoparms", "target");
-    double threshold = getFloat("autoparms", "threshold") / 100; // not used ATM, we'll see that later
-    double coef = target / fromValue;
-    double val = 0;
-    if (elt == "exposure") val = getFloat("parms", elt);
-    if (elt == "gain") val = getInt("parms", elt);
+    if (elt == "") return;
+
+    AutoExposure::Measure measure = getString("autoparms", "measure") == "median" ? AutoExposure::Median :
+                                    AutoExposure::Mean;
+    double level = mAutoExposure.measure(stats, _image->getImageBuffer(), measure, getFloat("autoparms", "mask"));
+
+    mAutoExposure.target = getFloat("autoparms", "target");
+    mAutoExposure.threshold = getFloat("autoparms", "threshold") / 100;
+    mAutoExposure.damping = getFloat("autoparms", "damping");
+    mAutoExposure.predict = getBool("autoparms", "predict");
+    mAutoExposure.minValue = getFloat("autoparms", "min");
+    mAutoExposure.maxValue = getFloat("autoparms", "max");
 
+    /* the value this frame was taken with, parms may already have been edited */
+    double val = elt == "exposure" ? mCaptureExposure : mCaptureGain;
     int    delay = getInt("parms", "delay");
-    double newval = val * coef;
+    double JD = ln_get_julian_from_sys();
+    double now = QDateTime::currentMSecsSinceEpoch() / 1000.0;
+    double newval = mAutoExposure.next(val, level, now, now + delay, sunAltitude(JD), sunAltitude(JD + delay / 86400.0));
+
     if (elt == "exposure" && newval > delay)
     {
         newval = 0.95 * delay;
     }
-    if (newval < getFloat("autoparms", "min"))
-    {
-        newval = getFloat("autoparms", "min");
-    }
-    if (newval > getFloat("autoparms", "max"))
-    {
-        newval = getFloat("autoparms", "max");
-    }
     if (elt == "exposure") getEltFloat("parms", elt)->setValue(newval, true);
-    if (elt == "gain") getEltInt("parms", elt)->setValue(newval, true);
-
-
-
+    if (elt == "gain") getEltInt("parms", elt)->setValue(qRound(newval), true);
+}
+double Allsky::sunAltitude(double JD)
+{
+    ln_lnlat_posn observer;
+    observer.lat = getFloat("geo", "lat");
+    observer.lng = getFloat("geo", "long");
+    ln_equ_posn equ;
+    ln_get_solar_equ_coords(JD, &equ);
+    ln_hrz_posn hrz;
+    ln_get_hrz_from_equ(&equ, &observer, JD, &hrz);
+    return hrz.alt;
 }
 void Allsky::checkArchives(void)
 {
-    getProperty("archives")->clearGrid();
-    QStringList folders;
-
-    //check existing folders
-    QDirIterator itFolders(getWebroot() + "/" + getModuleName() + "/archives", QDirIterator::Subdirectories);
-    while (itFolders.hasNext())
-    {
-        QString d = itFolders.next();
-        d.replace(getWebroot() + "/" + getModuleName() + "/archives", "");
-        if (d.endsWith("/.") && !d.contains("images") && d != "/.")
-        {
-            QString dd = d;
-            dd.replace("/.", "");
-            if (!folders.contains(dd))
-            {
-                folders.append(dd);
-            }
-        }
-    }
+    QString root = getWebroot() + "/" + getModuleName() + "/archives";
+    if (mArchives.root() != root) mArchives.load(root);
 
-    folders.sort();
-    for (const auto &f : folders)
+    getProperty("archives")->clearGrid();
+    for (const ArchiveIndex::Night &n : mArchives.nights())
     {
-        QString dd = f;
         OST::ImgData i = getEltImg("archives", "keogram")->value();
-        i.mUrlJpeg = getModuleName() + "/archives" + dd + "/keogram.jpeg";
+        i.mUrlJpeg = getModuleName() + "/archives/" + n.folder + "/keogram.jpeg";
         getEltImg("archives", "keogram")->setValue(i);
         i = getEltImg("archives", "stack")->value();
-        i.mUrlJpeg = getModuleName() + "/archives" + dd + "/stacked.jpeg";
+        i.mUrlJpeg = getModuleName() + "/archives/" + n.folder + "/stacked.jpeg";
         getEltImg("archives", "stack")->setValue(i);
         OST::VideoData v = getEltVideo("archives", "timelapse")->value();
-        v.url = getModuleName() + "/archives" + dd + "/timelapse.mp4";
+        v.url = getModuleName() + "/archives/" + n.folder + "/timelapse.mp4";
         getEltVideo("archives", "timelapse")->setValue(v);
-        getEltString("archives", "date")->setValue(dd.replace("/", ""));
+        getEltString("archives", "date")->setValue(n.folder);
+        getEltInt("archives", "frames")->setValue(n.frames);
+        getEltFloat("archives", "duration")->setValue((n.end - n.start) / 3600000.0);
+        getEltFloat("archives", "cover")->setValue(n.meanCover);
+        getEltInt("archives", "meteors")->setValue(n.meteors);
+        getEltFloat("archives", "size")->setValue(n.bytes / 1048576.0);
         getProperty("archives")->push();
     }
 }
-void Allsky::moveCurrentToArchives(void)
+void Allsky::moveToArchives(const QString &folder)
 {
     QDir dir;
     dir.mkdir(getWebroot() + "/" + getModuleName() + "/archives");
-    dir.rename(getWebroot() + "/" + getModuleName() + "/" + mFolder,
-               getWebroot() + "/" + getModuleName() + "/archives/" + mFolder);
+    dir.rename(getWebroot() + "/" + getModuleName() + "/" + folder,
+               getWebroot() + "/" + getModuleName() + "/archives/" + folder);
     if (!getBool("keepimages", "enable"))
     {
-        QDir dd(getWebroot() + "/" + getModuleName() + "/archives/" + mFolder + "/images");
+        QDir dd(getWebroot() + "/" + getModuleName() + "/archives/" + folder + "/images");
         dd.removeRecursively();
     }
 
+    /* only this night's files are looked at, the other ones are already in the index */
+    QString root = getWebroot() + "/" + getModuleName() + "/archives";
+    if (mArchives.root() != root) mArchives.load(root);
+    ArchiveIndex::Night night = mArchives.scan(folder);
+    /* counters belong to the current night, an older one keeps what its files tell */
+    if (folder == mFolder)
+    {
+        night.start = mNightStart;
+        night.end = QDateTime::currentMSecsSinceEpoch();
+        night.frames = _index;
+        night.meteors = mNightMeteors;
+        if (mNightCovers > 0)
+        {
+            night.meanCover = mNightCoverSum / mNightCovers;
+            night.clearFraction = 100.0 * mNightClear / mNightCovers;
+        }
+    }
+    mArchives.add(night);
+
+    checkArchives();
+    applyRetention();
+}
+void Allsky::applyRetention(void)
+{
+    /* nothing is ever removed from the archives unless asked for */
+    if (!getBool("retention", "enabled"))
+    {
+        mRetention.cancel();
+        return;
+    }
+    if (!mArchives.isLoaded()) return;
+    ArchiveRetention::Policy policy;
+    policy.thinDays = getInt("retention", "thindays");
+    policy.recompressDays = getInt("retention", "recompressdays");
+    policy.quality = getInt("retention", "quality");
+    policy.videoDays = getInt("retention", "videodays");
+    policy.deleteDays = getInt("retention", "deletedays");
+    policy.maxBytes = static_cast<qint64>(getFloat("retention", "maxsize") * 1073741824.0);
+    mRetention.schedule(mArchives.root(), ArchiveRetention::plan(mArchives.nights(), policy,
+                        QDateTime::currentMSecsSinceEpoch()));
+}
+void Allsky::OnRetentionDone(const QString &folder, int action, int value, bool complete)
+{
+    if (action == ArchiveRetention::Delete)
+    {
+        if (!complete)
+        {
+            sendWarning("Could not delete archived night " + folder);
+            return;
+        }
+        mArchives.remove(folder);
+        mArchives.save();
+        checkArchives();
+        return;
+    }
+    const ArchiveIndex::Night *indexed = mArchives.find(folder);
+    if (!indexed) return;
+
+    /* what is left on disk, the capture statistics do not change */
+    ArchiveIndex::Night night = *indexed;
+    ArchiveIndex::Night files = mArchives.scan(folder);
+    night.bytes = files.bytes;
+    night.imageBytes = files.imageBytes;
+    night.images = files.images;
+    if (complete && action == ArchiveRetention::Thin) night.thinning = value;
+    if (complete && action == ArchiveRetention::Recompress) night.quality = value;
+    mArchives.add(night);
     checkArchives();
 }
 void Allsky::calculateSunset(void)
@@ -1,8 +1,18 @@
 #ifndef ALLSKY_MODULE_h_
 #define ALLSKY_MODULE_h_
 #include <indimodule.h>
+#include <QElapsedTimer>
 #include <fileio.h>
 #include <solver.h>
+#include "archiveindex.h"
+#include "archiveretention.h"
+#include "autoexposure.h"
+#include "framewriter.h"
+#include "keogram.h"
+#include "meteordetector.h"
+#include "skyquality.h"
+#include "timelapseencoder.h"
+#include "trailstacker.h"
 
 
 #if defined(ALLSKY_MODULE)
@@ -22,36 +32,63 @@ class MODULE_INIT Allsky : public IndiModule
     public slots:
         void OnMyExternalEvent(const QString &eventType, const QString  &eventModule, const QString  &eventKey,
                                const QVariantMap &eventData) override;
-        void processFinished(int exitCode, QProcess::ExitStatus exitStatus);
     private slots:
+        void OnTimelapseSegment(const QString &path);
+        void OnTimelapseFinished(int exitCode, const QString &folder);
+        void OnRetentionDone(const QString &folder, int action, int value, bool complete);
         void OnTimer(void);
         void OnScheduleTimer(void);
+        void OnSucessSEP(void);
+        void OnSolverFinished(void);
     private:
         void newBLOB(INDI::PropertyBlob pblob);
         void updateProperty(INDI::Property property) override;
         void startLoop();
         void stopLoop();
-        void startTimelapseBatch();
-        void processOutput();
-        void processError();
-        void computeExposureOrGain(double fromValue);
+        void computeExposureOrGain(void);
+        double sunAltitude(double JD);
         void checkArchives(void);
-        void moveCurrentToArchives(void);
+        void moveToArchives(const QString &folder);
+        void applyRetention(void);
         void calculateSunset(void);
         void addGPSLocalization(void);
         void enableParms(bool enable);
+        void saveKeogram(void);
+        void saveStack(void);
+        int expectedFrames(void);
+        bool findStars(double time);
+        void detectMeteors(const QImage &frame);
 
         QPointer<fileio> _image;
-        QImage imageStacked;
-        bool firstStack = true;
+        AutoExposure mAutoExposure;
+        double mCaptureExposure = 0;
+        int mCaptureGain = 0;
+        TrailStacker mStacker;
+        int mStackWidth = 0;
         Solver _solver;
+        SkyQuality mSkyQuality;
+        MeteorDetector mMeteors;
+        bool mExtracting = false;
+        QMetaObject::Connection mSolveFinished;
+        QElapsedTimer mExtractTimer;
+        double mExtractTime = 0;
+        double mExtractSnr = 0;
+        double mExtractExposure = 0;
         FITSImage::Statistic stats;
         long _index;
-        QProcess *_process;
-        QImage mKeog;
+        TimelapseEncoder mTimelapse;
+        FrameWriter mWriter;
+        Keogram mKeogram;
         QTimer mTimer;
         bool mIsLooping = false;
         QString mFolder;
+        ArchiveIndex mArchives;
+        ArchiveRetention mRetention;
+        qint64 mNightStart = 0;
+        double mNightCoverSum = 0;
+        int mNightCovers = 0;
+        int mNightClear = 0;
+        int mNightMeteors = 0;
         QTimer mScheduleTimer;
 
 };
@@ -0,0 +1,175 @@
+/**
+ * @file archiveindex.cpp
+ * @brief Persistent catalogue of the archived nights
+ */
+
+#include "archiveindex.h"
+
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <algorithm>
+
+namespace
+{
+const int Version = 1;
+
+QJsonObject toJson(const ArchiveIndex::Night &n)
+{
+    QJsonObject o;
+    o["folder"] = n.folder;
+    o["start"] = double(n.start);
+    o["end"] = double(n.end);
+    o["frames"] = n.frames;
+    o["meancover"] = n.meanCover;
+    o["clear"] = n.clearFraction;
+    o["meteors"] = n.meteors;
+    o["bytes"] = double(n.bytes);
+    o["imagebytes"] = double(n.imageBytes);
+    o["images"] = n.images;
+    o["thinning"] = n.thinning;
+    o["quality"] = n.quality;
+    return o;
+}
+
+ArchiveIndex::Night fromJson(const QJsonObject &o)
+{
+    ArchiveIndex::Night n;
+    n.folder = o["folder"].toString();
+    n.start = static_cast<qint64>(o["start"].toDouble());
+    n.end = static_cast<qint64>(o["end"].toDouble());
+    n.frames = o["frames"].toInt();
+    n.meanCover = o["meancover"].toDouble(99);
+    n.clearFraction = o["clear"].toDouble(99);
+    n.meteors = o["meteors"].toInt();
+    n.bytes = static_cast<qint64>(o["bytes"].toDouble());
+    n.imageBytes = static_cast<qint64>(o["imagebytes"].toDouble());
+    n.images = o["images"].toBool();
+    n.thinning = std::max(1, o["thinning"].toInt(1));
+    n.quality = o["quality"].toInt();
+    return n;
+}
+}
+
+bool ArchiveIndex::load(const QString &root)
+{
+    mRoot = root;
+    mNights.clear();
+
+    QFile file(mRoot + "/index.json");
+    if (file.open(QIODevice::ReadOnly))
+    {
+        QJsonDocument doc = QJsonDocument::fromJson(file.readAll());
+        if (doc.isObject() && doc.object()["version"].toInt() == Version)
+        {
+            for (const QJsonValue &v : doc.object()["nights"].toArray()) mNights.append(fromJson(v.toObject()));
+            sort();
+            return true;
+        }
+    }
+    rebuild();
+    return save();
+}
+
+bool ArchiveIndex::save()
+{
+    if (mRoot.isEmpty()) return false;
+    QDir().mkpath(mRoot);
+    QJsonArray nights;
+    for (const Night &n : mNights) nights.append(toJson(n));
+    QJsonObject doc;
+    doc["version"] = Version;
+    doc["nights"] = nights;
+
+    /* written aside then renamed : a crash never leaves a truncated index */
+    QFile file(mRoot + "/index.json.tmp");
+    if (!file.open(QIODevice::WriteOnly)) return false;
+    file.write(QJsonDocument(doc).toJson(QJsonDocument::Indented));
+    file.close();
+    QFile::remove(mRoot + "/index.json");
+    return QFile::rename(file.fileName(), mRoot + "/index.json");
+}
+
+void ArchiveIndex::add(const Night &night)
+{
+    remove(night.folder);
+    mNights.append(night);
+    sort();
+    save();
+}
+
+void ArchiveIndex::remove(const QString &folder)
+{
+    for (int i = mNights.size() - 1; i >= 0; i--)
+    {
+        if (mNights[i].folder == folder) mNights.removeAt(i);
+    }
+}
+
+const ArchiveIndex::Night *ArchiveIndex::find(const QString &folder) const
+{
+    for (const Night &n : mNights)
+    {
+        if (n.folder == folder) return &n;
+    }
+    return nullptr;
+}
+
+ArchiveIndex::Night ArchiveIndex::scan(const QString &folder) const
+{
+    Night n;
+    n.folder = folder;
+    QDir dir(mRoot + "/" + folder);
+    n.start = QDateTime::fromString(folder, "yyyyMMdd-hh-mm-ss").toMSecsSinceEpoch();
+    n.end = n.start;
+
+    for (const QFileInfo &f : dir.entryInfoList(QDir::Files))
+    {
+        n.bytes += f.size();
+        n.end = std::max(n.end, f.lastModified().toMSecsSinceEpoch());
+    }
+    QDir images(dir.filePath("images"));
+    if (images.exists())
+    {
+        for (const QFileInfo &f : images.entryInfoList({"*.jpeg"}, QDir::Files))
+        {
+            n.imageBytes += f.size();
+            n.frames++;
+        }
+        n.bytes += n.imageBytes;
+        n.images = n.frames > 0;
+    }
+    QDir meteors(dir.filePath("meteors"));
+    if (meteors.exists())
+    {
+        for (const QFileInfo &f : meteors.entryInfoList(QDir::Files))
+        {
+            n.bytes += f.size();
+            if (f.suffix() == "jpeg") n.meteors++;
+        }
+    }
+    return n;
+}
+
+void ArchiveIndex::rebuild()
+{
+    mNights.clear();
+    QDir dir(mRoot);
+    for (const QString &folder : dir.entryList(QDir::Dirs | QDir::NoDotAndDotDot))
+    {
+        mNights.append(scan(folder));
+    }
+    sort();
+}
+
+void ArchiveIndex::sort()
+{
+    std::sort(mNights.begin(), mNights.end(), [](const Night & a, const Night & b)
+    {
+        return a.folder < b.folder;
+    });
+}
@@ -0,0 +1,71 @@
+/**
+ * @file archiveindex.h
+ * @brief Persistent catalogue of the archived nights
+ *
+ * archives/index.json holds one entry per night folder with what the
+ * archive list shows (frames, duration, cloud statistics, meteors, disk
+ * usage), so listing the archives reads one small file : O(nights), no
+ * walk through the images/ folders.
+ *
+ * Entries are added as nights are archived. When the index is missing
+ * (first start after an upgrade) it is rebuilt once from the top level
+ * folders only ; frame counts and sizes of these older nights are filled
+ * from their files, a one time cost.
+ */
+
+#pragma once
+
+#include <QList>
+#include <QString>
+
+class ArchiveIndex
+{
+    public:
+        struct Night
+        {
+            QString folder;
+            qint64 start = 0;       ///< ms since epoch
+            qint64 end = 0;
+            int frames = 0;
+            double meanCover = 99;  ///< %, 99 : not measured
+            double clearFraction = 99; ///< % of frames under 20% cover, 99 : not measured
+            int meteors = 0;
+            qint64 bytes = 0;
+            qint64 imageBytes = 0;  ///< part of bytes in images/
+            bool images = false;    ///< individual frames kept
+            int thinning = 1;       ///< one frame kept every thinning, see ArchiveRetention
+            int quality = 0;        ///< jpeg quality of the recompressed frames, 0 : as captured
+        };
+
+        /// Read root/index.json, rebuild it from the folders when missing or unreadable
+        bool load(const QString &root);
+        bool save();
+        /// Add or replace the entry of night.folder and save
+        void add(const Night &night);
+        /// Entry filled from the files of an archived folder
+        Night scan(const QString &folder) const;
+        void remove(const QString &folder);
+        /// Entry of folder, nullptr when not indexed
+        const Night *find(const QString &folder) const;
+
+        /// Nights sorted by folder name (date)
+        const QList<Night> &nights() const
+        {
+            return mNights;
+        }
+        QString root() const
+        {
+            return mRoot;
+        }
+        bool isLoaded() const
+        {
+            return !mRoot.isEmpty();
+        }
+
+    private:
+        void rebuild();
+        void sort();
+
+        QString mRoot;
+        QList<Night> mNights;
+};
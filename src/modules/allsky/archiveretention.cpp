@@ -0,0 +1,245 @@
+/**
+ * @file archiveretention.cpp
+ * @brief Age and size based housekeeping of the archived nights
+ */
+
+#include "archiveretention.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QImageReader>
+#include <QImageWriter>
+#include <QMutexLocker>
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+const double DayMs = 86400000.0;
+
+#ifdef __linux__
+/* from linux/ioprio.h, not always installed */
+const int IoprioWhoProcess = 1;
+const int IoprioClassIdle = 3;
+const int IoprioClassShift = 13;
+#endif
+}
+
+ArchiveRetention::ArchiveRetention(QObject *parent) : QThread(parent)
+{
+    start(QThread::IdlePriority);
+}
+
+ArchiveRetention::~ArchiveRetention()
+{
+    {
+        QMutexLocker locker(&mMutex);
+        mStop = true;
+        mInterrupt = true;
+        mNotEmpty.wakeAll();
+    }
+    wait();
+}
+
+QList<ArchiveRetention::Task> ArchiveRetention::plan(const QList<ArchiveIndex::Night> &nights, const Policy &policy,
+        qint64 now)
+{
+    QList<Task> tasks;
+    const int count = nights.size();
+    std::vector<qint64> bytes(count), imageBytes(count);
+    std::vector<char> images(count), deleted(count, 0);
+    qint64 total = 0;
+
+    auto forget = [&tasks](const QString & folder)
+    {
+        for (int k = tasks.size() - 1; k >= 0; k--)
+        {
+            if (tasks[k].folder == folder) tasks.removeAt(k);
+        }
+    };
+
+    /* age rules, nights are sorted oldest first */
+    for (int i = 0; i < count; i++)
+    {
+        const ArchiveIndex::Night &n = nights[i];
+        const double age = (now - n.end) / DayMs;
+        bytes[i] = n.bytes;
+        imageBytes[i] = n.imageBytes;
+        images[i] = n.images;
+        total += n.bytes;
+
+        if (policy.deleteDays > 0 && age >= policy.deleteDays && i < count - 1)
+        {
+            tasks.append({n.folder, Delete, 0});
+            deleted[i] = 1;
+            total -= bytes[i];
+            continue;
+        }
+        if (!n.images) continue;
+        if (policy.videoDays > 0 && age >= policy.videoDays)
+        {
+            tasks.append({n.folder, DropImages, 0});
+            images[i] = 0;
+            total -= imageBytes[i];
+            bytes[i] -= imageBytes[i];
+            continue;
+        }
+        if (policy.thinDays > 0 && age >= policy.thinDays)
+        {
+            int keep = 2;
+            for (double d = 2.0 * policy.thinDays; age >= d && keep < policy.maxThinning; d += policy.thinDays) keep *= 2;
+            keep = std::max(2, std::min(keep, policy.maxThinning));
+            if (keep > n.thinning)
+            {
+                tasks.append({n.folder, Thin, keep});
+                qint64 left = imageBytes[i] * n.thinning / keep;
+                total -= imageBytes[i] - left;
+                bytes[i] -= imageBytes[i] - left;
+                imageBytes[i] = left;
+            }
+        }
+        if (policy.recompressDays > 0 && age >= policy.recompressDays && policy.quality > 0
+                && (n.quality == 0 || n.quality > policy.quality))
+        {
+            tasks.append({n.folder, Recompress, policy.quality});
+        }
+    }
+
+    /* size quota : frames of the oldest nights first, then the oldest nights */
+    if (policy.maxBytes <= 0) return tasks;
+    for (int i = 0; i < count && total > policy.maxBytes; i++)
+    {
+        if (deleted[i] || !images[i]) continue;
+        forget(nights[i].folder);
+        tasks.append({nights[i].folder, DropImages, 0});
+        images[i] = 0;
+        total -= imageBytes[i];
+        bytes[i] -= imageBytes[i];
+    }
+    for (int i = 0; i < count - 1 && total > policy.maxBytes; i++)
+    {
+        if (deleted[i]) continue;
+        forget(nights[i].folder);
+        tasks.append({nights[i].folder, Delete, 0});
+        deleted[i] = 1;
+        total -= bytes[i];
+    }
+    return tasks;
+}
+
+void ArchiveRetention::schedule(const QString &root, const QList<Task> &tasks)
+{
+    QMutexLocker locker(&mMutex);
+    mRoot = root;
+    mQueue.clear();
+    for (const Task &task : tasks)
+    {
+        /* the running task already takes care of that night */
+        if (task.folder != mCurrent) mQueue.append(task);
+    }
+    if (!mQueue.isEmpty()) mNotEmpty.wakeOne();
+}
+
+void ArchiveRetention::cancel()
+{
+    QMutexLocker locker(&mMutex);
+    mQueue.clear();
+    mInterrupt = true;
+}
+
+void ArchiveRetention::run()
+{
+#ifdef __linux__
+    /* idle I/O class : this thread only gets the disk when nobody else wants it */
+    syscall(SYS_ioprio_set, IoprioWhoProcess, 0, IoprioClassIdle << IoprioClassShift);
+#endif
+    forever
+    {
+        Task task;
+        {
+            QMutexLocker locker(&mMutex);
+            while (!mStop && mQueue.isEmpty()) mNotEmpty.wait(&mMutex);
+            if (mStop) return;
+            task = mQueue.takeFirst();
+            mCurrent = task.folder;
+            mInterrupt = false;
+        }
+        bool complete = execute(task);
+        {
+            QMutexLocker locker(&mMutex);
+            mCurrent.clear();
+            if (mStop) return;
+        }
+        emit taskDone(task.folder, task.action, task.value, complete);
+    }
+}
+
+bool ArchiveRetention::execute(const Task &task)
+{
+    /* never leave the archives folder */
+    if (mRoot.isEmpty() || task.folder.isEmpty() || task.folder.contains('/') || task.folder.startsWith('.')) return false;
+    QString folder = mRoot + "/" + task.folder;
+    switch (task.action)
+    {
+        case Thin:
+            return thin(folder, task.value);
+        case Recompress:
+            return recompress(folder, task.value);
+        case DropImages:
+            return QDir(folder + "/images").removeRecursively();
+        case Delete:
+            return QDir(folder).removeRecursively();
+    }
+    return false;
+}
+
+bool ArchiveRetention::thin(const QString &folder, int keep)
+{
+    if (keep < 2) return true;
+    QDir images(folder + "/images");
+    for (const QFileInfo &f : images.entryInfoList({"*.jpeg"}, QDir::Files, QDir::Name))
+    {
+        if (mInterrupt) return false;
+        bool ok;
+        int index = f.completeBaseName().toInt(&ok);
+        if (!ok || index % keep == 0) continue;
+        QFile::remove(f.filePath());
+        msleep(pause);
+    }
+    return true;
+}
+
+bool ArchiveRetention::recompress(const QString &folder, int quality)
+{
+    QDir images(folder + "/images");
+    for (const QFileInfo &f : images.entryInfoList({"*.jpeg"}, QDir::Files, QDir::Name))
+    {
+        if (mInterrupt) return false;
+        QImage image = QImageReader(f.filePath()).read();
+        if (image.isNull()) continue;
+        QString tmp = f.filePath() + ".tmp";
+        QImageWriter writer(tmp, "jpeg");
+        writer.setQuality(quality);
+        writer.setOptimizedWrite(true);
+        /* an already small frame is left as it is, recompressing it again only loses detail */
+        if (writer.write(image) && QFileInfo(tmp).size() < f.size())
+        {
+            if (::rename(QFile::encodeName(tmp).constData(), QFile::encodeName(f.filePath()).constData()) != 0)
+            {
+                QFile::remove(tmp);
+            }
+        }
+        else
+        {
+            QFile::remove(tmp);
+        }
+        msleep(pause);
+    }
+    return true;
+}
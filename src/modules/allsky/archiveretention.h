@@ -0,0 +1,96 @@
+/**
+ * @file archiveretention.h
+ * @brief Age and size based housekeeping of the archived nights
+ *
+ * plan() turns the archive index and a policy into a list of tasks, from
+ * the oldest night to the newest :
+ *   - frames are thinned progressively, one kept out of 2 after thinDays,
+ *     out of 4 after twice that age, and so on up to maxThinning
+ *   - frames are recompressed at a lower jpeg quality after recompressDays
+ *   - individual frames are dropped after videoDays, keogram, stack,
+ *     timelapse and meteor crops stay
+ *   - whole nights are deleted after deleteDays
+ *   - above the size quota, frames of the oldest nights are dropped first,
+ *     then the oldest nights deleted ; the newest night is always kept
+ *
+ * The tasks run on an idle priority thread, with the idle I/O class on
+ * Linux and a short pause between files, so the capture keeps the card.
+ * A task is done file by file and can be run again after an interruption.
+ */
+
+#pragma once
+
+#include "archiveindex.h"
+
+#include <QList>
+#include <QMutex>
+#include <QThread>
+#include <QWaitCondition>
+#include <atomic>
+
+class ArchiveRetention : public QThread
+{
+        Q_OBJECT
+
+    public:
+        enum Action
+        {
+            Thin,           ///< keep one frame out of value
+            Recompress,     ///< rewrite frames at jpeg quality value
+            DropImages,     ///< remove images/
+            Delete          ///< remove the whole night
+        };
+
+        struct Task
+        {
+            QString folder;
+            Action action;
+            int value;
+        };
+
+        /// 0 disables a rule
+        struct Policy
+        {
+            int thinDays = 0;
+            int maxThinning = 16;
+            int recompressDays = 0;
+            int quality = 60;
+            int videoDays = 0;
+            int deleteDays = 0;
+            qint64 maxBytes = 0;
+        };
+
+        explicit ArchiveRetention(QObject *parent = nullptr);
+        ~ArchiveRetention();
+
+        /// Tasks needed for nights to comply with policy at time now (ms since epoch)
+        static QList<Task> plan(const QList<ArchiveIndex::Night> &nights, const Policy &policy, qint64 now);
+
+        /// Replace the waiting tasks, root is the archives folder
+        void schedule(const QString &root, const QList<Task> &tasks);
+        /// Drop the waiting tasks and interrupt the current one
+        void cancel();
+
+        /// Pause between two files, ms
+        int pause = 10;
+
+    signals:
+        /// Emitted from the worker thread, connections are queued
+        void taskDone(const QString &folder, int action, int value, bool complete);
+
+    protected:
+        void run() override;
+
+    private:
+        bool execute(const Task &task);
+        bool thin(const QString &folder, int keep);
+        bool recompress(const QString &folder, int quality);
+
+        QString mRoot;
+        QList<Task> mQueue;
+        QString mCurrent;
+        QMutex mMutex;
+        QWaitCondition mNotEmpty;
+        bool mStop = false;
+        std::atomic<bool> mInterrupt { false };
+};
@@ -0,0 +1,190 @@
+/**
+ * @file autoexposure.cpp
+ * @brief Predictive exposure (or gain) control for the allsky camera
+ */
+
+#include "autoexposure.h"
+
+#include <fitsio.h>
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+/* least squares y = a + b x, false when x does not move enough */
+bool lineFit(const double *x, const double *y, int n, double minSpan, double &a, double &b)
+{
+    double sx = 0, sy = 0, sxx = 0, sxy = 0;
+    double lo = x[0], hi = x[0];
+    for (int i = 0; i < n; i++)
+    {
+        sx += x[i];
+        sy += y[i];
+        sxx += x[i] * x[i];
+        sxy += x[i] * y[i];
+        lo = std::min(lo, x[i]);
+        hi = std::max(hi, x[i]);
+    }
+    double d = n * sxx - sx * sx;
+    if (hi - lo < minSpan || std::fabs(d) < 1e-12) return false;
+    b = (n * sxy - sx * sy) / d;
+    a = (sy - b * sx) / n;
+    return true;
+}
+}
+
+template <typename T>
+void AutoExposure::histogram(const T *data, const FITSImage::Statistic &stats, double scale, double maskRadius)
+{
+    const int w = stats.width;
+    const int h = stats.height;
+    const int channels = stats.channels >= 3 ? 3 : 1;
+    const double cx = w / 2.0;
+    const double cy = h / 2.0;
+    const double r = maskRadius > 0 ? maskRadius / 100 * std::min(w, h) / 2 : std::hypot(cx, cy);
+    const int step = std::max(1, std::min(w, h) / 256);
+
+    for (int y = step / 2; y < h; y += step)
+    {
+        double dy = y + 0.5 - cy;
+        if (std::fabs(dy) > r) continue;
+        double half = std::sqrt(r * r - dy * dy);
+        int x0 = std::max(0, static_cast<int>(std::ceil(cx - half)));
+        int x1 = std::min(w - 1, static_cast<int>(cx + half));
+        x0 += (step - x0 % step) % step;
+        for (int x = x0; x <= x1; x += step)
+        {
+            double v = 0;
+            for (int c = 0; c < channels; c++) v += data[(static_cast<size_t>(c) * h + y) * w + x];
+            v /= channels;
+            int bin = std::min(Bins - 1, std::max(0, static_cast<int>(v * scale)));
+            mHistogram[bin]++;
+            mSum += v;
+            mCount++;
+        }
+    }
+}
+
+double AutoExposure::measure(const FITSImage::Statistic &stats, const uint8_t *buffer, Measure measure,
+                             double maskRadius)
+{
+    std::fill(mHistogram, mHistogram + Bins, 0.0);
+    mRange = 0;
+    mSum = 0;
+    mCount = 0;
+    if (!buffer || stats.width <= 0 || stats.height <= 0) return 0;
+
+    double range = 1;
+    switch (stats.dataType)
+    {
+        case TBYTE:
+            range = 256;
+            histogram(buffer, stats, Bins / range, maskRadius);
+            break;
+        case TUSHORT:
+            range = 65536;
+            histogram(reinterpret_cast<const uint16_t *>(buffer), stats, Bins / range, maskRadius);
+            break;
+        case TFLOAT:
+            range = stats.max[0] > 0 ? stats.max[0] : 1;
+            histogram(reinterpret_cast<const float *>(buffer), stats, Bins / range, maskRadius);
+            break;
+        default:
+            return measure == Median ? stats.median[0] : stats.mean[0];
+    }
+    mRange = range;
+    if (mCount == 0) return 0;
+    if (measure == Mean) return mSum / mCount;
+
+    /* median, interpolated inside its bin */
+    double half = mCount / 2;
+    double cumul = 0;
+    for (int i = 0; i < Bins; i++)
+    {
+        if (cumul + mHistogram[i] >= half)
+        {
+            double f = mHistogram[i] > 0 ? (half - cumul) / mHistogram[i] : 0;
+            return (i + f) * range / Bins;
+        }
+        cumul += mHistogram[i];
+    }
+    return range;
+}
+
+void AutoExposure::reset()
+{
+    mSamples.clear();
+    mPredictedLevel = 0;
+}
+
+double AutoExposure::next(double value, double level, double time, double nextTime, double sunNow, double sunNext)
+{
+    auto clamp = [this](double v)
+    {
+        if (v < minValue) v = minValue;
+        if (maxValue > minValue && v > maxValue) v = maxValue;
+        return v;
+    };
+    if (target <= 0) return clamp(value);
+    /* gain 0 is a usual start : ratios need a positive value, the lowest allowed or one unit */
+    if (value <= 0) value = minValue > 0 ? minValue : 1;
+
+    /* a saturated frame only tells the sky is brighter : no history, largest step down */
+    if (mRange > 0 && level >= 0.95 * mRange)
+    {
+        mSamples.clear();
+        mPredictedLevel = level;
+        return clamp(value / maxStep);
+    }
+
+    /* brightness per unit of exposure, log so that a fit is a constant rate of change */
+    double logSky = std::log(std::max(level, 1e-6) / value);
+    mSamples.push_back({time, sunNow, logSky});
+    while (static_cast<int>(mSamples.size()) > std::max(2, history)) mSamples.pop_front();
+
+    double fitted = logSky;
+    double predicted = logSky;
+    int n = static_cast<int>(mSamples.size());
+    if (predict && n >= 3)
+    {
+        double sun[64], t[64], y[64];
+        n = std::min(n, 64);
+        for (int i = 0; i < n; i++)
+        {
+            const Sample &s = mSamples[mSamples.size() - n + i];
+            sun[i] = s.sun;
+            t[i] = s.time - time;
+            y[i] = s.logSky;
+        }
+        double a, b;
+        bool twilight = sunNow > -18 && sunNow < 6;
+        if (twilight && lineFit(sun, y, n, 0.05, a, b))
+        {
+            fitted = a + b * sunNow;
+            predicted = a + b * sunNext;
+        }
+        else if (lineFit(t, y, n, 1, a, b))
+        {
+            fitted = a;
+            predicted = a + b * (nextTime - time);
+        }
+
+        /* a bad fit must not throw the exposure away */
+        double limit = std::log(maxStep);
+        fitted = std::max(logSky - limit, std::min(logSky + limit, fitted));
+        predicted = std::max(fitted - limit, std::min(fitted + limit, predicted));
+    }
+
+    mPredictedLevel = std::exp(predicted) * value;
+    if (std::fabs(mPredictedLevel - target) <= threshold * target) return clamp(value);
+
+    /* the trend is followed as is, only the remaining level error is damped, unless far from target */
+    double current = std::log(value);
+    double error = std::log(target) - fitted - current;
+    double gain = std::fabs(error) > std::log(2.0) ? 1 : 1 - std::max(0.0, std::min(0.95, damping));
+    double step = (fitted - predicted) + gain * error;
+    step = std::max(-std::log(maxStep), std::min(std::log(maxStep), step));
+    double out = clamp(std::exp(current + step));
+    mPredictedLevel = std::exp(predicted) * out;
+    return out;
+}
@@ -0,0 +1,77 @@
+/**
+ * @file autoexposure.h
+ * @brief Predictive exposure (or gain) control for the allsky camera
+ *
+ * The sky level is measured on a downsampled histogram of the native buffer,
+ * restricted to a centred circle : black corners outside the fisheye and the
+ * horizon no longer pull the level down.
+ *
+ * Sky brightness is tracked per unit of exposure, in log. During twilight it
+ * follows the sun altitude closely, so the next value is extrapolated from a
+ * fit against the altitude the sun will have at the next frame ; otherwise
+ * from the recent time trend. The correction is damped, and skipped while the
+ * predicted level stays within threshold of the target.
+ */
+
+#pragma once
+
+#include <solver.h>
+#include <deque>
+
+class AutoExposure
+{
+    public:
+        enum Measure
+        {
+            Mean = 0,
+            Median = 1
+        };
+
+        /// Sky level (ADU, first channel scale) inside the mask, maskRadius in % of the half short side, 0 : full frame
+        double measure(const FITSImage::Statistic &stats, const uint8_t *buffer, Measure measure, double maskRadius);
+        /// Forget the brightness history (new night, camera change)
+        void reset();
+        /**
+         * @brief New exposure (or gain) from the last frame
+         * @param value exposure (or gain) the frame was taken with
+         * @param level level measured on that frame
+         * @param time, nextTime frame and next frame times, seconds
+         * @param sunNow, sunNext sun altitude at these times, degrees
+         */
+        double next(double value, double level, double time, double nextTime, double sunNow, double sunNext);
+
+        /// Last predicted sky level for the returned value
+        double predictedLevel() const
+        {
+            return mPredictedLevel;
+        }
+
+        double target = 0;
+        double threshold = 0;       ///< Relative dead band, 0.1 : +/-10% around target
+        double damping = 0.5;       ///< 0 : full correction, 0.9 : 10% of it per frame
+        double minValue = 0;
+        double maxValue = 0;        ///< No limit when not above minValue
+        bool predict = true;
+        int history = 6;            ///< Frames used for the trend
+        double maxStep = 4;         ///< Largest change factor per frame
+
+    private:
+        struct Sample
+        {
+            double time;
+            double sun;
+            double logSky;
+        };
+
+        template <typename T> void histogram(const T *data, const FITSImage::Statistic &stats, double scale,
+                                             double maskRadius);
+
+        std::deque<Sample> mSamples;
+        double mPredictedLevel = 0;
+
+        static const int Bins = 4096;
+        double mHistogram[Bins];
+        double mRange = 0;          ///< Saturation level of the last measured frame
+        double mSum = 0;
+        double mCount = 0;
+};
@@ -0,0 +1,62 @@
+/**
+ * @file binning.cpp
+ * @brief Mono binning of the native sensor buffer, shared by the frame analysers
+ */
+
+#include "binning.h"
+
+#include <fitsio.h>
+#include <algorithm>
+#include <vector>
+
+namespace
+{
+template <typename T>
+void bin(const T *data, int w, int h, int channels, int factor, float *out)
+{
+    const int ow = w / factor;
+    const int oh = h / factor;
+    const float k = 1.0f / (factor * factor * channels);
+    std::vector<float> column(w);
+    for (int oy = 0; oy < oh; oy++)
+    {
+        std::fill(column.begin(), column.end(), 0.0f);
+        for (int c = 0; c < channels; c++)
+        {
+            for (int y = oy * factor; y < (oy + 1) * factor; y++)
+            {
+                const T *in = data + (static_cast<size_t>(c) * h + y) * w;
+                float *acc = column.data();
+                for (int x = 0; x < w; x++) acc[x] += in[x];
+            }
+        }
+        float *line = out + static_cast<size_t>(oy) * ow;
+        for (int x = 0; x < ow; x++)
+        {
+            float sum = 0;
+            for (int i = 0; i < factor; i++) sum += column[x * factor + i];
+            line[x] = sum * k;
+        }
+    }
+}
+}
+
+bool binMono(const FITSImage::Statistic &stats, const uint8_t *buffer, int factor, float *out)
+{
+    const int channels = stats.channels >= 3 ? 3 : 1;
+    factor = std::max(1, factor);
+    switch (stats.dataType)
+    {
+        case TBYTE:
+            bin(buffer, stats.width, stats.height, channels, factor, out);
+            return true;
+        case TUSHORT:
+            bin(reinterpret_cast<const uint16_t *>(buffer), stats.width, stats.height, channels, factor, out);
+            return true;
+        case TFLOAT:
+            bin(reinterpret_cast<const float *>(buffer), stats.width, stats.height, channels, factor, out);
+            return true;
+        default:
+            return false;
+    }
+}
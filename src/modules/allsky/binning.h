@@ -0,0 +1,17 @@
+/**
+ * @file binning.h
+ * @brief Mono binning of the native sensor buffer, shared by the frame analysers
+ */
+
+#pragma once
+
+#include <solver.h>
+
+/**
+ * @brief Average factor x factor blocks of every channel into one float plane
+ *
+ * out holds (width / factor) x (height / factor) values. Lines are summed
+ * vertically first over contiguous memory (vectorized), then reduced once
+ * horizontally. False for unsupported data types.
+ */
+bool binMono(const FITSImage::Statistic &stats, const uint8_t *buffer, int factor, float *out);
@@ -0,0 +1,170 @@
+/**
+ * @file framewriter.cpp
+ * @brief Background output stage for the allsky images
+ */
+
+#include "framewriter.h"
+
+#include <QBuffer>
+#include <QFile>
+#include <QImageWriter>
+#include <QMutexLocker>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+
+FrameWriter::FrameWriter(QObject *parent) : QThread(parent)
+{
+    start(QThread::LowPriority);
+}
+
+FrameWriter::~FrameWriter()
+{
+    {
+        QMutexLocker locker(&mMutex);
+        mStop = true;
+        mNotEmpty.wakeAll();
+        mNotFull.wakeAll();
+    }
+    wait();
+}
+
+void FrameWriter::writeJpeg(const QImage &image, const QStringList &paths, int quality, std::function<void()> done)
+{
+    if (image.isNull() || paths.isEmpty()) return;
+    Job job;
+    job.key = paths.first();
+    job.image = image;
+    job.paths = paths;
+    job.quality = qBound(1, quality, 100);
+    job.done = std::move(done);
+    enqueue(std::move(job));
+}
+
+void FrameWriter::post(const QString &key, std::function<void()> task, std::function<void()> done)
+{
+    Job job;
+    job.key = key;
+    job.task = std::move(task);
+    job.done = std::move(done);
+    enqueue(std::move(job));
+}
+
+void FrameWriter::enqueue(Job &&job)
+{
+    QMutexLocker locker(&mMutex);
+    for (Job &queued : mQueue)
+    {
+        if (queued.key == job.key)
+        {
+            queued = std::move(job);
+            mSuperseded++;
+            return;
+        }
+    }
+    while (!mStop && static_cast<int>(mQueue.size()) >= maxQueued) mNotFull.wait(&mMutex);
+    if (mStop) return;
+    mQueue.push_back(std::move(job));
+    mNotEmpty.wakeOne();
+}
+
+void FrameWriter::flush()
+{
+    QMutexLocker locker(&mMutex);
+    while (!mStop && (mBusy || !mQueue.empty())) mIdle.wait(&mMutex);
+}
+
+int FrameWriter::pending()
+{
+    QMutexLocker locker(&mMutex);
+    return static_cast<int>(mQueue.size()) + (mBusy ? 1 : 0);
+}
+
+void FrameWriter::run()
+{
+    forever
+    {
+        Job job;
+        {
+            QMutexLocker locker(&mMutex);
+            while (!mStop && mQueue.empty())
+            {
+                mBusy = false;
+                mIdle.wakeAll();
+                mNotEmpty.wait(&mMutex);
+            }
+            if (mStop) return;
+            job = std::move(mQueue.front());
+            mQueue.pop_front();
+            mBusy = true;
+            mNotFull.wakeOne();
+        }
+
+        QString error = write(job);
+        /* signals cross to the owner thread, nothing published for a file that is not there */
+        if (!error.isEmpty()) emit failed(error);
+        else if (job.done) QMetaObject::invokeMethod(this, job.done, Qt::QueuedConnection);
+    }
+}
+
+QString FrameWriter::write(const Job &job)
+{
+    if (job.task)
+    {
+        job.task();
+        return QString();
+    }
+
+    QByteArray bytes;
+    QBuffer buffer(&bytes);
+    buffer.open(QIODevice::WriteOnly);
+    QImageWriter encoder(&buffer, "jpeg");
+    encoder.setQuality(job.quality);
+    encoder.setOptimizedWrite(true);
+    if (!encoder.write(job.image)) return "Can't encode " + job.key + " : " + encoder.errorString();
+
+    const QString &first = job.paths.first();
+    QFile out(first + ".tmp");
+    if (!out.open(QIODevice::WriteOnly) || out.write(bytes) != bytes.size())
+    {
+        QString error = "Can't write " + first + " : " + out.errorString();
+        out.close();
+        out.remove();
+        return error;
+    }
+    out.close();
+    /* POSIX rename replaces the target atomically, QFile::rename refuses to overwrite */
+    if (!replace(out.fileName(), first)) return "Can't rename " + out.fileName() + " : " + strerror(errno);
+
+    /* same bytes elsewhere : hard link (every file is replaced by rename, so links never see a later frame) */
+    QString error;
+    for (int i = 1; i < job.paths.size(); i++)
+    {
+        const QString &path = job.paths.at(i);
+        QString tmp = path + ".tmp";
+        QFile::remove(tmp);
+        if (::link(QFile::encodeName(first).constData(), QFile::encodeName(tmp).constData()) != 0)
+        {
+            QFile copy(tmp);
+            if (!copy.open(QIODevice::WriteOnly) || copy.write(bytes) != bytes.size())
+            {
+                error = "Can't write " + path + " : " + copy.errorString();
+                copy.close();
+                copy.remove();
+                continue;
+            }
+        }
+        if (!replace(tmp, path)) error = "Can't rename " + tmp + " : " + strerror(errno);
+    }
+    return error;
+}
+
+bool FrameWriter::replace(const QString &tmp, const QString &path)
+{
+    if (::rename(QFile::encodeName(tmp).constData(), QFile::encodeName(path).constData()) == 0) return true;
+    int error = errno;
+    QFile::remove(tmp);
+    errno = error;
+    return false;
+}
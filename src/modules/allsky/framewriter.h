@@ -0,0 +1,86 @@
+/**
+ * @file framewriter.h
+ * @brief Background output stage for the allsky images
+ *
+ * Encoding and disk writes run on a dedicated thread, so slow storage (SD
+ * cards) no longer delays the next exposure :
+ *   - an image is encoded once, the first path receives the bytes and the
+ *     other paths are hard links to it (copies when links are unsupported)
+ *   - files are written under a temporary name then renamed, a client never
+ *     reads a half written jpeg
+ *   - a job for a path already waiting in the queue replaces it, only the
+ *     latest live preview, stack or keogram is written
+ *   - the queue is bounded : when full the caller waits, archived frames are
+ *     never silently lost
+ *
+ * The optional done callback runs in the owner thread once the files are on
+ * disk, that is where images are published to the clients. A failed write
+ * runs no callback and is reported by failed(), temporary files are removed.
+ */
+
+#pragma once
+
+#include <QImage>
+#include <QMutex>
+#include <QStringList>
+#include <QThread>
+#include <QWaitCondition>
+#include <deque>
+#include <functional>
+
+class FrameWriter : public QThread
+{
+        Q_OBJECT
+
+    public:
+        explicit FrameWriter(QObject *parent = nullptr);
+        ~FrameWriter();
+
+        /// Encode image once as jpeg and store it in every path
+        void writeJpeg(const QImage &image, const QStringList &paths, int quality, std::function<void()> done = nullptr);
+        /// Run any other write (FITS...), key identifies the target for replacement
+        void post(const QString &key, std::function<void()> task, std::function<void()> done = nullptr);
+        /// Wait until every queued job is written
+        void flush();
+
+        int pending();
+        int superseded() const
+        {
+            return mSuperseded;
+        }
+
+        /// Jobs allowed in the queue before the caller waits
+        int maxQueued = 8;
+
+    signals:
+        /// Encode or write error, received in the owner thread
+        void failed(const QString &message);
+
+    protected:
+        void run() override;
+
+    private:
+        struct Job
+        {
+            QString key;
+            QImage image;
+            QStringList paths;
+            int quality = 90;
+            std::function<void()> task;
+            std::function<void()> done;
+        };
+
+        void enqueue(Job &&job);
+        /// Empty when every path was written
+        QString write(const Job &job);
+        static bool replace(const QString &tmp, const QString &path);
+
+        std::deque<Job> mQueue;
+        QMutex mMutex;
+        QWaitCondition mNotEmpty;
+        QWaitCondition mNotFull;
+        QWaitCondition mIdle;
+        bool mBusy = false;
+        bool mStop = false;
+        int mSuperseded = 0;
+};
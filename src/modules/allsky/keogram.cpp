@@ -0,0 +1,51 @@
+/**
+ * @file keogram.cpp
+ * @brief Keogram built in place, one column per frame
+ */
+
+#include "keogram.h"
+
+#include <algorithm>
+
+void Keogram::reset(int height, int expectedFrames)
+{
+    mHeight = std::max(1, height);
+    mCount = 0;
+    mImage = QImage(std::max(16, expectedFrames), mHeight, QImage::Format_RGB32);
+    mImage.fill(Qt::black);
+}
+
+void Keogram::grow(int capacity)
+{
+    QImage bigger(capacity, mHeight, QImage::Format_RGB32);
+    bigger.fill(Qt::black);
+    for (int y = 0; y < mHeight; y++)
+    {
+        const QRgb *from = reinterpret_cast<const QRgb *>(mImage.constScanLine(y));
+        QRgb *to = reinterpret_cast<QRgb *>(bigger.scanLine(y));
+        std::copy(from, from + mCount, to);
+    }
+    mImage = bigger;
+}
+
+void Keogram::addColumn(const QImage &column)
+{
+    if (column.isNull()) return;
+    if (mImage.isNull() || (column.height() != mHeight && mCount == 0)) reset(column.height(), capacity());
+    if (mCount == capacity()) grow(capacity() + capacity() / 2);
+
+    QImage src = column.format() == QImage::Format_RGB32 ? column : column.convertToFormat(QImage::Format_RGB32);
+    if (src.height() != mHeight) src = src.scaled(1, mHeight);
+
+    for (int y = 0; y < mHeight; y++)
+    {
+        reinterpret_cast<QRgb *>(mImage.scanLine(y))[mCount] = reinterpret_cast<const QRgb *>(src.constScanLine(y))[0];
+    }
+    mCount++;
+}
+
+QImage Keogram::view() const
+{
+    if (mCount == 0) return QImage();
+    return QImage(mImage.constBits(), mCount, mHeight, mImage.bytesPerLine(), QImage::Format_RGB32);
+}
@@ -0,0 +1,47 @@
+/**
+ * @file keogram.h
+ * @brief Keogram built in place, one column per frame
+ *
+ * The image is allocated once for the number of frames expected from the
+ * schedule. Each frame writes its column directly into the buffer: adding a
+ * frame costs O(height) instead of repainting the whole keogram. When the
+ * night lasts longer than planned, capacity grows by half (amortized
+ * O(1) per frame).
+ *
+ * view() exposes the filled part without copying, for encoding.
+ */
+
+#pragma once
+
+#include <QImage>
+
+class Keogram
+{
+    public:
+        /// Drop the current keogram, preallocate for expected frames of height pixels
+        void reset(int height, int expectedFrames);
+        /// Append the first column of column (scaled to height if needed)
+        void addColumn(const QImage &column);
+
+        int count() const
+        {
+            return mCount;
+        }
+        int capacity() const
+        {
+            return mImage.width();
+        }
+        bool isEmpty() const
+        {
+            return mCount == 0;
+        }
+        /// Filled part of the keogram, shares the buffer : valid until next addColumn/reset
+        QImage view() const;
+
+    private:
+        void grow(int capacity);
+
+        QImage mImage;
+        int mHeight = 0;
+        int mCount = 0;
+};
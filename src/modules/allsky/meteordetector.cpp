@@ -0,0 +1,285 @@
+/**
+ * @file meteordetector.cpp
+ * @brief Streak detection (meteors, satellites, planes) by frame differencing
+ */
+
+#include "meteordetector.h"
+#include "binning.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+const int ThetaBins = 180;
+
+float sampleMedian(const std::vector<float> &values, const std::vector<uint8_t> &mask)
+{
+    std::vector<float> sample;
+    sample.reserve(4096);
+    size_t stride = std::max<size_t>(1, values.size() / 4096);
+    for (size_t i = 0; i < values.size(); i += stride)
+    {
+        if (mask[i]) sample.push_back(values[i]);
+    }
+    if (sample.empty()) return 0;
+    std::nth_element(sample.begin(), sample.begin() + sample.size() / 2, sample.end());
+    return sample[sample.size() / 2];
+}
+}
+
+void MeteorDetector::reset()
+{
+    mWidth = 0;
+    mHeight = 0;
+    mFrames = 0;
+    mOverflow = false;
+    mDetections.clear();
+    mPrevious.clear();
+    mCurrent.clear();
+}
+
+void MeteorDetector::setup(int width, int height, int bin)
+{
+    mWidth = width;
+    mHeight = height;
+    mBin = bin;
+    mFrames = 0;
+    const size_t n = static_cast<size_t>(width) * height;
+    mFrame.assign(n, 0);
+    mBackground.assign(n, 0);
+    mHits.assign(n, 0);
+    mMask.assign(n, 1);
+    mPoints.clear();
+    mPoints.reserve(maxPoints + 1);
+
+    const double cx = width / 2.0;
+    const double cy = height / 2.0;
+    const double r = maskRadius > 0 ? maskRadius / 100 * std::min(width, height) / 2 : std::hypot(cx, cy);
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            mMask[static_cast<size_t>(y) * width + x] = std::hypot(x + 0.5 - cx, y + 0.5 - cy) <= r ? 1 : 0;
+        }
+    }
+
+    mCos.resize(ThetaBins);
+    mSin.resize(ThetaBins);
+    for (int t = 0; t < ThetaBins; t++)
+    {
+        mCos[t] = std::cos(t * M_PI / ThetaBins);
+        mSin[t] = std::sin(t * M_PI / ThetaBins);
+    }
+    mRhoBins = 2 * static_cast<int>(std::ceil(std::hypot(width, height))) + 1;
+    mAccumulator.assign(static_cast<size_t>(ThetaBins) * mRhoBins, 0);
+    mPrevious.clear();
+}
+
+const std::vector<MeteorDetector::Detection> &MeteorDetector::process(const FITSImage::Statistic &stats,
+        const uint8_t *buffer)
+{
+    mDetections.clear();
+    mCurrent.clear();
+    mOverflow = false;
+    if (!buffer || stats.width <= 0 || stats.height <= 0) return mDetections;
+
+    int bin = maxWidth > 0 ? std::max(1, (stats.width + maxWidth - 1) / maxWidth) : 1;
+    int w = stats.width / bin;
+    int h = stats.height / bin;
+    if (w < 16 || h < 16) return mDetections;
+    if (w != mWidth || h != mHeight || bin != mBin) setup(w, h, bin);
+    if (!binMono(stats, buffer, bin, mFrame.data())) return mDetections;
+
+    const size_t n = mFrame.size();
+    if (mFrames == 0)
+    {
+        mBackground = mFrame;
+        mFrames++;
+        mPrevious.clear();
+        return mDetections;
+    }
+
+    /* exposure or gain changes scale the whole sky, bring the frame to the background level */
+    float frameLevel = sampleMedian(mFrame, mMask);
+    float backgroundLevel = sampleMedian(mBackground, mMask);
+    mScale = frameLevel > 0 ? backgroundLevel / frameLevel : 1.0f;
+    const float scale = mScale;
+
+    /* noise from the median absolute difference */
+    std::vector<float> deviation;
+    deviation.reserve(4096);
+    size_t stride = std::max<size_t>(1, n / 4096);
+    for (size_t i = 0; i < n; i += stride)
+    {
+        if (mMask[i]) deviation.push_back(std::fabs(mFrame[i] * scale - mBackground[i]));
+    }
+    float noise = 1;
+    if (!deviation.empty())
+    {
+        std::nth_element(deviation.begin(), deviation.begin() + deviation.size() / 2, deviation.end());
+        noise = std::max(0.1f, 1.4826f * deviation[deviation.size() / 2]);
+    }
+    const float threshold = sigma * noise;
+    /* running median : one step towards each new value, faster while warming up */
+    const float step = mFrames < warmup ? noise : 0.1f * noise;
+
+    const float *frame = mFrame.data();
+    const uint8_t *mask = mMask.data();
+    float *background = mBackground.data();
+    uint8_t *hits = mHits.data();
+    size_t count = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        float d = frame[i] * scale - background[i];
+        uint8_t hit = (d > threshold) & mask[i];
+        hits[i] = hit;
+        count += hit;
+        background[i] += step * ((d > 0) - (d < 0));
+    }
+    mFrames++;
+    if (mFrames <= warmup) return mDetections;
+    if (count > static_cast<size_t>(maxPoints))
+    {
+        mOverflow = true;
+        mPrevious.clear();
+        return mDetections;
+    }
+
+    mPoints.clear();
+    for (size_t i = 0; i < n && count > 0; i++)
+    {
+        if (hits[i])
+        {
+            mPoints.push_back(static_cast<int>(i));
+            count--;
+        }
+    }
+
+    const int minRun = std::max(4, static_cast<int>(minLength / bin));
+    if (static_cast<int>(mPoints.size()) >= minRun / 2)
+    {
+        hough(minRun / 2);
+        for (Detection &d : mDetections)
+        {
+            d.x1 = (d.x1 + 0.5) * bin;
+            d.y1 = (d.y1 + 0.5) * bin;
+            d.x2 = (d.x2 + 0.5) * bin;
+            d.y2 = (d.y2 + 0.5) * bin;
+            d.length *= bin;
+        }
+    }
+    mPrevious = mCurrent;
+    return mDetections;
+}
+
+void MeteorDetector::hough(int minVotes)
+{
+    const int w = mWidth;
+    const int diag = (mRhoBins - 1) / 2;
+    int *acc = mAccumulator.data();
+    std::fill(mAccumulator.begin(), mAccumulator.end(), 0);
+
+    auto vote = [&](int index, int delta)
+    {
+        const float x = index % w;
+        const float y = index / w;
+        for (int t = 0; t < ThetaBins; t++)
+        {
+            int r = static_cast<int>(std::lround(x * mCos[t] + y * mSin[t])) + diag;
+            acc[t * mRhoBins + r] += delta;
+        }
+    };
+    for (int p : mPoints) vote(p, 1);
+
+    const int minRun = 2 * minVotes;
+    std::vector<char> used(mPoints.size(), 0);
+    std::vector<std::pair<float, int>> along;
+    for (int attempt = 0; attempt < 4 * maxDetections && static_cast<int>(mDetections.size()) < maxDetections; attempt++)
+    {
+        int best = static_cast<int>(std::max_element(mAccumulator.begin(), mAccumulator.end()) - mAccumulator.begin());
+        if (acc[best] < minVotes) break;
+        const int t = best / mRhoBins;
+        const float rho = best % mRhoBins - diag;
+        const float c = mCos[t];
+        const float s = mSin[t];
+
+        /* points close to the line, ordered along it */
+        along.clear();
+        for (size_t i = 0; i < mPoints.size(); i++)
+        {
+            if (used[i]) continue;
+            const float x = mPoints[i] % w;
+            const float y = mPoints[i] / w;
+            if (std::fabs(x * c + y * s - rho) <= 1.5f) along.push_back({-x * s + y * c, static_cast<int>(i)});
+        }
+        std::sort(along.begin(), along.end());
+
+        /* longest run without holes longer than maxGap */
+        size_t bestStart = 0, bestEnd = 0, start = 0;
+        for (size_t k = 1; k <= along.size(); k++)
+        {
+            if (k == along.size() || along[k].first - along[k - 1].first > maxGap)
+            {
+                if (k - start > bestEnd - bestStart) // most points
+                {
+                    bestStart = start;
+                    bestEnd = k;
+                }
+                start = k;
+            }
+        }
+        float length = bestEnd > bestStart ? along[bestEnd - 1].first - along[bestStart].first : 0;
+        int points = static_cast<int>(bestEnd - bestStart);
+
+        if (length >= minRun && points >= 0.5f * length)
+        {
+            Detection d;
+            float a = along[bestStart].first;
+            float b = along[bestEnd - 1].first;
+            d.x1 = rho * c - a * s;
+            d.y1 = rho * s + a * c;
+            d.x2 = rho * c - b * s;
+            d.y2 = rho * s + b * c;
+            d.length = length;
+            d.points = points;
+            d.brightness = 0;
+            for (size_t k = bestStart; k < bestEnd; k++)
+            {
+                int p = mPoints[along[k].second];
+                d.brightness += std::max(0.0f, mFrame[p] * mScale - mBackground[p]);
+            }
+            d.moving = false;
+            for (const Line &l : mPrevious)
+            {
+                /* theta wraps at 180°, with rho changing sign */
+                double dt = std::fabs(l.theta - t);
+                double dr = dt > ThetaBins / 2 ? std::fabs(l.rho + rho) : std::fabs(l.rho - rho);
+                dt = std::min(dt, ThetaBins - dt);
+                if (dt <= 3 && dr <= 10) d.moving = true;
+            }
+            mDetections.push_back(d);
+            mCurrent.push_back({double(t), rho});
+
+            /* the whole band leaves the accumulator, not only the run */
+            for (const auto &pt : along)
+            {
+                used[pt.second] = 1;
+                vote(mPoints[pt.second], -1);
+            }
+        }
+        else
+        {
+            /* not a streak : clear the peak and its neighbourhood */
+            for (int dt = -2; dt <= 2; dt++)
+            {
+                int tt = (t + dt + ThetaBins) % ThetaBins;
+                for (int dr = -2; dr <= 2; dr++)
+                {
+                    int r = best % mRhoBins + dr;
+                    if (r >= 0 && r < mRhoBins) acc[tt * mRhoBins + r] = 0;
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,92 @@
+/**
+ * @file meteordetector.h
+ * @brief Streak detection (meteors, satellites, planes) by frame differencing
+ *
+ * Each frame is binned to a small mono plane, scaled to the background level
+ * (exposure or gain changes do not light up the whole sky) and compared to
+ * a running median background, updated by one step towards every new value.
+ * Memory stays a few floats per binned pixel whatever the night length, and
+ * the difference, threshold and update kernels are single branch-free loops
+ * the compiler vectorizes.
+ *
+ * Pixels brighter than the background by sigma times the noise vote in a
+ * Hough accumulator. The strongest lines are then walked along : a run of
+ * at least minLength pixels with gaps shorter than maxGap is a detection.
+ * A streak that continues a line found on the previous frame is flagged as
+ * moving (satellite, plane) rather than a single frame event (meteor).
+ */
+
+#pragma once
+
+#include <solver.h>
+#include <cstddef>
+#include <vector>
+
+class MeteorDetector
+{
+    public:
+        struct Detection
+        {
+            /// End points, sensor pixels
+            double x1, y1, x2, y2;
+            double length;
+            /// Sum of the excess over background along the streak, binned ADU
+            double brightness;
+            int points;
+            /// Continues a streak of the previous frame : satellite or plane
+            bool moving;
+        };
+
+        /// Forget background and previous detections
+        void reset();
+        /// Analyse one frame, detections are valid until next call
+        const std::vector<Detection> &process(const FITSImage::Statistic &stats, const uint8_t *buffer);
+
+        /// Frames used to build the background before detecting
+        int frames() const
+        {
+            return mFrames;
+        }
+        /// True when too many pixels changed for the last frame (lightning, clouds, headlights)
+        bool overflow() const
+        {
+            return mOverflow;
+        }
+
+        int maxWidth = 1024;        ///< Analysis width, frames are binned down to it
+        double maskRadius = 90;     ///< Analysed circle, % of the half short side, 0 : full frame
+        double sigma = 5;           ///< Threshold over background, in noise standard deviations
+        double minLength = 100;     ///< Shortest streak, sensor pixels
+        int maxGap = 4;             ///< Longest hole along a streak, binned pixels
+        int warmup = 5;             ///< Frames before the first detection
+        int maxPoints = 20000;      ///< More changed pixels than this : frame skipped
+        int maxDetections = 3;
+
+    private:
+        void setup(int width, int height, int bin);
+        void hough(int minVotes);
+
+        struct Line
+        {
+            double theta, rho;
+        };
+
+        int mWidth = 0;
+        int mHeight = 0;
+        int mBin = 1;
+        int mFrames = 0;
+        bool mOverflow = false;
+        float mScale = 1;
+
+        std::vector<float> mFrame;
+        std::vector<float> mBackground;
+        std::vector<uint8_t> mMask;         ///< Analysed circle
+        std::vector<uint8_t> mHits;
+        std::vector<int> mPoints;           ///< Hit indexes, bounded by maxPoints
+        std::vector<float> mCos, mSin;
+        std::vector<int> mAccumulator;
+        int mRhoBins = 0;
+
+        std::vector<Detection> mDetections;
+        std::vector<Line> mPrevious, mCurrent;
+};
@@ -0,0 +1,127 @@
+/**
+ * @file skyquality.cpp
+ * @brief Cloud cover and transparency from the stars detected in each frame
+ */
+
+#include "skyquality.h"
+#include "binning.h"
+
+#include <fitsio.h>
+#include <algorithm>
+#include <cmath>
+
+bool SkyQuality::prepare(const FITSImage::Statistic &stats, const uint8_t *buffer, double maskRadius, int maxWidth)
+{
+    if (!buffer || stats.width <= 0 || stats.height <= 0) return false;
+    const int w = stats.width;
+    const int h = stats.height;
+    mBin = maxWidth > 0 ? std::max(1, (w + maxWidth - 1) / maxWidth) : 1;
+    const int ow = w / mBin;
+    const int oh = h / mBin;
+    if (ow < 16 || oh < 16) return false;
+
+    mBuffer.resize(static_cast<size_t>(ow) * oh);
+    if (!binMono(stats, buffer, mBin, mBuffer.data())) return false;
+
+    /* outside the circle : sky background, so that the edge is not detected as stars */
+    const double cx = ow / 2.0;
+    const double cy = oh / 2.0;
+    mRadius = maskRadius > 0 ? maskRadius / 100 * std::min(ow, oh) / 2 : std::hypot(cx, cy);
+    std::vector<float> sample;
+    sample.reserve(4096);
+    size_t stride = std::max<size_t>(1, mBuffer.size() / 4096);
+    for (size_t i = 0; i < mBuffer.size(); i += stride)
+    {
+        if (std::hypot(i % ow + 0.5 - cx, i / ow + 0.5 - cy) <= mRadius) sample.push_back(mBuffer[i]);
+    }
+    if (sample.empty()) return false;
+    std::nth_element(sample.begin(), sample.begin() + sample.size() / 2, sample.end());
+    const float background = sample[sample.size() / 2];
+
+    float lo = background, hi = background;
+    double sum = 0;
+    for (int y = 0; y < oh; y++)
+    {
+        float *line = &mBuffer[static_cast<size_t>(y) * ow];
+        double dy = y + 0.5 - cy;
+        double half = std::fabs(dy) <= mRadius ? std::sqrt(mRadius * mRadius - dy * dy) : -1;
+        for (int x = 0; x < ow; x++)
+        {
+            if (std::fabs(x + 0.5 - cx) > half) line[x] = background;
+            lo = std::min(lo, line[x]);
+            hi = std::max(hi, line[x]);
+            sum += line[x];
+        }
+    }
+
+    mStats = FITSImage::Statistic();
+    mStats.width = ow;
+    mStats.height = oh;
+    mStats.channels = 1;
+    mStats.dataType = TFLOAT;
+    mStats.bytesPerPixel = sizeof(float);
+    mStats.samples_per_channel = ow * oh;
+    mStats.size = mBuffer.size() * sizeof(float);
+    mStats.min[0] = lo;
+    mStats.max[0] = hi;
+    mStats.mean[0] = sum / mBuffer.size();
+    mStats.median[0] = background;
+    return true;
+}
+
+void SkyQuality::reset()
+{
+    std::fill(mReference, mReference + Sectors, 0.0);
+    mTotalReference = 0;
+    clear();
+}
+
+void SkyQuality::clear()
+{
+    for (int s = 0; s < Sectors; s++)
+    {
+        mMags[s].clear();
+        mCount[s] = 0;
+        mLimit[s] = NoValue;
+        mCover[s] = NoValue;
+    }
+    mTotal = 0;
+    mTotalCover = NoValue;
+}
+
+int SkyQuality::sector(double x, double y) const
+{
+    double dx = x - mStats.width / 2.0;
+    double dy = y - mStats.height / 2.0;
+    if (std::hypot(dx, dy) < mRadius / 2) return 0;
+    if (std::fabs(dy) > std::fabs(dx)) return dy < 0 ? 1 : 3;
+    return dx > 0 ? 2 : 4;
+}
+
+void SkyQuality::add(double x, double y, double mag)
+{
+    int s = sector(x, y);
+    mMags[s].push_back(mag);
+    mCount[s]++;
+    mTotal++;
+}
+
+void SkyQuality::compute(double exposure)
+{
+    /* same star, same value whatever the exposure */
+    const double zero = exposure > 0 ? 2.5 * std::log10(exposure) : 0;
+    for (int s = 0; s < Sectors; s++)
+    {
+        std::vector<double> &mags = mMags[s];
+        if (mags.size() >= 5)
+        {
+            size_t k = mags.size() * 9 / 10;
+            std::nth_element(mags.begin(), mags.begin() + k, mags.end());
+            mLimit[s] = mags[k] + zero;
+        }
+        mReference[s] = std::max(mReference[s] * referenceDecay, double(mCount[s]));
+        if (mReference[s] >= 5) mCover[s] = std::max(0.0, std::min(1.0, 1 - mCount[s] / mReference[s]));
+    }
+    mTotalReference = std::max(mTotalReference * referenceDecay, double(mTotal));
+    if (mTotalReference >= 5) mTotalCover = std::max(0.0, std::min(1.0, 1 - mTotal / mTotalReference));
+}
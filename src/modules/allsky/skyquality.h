@@ -0,0 +1,101 @@
+/**
+ * @file skyquality.h
+ * @brief Cloud cover and transparency from the stars detected in each frame
+ *
+ * prepare() bins the frame down to a small mono float image, with the area
+ * outside the fisheye circle set to the sky background, which is what the
+ * star extraction runs on : a few hundred thousand pixels instead of the
+ * full sensor, cheap enough for every frame on an ARM board.
+ *
+ * measure() then counts stars per sector (centre, and the top, right,
+ * bottom, left quarters of the ring around it) and takes the 90th
+ * percentile of their magnitude, normalised to a 1s exposure, as a limiting
+ * magnitude proxy. Cover is the missing fraction of stars compared to the
+ * best count seen recently in the same sector.
+ */
+
+#pragma once
+
+#include <solver.h>
+#include <vector>
+
+class SkyQuality
+{
+    public:
+        static const int Sectors = 5;
+        static constexpr double NoValue = 99;
+
+        /// Bin to at most maxWidth pixels wide and mask, maskRadius in % of the half short side (0 : full frame)
+        bool prepare(const FITSImage::Statistic &stats, const uint8_t *buffer, double maskRadius, int maxWidth);
+        /// Prepared image, valid until next prepare()
+        const FITSImage::Statistic &stats() const
+        {
+            return mStats;
+        }
+        const uint8_t *buffer() const
+        {
+            return reinterpret_cast<const uint8_t *>(mBuffer.data());
+        }
+        /// Binning factor from sensor to prepared pixels
+        int binning() const
+        {
+            return mBin;
+        }
+
+        /// Analyse stars found on the prepared image, any list of FITSImage::Star like objects
+        template<typename Stars>
+        void measure(const Stars &stars, double exposure)
+        {
+            clear();
+            for (const auto &s : stars) add(s.x, s.y, s.mag);
+            compute(exposure);
+        }
+        /// Forget the clear sky references (new night)
+        void reset();
+
+        int count() const
+        {
+            return mTotal;
+        }
+        int count(int sector) const
+        {
+            return mCount[sector];
+        }
+        /// Magnitude reached in sector for 1s, NoValue without enough stars
+        double limitingMag(int sector) const
+        {
+            return mLimit[sector];
+        }
+        /// 0 clear ... 1 overcast, compared to the best recent count
+        double cover(int sector) const
+        {
+            return mCover[sector];
+        }
+        double cover() const
+        {
+            return mTotalCover;
+        }
+
+        /// Per frame decay of the clear sky reference, so that it follows the night
+        double referenceDecay = 0.998;
+
+    private:
+        void clear();
+        void add(double x, double y, double mag);
+        void compute(double exposure);
+        int sector(double x, double y) const;
+
+        FITSImage::Statistic mStats;
+        std::vector<float> mBuffer;
+        int mBin = 1;
+        double mRadius = 0;
+
+        std::vector<double> mMags[Sectors];
+        int mCount[Sectors] = {};
+        double mLimit[Sectors] = {};
+        double mCover[Sectors] = {};
+        double mReference[Sectors] = {};
+        int mTotal = 0;
+        double mTotalReference = 0;
+        double mTotalCover = 0;
+};
@@ -0,0 +1,243 @@
+/**
+ * @file timelapseencoder.cpp
+ * @brief Timelapse encoded during the night, frame by frame
+ */
+
+#include "timelapseencoder.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QPainter>
+#include <QTextStream>
+
+TimelapseEncoder::TimelapseEncoder(QObject *parent) : QObject(parent)
+{
+}
+
+TimelapseEncoder::~TimelapseEncoder()
+{
+    /* night interrupted : let ffmpeg write what it has */
+    if (mCurrent)
+    {
+        mCurrent->closeWriteChannel();
+        mCurrent->waitForFinished(10000);
+    }
+}
+
+void TimelapseEncoder::start(const QString &folder, int framerate, int segmentFrames)
+{
+    finish();
+    mNight++;
+    mNights[mNight].folder = folder;
+    mFolder = folder;
+    mFramerate = qMax(1, framerate);
+    mSegmentFrames = qMax(1, segmentFrames);
+    mRunning = true;
+    mFailed = false;
+    mFrames = 0;
+    mDropped = 0;
+    mSegmentCount = 0;
+    mSize = QSize();
+}
+
+void TimelapseEncoder::openSegment(const QSize &size)
+{
+    mSegmentCount++;
+    QString path = mFolder + QString("/segment%1.mp4").arg(mSegmentCount, 4, 10, QLatin1Char('0'));
+
+    QStringList arguments;
+    arguments << "-y";
+    arguments << "-f" << "rawvideo";
+    arguments << "-pix_fmt" << "bgra";
+    arguments << "-s" << QString("%1x%2").arg(size.width()).arg(size.height());
+    arguments << "-framerate" << QString::number(mFramerate);
+    arguments << "-i" << "-";
+    arguments << "-vf" << "scale=trunc(iw/2)*2:trunc(ih/2)*2";
+    arguments << "-c:v" << "libx264";
+    arguments << "-preset" << "veryfast";
+    arguments << "-pix_fmt" << "yuv420p";
+    arguments << "-movflags" << "+faststart";
+    arguments << path;
+
+    mCurrent = new QProcess(this);
+    mCurrent->setProperty("segment", path);
+    mCurrent->setProperty("night", mNight);
+    mCurrent->setProcessChannelMode(QProcess::ForwardedErrorChannel);
+    connect(mCurrent, static_cast<void(QProcess::*)(int, QProcess::ExitStatus)>(&QProcess::finished), this,
+            &TimelapseEncoder::OnSegmentFinished);
+    mCurrent->start("ffmpeg", arguments);
+    if (!mCurrent->waitForStarted(5000))
+    {
+        emit message("Can't start ffmpeg, timelapse disabled");
+        mCurrent->deleteLater();
+        mCurrent = nullptr;
+        mFailed = true;
+    }
+}
+
+void TimelapseEncoder::closeSegment()
+{
+    if (!mCurrent) return;
+    mNights[mNight].closing.append(mCurrent);
+    mCurrent->closeWriteChannel();
+    mCurrent = nullptr;
+}
+
+void TimelapseEncoder::addFrame(const QImage &frame)
+{
+    if (!mRunning || mFailed || frame.isNull()) return;
+
+    QImage image = frame.format() == QImage::Format_RGB32 ? frame : frame.convertToFormat(QImage::Format_RGB32);
+    /* segments are joined without re-encoding : the whole night keeps the size of its first frame */
+    if (!mSize.isValid()) mSize = image.size();
+    if (image.size() != mSize)
+    {
+        QImage fitted(mSize, QImage::Format_RGB32);
+        fitted.fill(Qt::black);
+        QImage scaled = image.scaled(mSize, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+        QPainter painter(&fitted);
+        painter.drawImage((mSize.width() - scaled.width()) / 2, (mSize.height() - scaled.height()) / 2, scaled);
+        painter.end();
+        image = fitted;
+    }
+    if (!mCurrent) openSegment(mSize);
+    if (!mCurrent) return;
+
+    qint64 frameBytes = 4LL * image.width() * image.height();
+    if (mCurrent->bytesToWrite() > maxQueuedFrames * frameBytes)
+    {
+        mDropped++;
+        return;
+    }
+
+    /* RGB32 is BGRA in memory on little endian, lines may be padded */
+    if (image.bytesPerLine() == 4 * image.width())
+    {
+        mCurrent->write(reinterpret_cast<const char *>(image.constBits()), frameBytes);
+    }
+    else
+    {
+        for (int y = 0; y < image.height(); y++)
+        {
+            mCurrent->write(reinterpret_cast<const char *>(image.constScanLine(y)), 4 * image.width());
+        }
+    }
+    mFrames++;
+    if (mFrames % mSegmentFrames == 0) closeSegment();
+}
+
+void TimelapseEncoder::finish()
+{
+    if (!mRunning) return;
+    mRunning = false;
+    closeSegment();
+    if (mNights[mNight].closing.isEmpty()) concat(mNight);
+}
+
+void TimelapseEncoder::OnSegmentFinished(int exitCode, QProcess::ExitStatus exitStatus)
+{
+    QProcess *process = qobject_cast<QProcess *>(sender());
+    if (!process) return;
+    process->deleteLater();
+    if (process == mCurrent) mCurrent = nullptr;
+    int id = process->property("night").toInt();
+    if (!mNights.contains(id)) return;
+    Night &night = mNights[id];
+    QString path = process->property("segment").toString();
+    night.closing.removeAll(process);
+
+    if (exitStatus == QProcess::NormalExit && exitCode == 0 && QFile::exists(path))
+    {
+        night.segments.append(path);
+        if (id == mNight) emit segmentReady(path);
+    }
+    else
+    {
+        emit message("Timelapse segment " + path + " failed (" + QString::number(exitCode) + ")");
+    }
+
+    bool finishing = id != mNight || !mRunning;
+    if (finishing && night.closing.isEmpty() && !night.concat && !(id == mNight && mCurrent)) concat(id);
+}
+
+void TimelapseEncoder::concat(int id)
+{
+    Night &night = mNights[id];
+    night.segments.sort();
+    QString output = night.folder + "/timelapse.mp4";
+    QFile::remove(output);
+
+    if (night.segments.isEmpty())
+    {
+        done(id, 1);
+        return;
+    }
+    if (night.segments.size() == 1)
+    {
+        QFile::rename(night.segments.first(), output);
+        done(id, 0);
+        return;
+    }
+
+    QFile list(night.folder + "/segments.txt");
+    if (list.open(QIODevice::WriteOnly | QIODevice::Text))
+    {
+        QTextStream out(&list);
+        for (const QString &segment : night.segments) out << "file '" << QFileInfo(segment).fileName() << "'\n";
+        list.close();
+    }
+
+    QStringList arguments;
+    arguments << "-y";
+    arguments << "-f" << "concat";
+    arguments << "-safe" << "0";
+    arguments << "-i" << list.fileName();
+    arguments << "-c" << "copy";
+    arguments << "-movflags" << "+faststart";
+    arguments << output;
+
+    night.concat = new QProcess(this);
+    night.concat->setProperty("night", id);
+    night.concat->setProcessChannelMode(QProcess::ForwardedErrorChannel);
+    connect(night.concat, static_cast<void(QProcess::*)(int, QProcess::ExitStatus)>(&QProcess::finished), this,
+            &TimelapseEncoder::OnConcatFinished);
+    connect(night.concat, &QProcess::errorOccurred, this, &TimelapseEncoder::OnConcatError);
+    night.concat->start("ffmpeg", arguments);
+}
+
+void TimelapseEncoder::OnConcatFinished(int exitCode, QProcess::ExitStatus exitStatus)
+{
+    QProcess *process = qobject_cast<QProcess *>(sender());
+    if (!process) return;
+    process->deleteLater();
+    int id = process->property("night").toInt();
+    if (!mNights.contains(id)) return;
+
+    int code = exitStatus == QProcess::NormalExit ? exitCode : -1;
+    if (code == 0)
+    {
+        for (const QString &segment : mNights[id].segments) QFile::remove(segment);
+        QFile::remove(mNights[id].folder + "/segments.txt");
+    }
+    done(id, code);
+}
+
+void TimelapseEncoder::OnConcatError(QProcess::ProcessError error)
+{
+    /* any other error is followed by finished() */
+    if (error != QProcess::FailedToStart) return;
+    QProcess *process = qobject_cast<QProcess *>(sender());
+    if (!process) return;
+    process->deleteLater();
+    int id = process->property("night").toInt();
+    if (!mNights.contains(id)) return;
+    emit message("Can't start ffmpeg to join the timelapse segments");
+    done(id, -1);
+}
+
+void TimelapseEncoder::done(int id, int exitCode)
+{
+    QString folder = mNights.take(id).folder;
+    emit finished(exitCode, folder);
+}
@@ -0,0 +1,106 @@
+/**
+ * @file timelapseencoder.h
+ * @brief Timelapse encoded during the night, frame by frame
+ *
+ * Each frame is piped as raw BGRA into a long running ffmpeg process, so the
+ * encoding cost is spread over the night instead of a multi-minute batch at
+ * dawn. Every segmentFrames frames the current ffmpeg is closed and a new
+ * segment started : completed segments are regular mp4 files, playable
+ * while the night goes on (segmentReady). finish() closes the last segment
+ * and joins all of them, without re-encoding, into timelapse.mp4. All the
+ * segments of a night share the size of its first frame : later frames of
+ * another size (binning, ROI) are scaled and letterboxed to it.
+ *
+ * If ffmpeg falls behind, frames are dropped rather than buffered without
+ * limit.
+ *
+ * Every started night ends with exactly one finished(code, folder), even
+ * when ffmpeg could not be started : the caller archives on that signal.
+ * Each night keeps its own segments and processes, so starting a new night
+ * while the previous one is still being joined does not mix them.
+ */
+
+#pragma once
+
+#include <QImage>
+#include <QMap>
+#include <QObject>
+#include <QProcess>
+#include <QStringList>
+
+class TimelapseEncoder : public QObject
+{
+        Q_OBJECT
+
+    public:
+        explicit TimelapseEncoder(QObject *parent = nullptr);
+        ~TimelapseEncoder();
+
+        /// Start a new timelapse in folder, a previous one still running is finished in the background
+        void start(const QString &folder, int framerate, int segmentFrames);
+        /// Queue one frame, scaled to the size of the night's first frame if needed
+        void addFrame(const QImage &frame);
+        /// Close the last segment and join all of them into folder/timelapse.mp4
+        void finish();
+
+        /// Accepting frames : started and not finished yet
+        bool isRunning() const
+        {
+            return mRunning;
+        }
+        int frames() const
+        {
+            return mFrames;
+        }
+        int dropped() const
+        {
+            return mDropped;
+        }
+        QString folder() const
+        {
+            return mFolder;
+        }
+
+        /// Frames allowed to wait in the pipe before dropping
+        int maxQueuedFrames = 4;
+
+    signals:
+        void segmentReady(const QString &path);
+        /// exitCode 0 : folder/timelapse.mp4 is complete
+        void finished(int exitCode, const QString &folder);
+        void message(const QString &text);
+
+    private slots:
+        void OnSegmentFinished(int exitCode, QProcess::ExitStatus exitStatus);
+        void OnConcatFinished(int exitCode, QProcess::ExitStatus exitStatus);
+        void OnConcatError(QProcess::ProcessError error);
+
+    private:
+        struct Night
+        {
+            QString folder;
+            QStringList segments;
+            QList<QProcess *> closing;
+            QProcess *concat = nullptr;
+        };
+
+        void openSegment(const QSize &size);
+        void closeSegment();
+        void concat(int night);
+        void done(int night, int exitCode);
+
+        /// Nights not joined yet, the current one included
+        QMap<int, Night> mNights;
+        int mNight = 0;
+        QString mFolder;
+        int mFramerate = 30;
+        int mSegmentFrames = 300;
+        bool mRunning = false;
+        bool mFailed = false;
+        int mFrames = 0;
+        int mDropped = 0;
+        int mSegmentCount = 0;
+        QSize mSize;        ///< size of every frame of the night
+
+        QProcess *mCurrent = nullptr;
+};
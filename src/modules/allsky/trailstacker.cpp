@@ -0,0 +1,235 @@
+/**
+ * @file trailstacker.cpp
+ * @brief Star trail stack on the native sensor buffer
+ */
+
+#include "trailstacker.h"
+
+#include <fitsio.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <type_traits>
+
+void TrailStacker::reset(Mode mode)
+{
+    mMode = mode;
+    mCount = 0;
+    mSamples = 0;
+    mDirty = true;
+    mMax.clear();
+    mMean.clear();
+    mM2.clear();
+    mKept.clear();
+    mOut.clear();
+}
+
+bool TrailStacker::add(const FITSImage::Statistic &stats, const uint8_t *buffer)
+{
+    if (stats.dataType != TBYTE && stats.dataType != TUSHORT && stats.dataType != TFLOAT) return false;
+
+    if (mCount == 0)
+    {
+        mStats = stats;
+        mSamples = static_cast<size_t>(stats.width) * stats.height * stats.channels;
+        if (mMode == Max)
+        {
+            mMax.assign(buffer, buffer + mSamples * stats.bytesPerPixel);
+            mCount = 1;
+            mDirty = true;
+            return true;
+        }
+        mMean.assign(mSamples, 0);
+        if (mMode == ClippedMean)
+        {
+            mM2.assign(mSamples, 0);
+            mKept.assign(mSamples, 0);
+        }
+    }
+    else if (stats.width != mStats.width || stats.height != mStats.height || stats.channels != mStats.channels
+             || stats.dataType != mStats.dataType)
+    {
+        return false;
+    }
+
+    switch (stats.dataType)
+    {
+        case TBYTE:
+            if (mMode == Max) addMax(buffer);
+            if (mMode == Mean) addMean(buffer);
+            if (mMode == ClippedMean) addClipped(buffer);
+            break;
+        case TUSHORT:
+            if (mMode == Max) addMax(reinterpret_cast<const uint16_t *>(buffer));
+            if (mMode == Mean) addMean(reinterpret_cast<const uint16_t *>(buffer));
+            if (mMode == ClippedMean) addClipped(reinterpret_cast<const uint16_t *>(buffer));
+            break;
+        default:
+            if (mMode == Max) addMax(reinterpret_cast<const float *>(buffer));
+            if (mMode == Mean) addMean(reinterpret_cast<const float *>(buffer));
+            if (mMode == ClippedMean) addClipped(reinterpret_cast<const float *>(buffer));
+            break;
+    }
+    mCount++;
+    mDirty = true;
+    return true;
+}
+
+template <typename T>
+void TrailStacker::addMax(const T *src)
+{
+    T *acc = reinterpret_cast<T *>(mMax.data());
+    const size_t n = mSamples;
+    for (size_t i = 0; i < n; i++)
+    {
+        acc[i] = std::max(acc[i], src[i]);
+    }
+}
+
+template <typename T>
+void TrailStacker::addMean(const T *src)
+{
+    float *mean = mMean.data();
+    const float k = 1.0f / (mCount + 1);
+    const size_t n = mSamples;
+    for (size_t i = 0; i < n; i++)
+    {
+        mean[i] += (static_cast<float>(src[i]) - mean[i]) * k;
+    }
+}
+
+template <typename T>
+void TrailStacker::addClipped(const T *src)
+{
+    float *mean = mMean.data();
+    float *m2 = mM2.data();
+    uint16_t *kept = mKept.data();
+    const float s2 = clipSigma * clipSigma;
+    const float minVar = std::is_floating_point<T>::value ? 1e-8f : 1.0f;   // one ADU, flat regions must still accept noise
+    const size_t n = mSamples;
+
+    /* Welford update, masked instead of branched : a rejected sample adds nothing */
+    for (size_t i = 0; i < n; i++)
+    {
+        float x = static_cast<float>(src[i]);
+        float d = x - mean[i];
+        float var = kept[i] > 1 ? m2[i] / (kept[i] - 1) : 0.0f;
+        bool keep = kept[i] < 3 || d * d <= s2 * std::max(var, minVar);
+        float w = keep ? 1.0f : 0.0f;
+        float k = w / (kept[i] + 1.0f);
+        mean[i] += d * k;
+        m2[i] += w * d * (x - mean[i]);
+        kept[i] += keep ? 1 : 0;
+    }
+}
+
+const uint8_t *TrailStacker::buffer()
+{
+    if (mCount == 0) return nullptr;
+    if (mMode == Max) return mMax.data();
+    if (mDirty || mOut.empty())
+    {
+        switch (mStats.dataType)
+        {
+            case TBYTE:
+                output<uint8_t>();
+                break;
+            case TUSHORT:
+                output<uint16_t>();
+                break;
+            default:
+                output<float>();
+                break;
+        }
+        mDirty = false;
+    }
+    return mOut.data();
+}
+
+template <typename T>
+void TrailStacker::output()
+{
+    mOut.resize(mSamples * sizeof(T));
+    T *out = reinterpret_cast<T *>(mOut.data());
+    const float *mean = mMean.data();
+    for (size_t i = 0; i < mSamples; i++)
+    {
+        out[i] = static_cast<T>(mean[i] + (std::is_floating_point<T>::value ? 0.0f : 0.5f));
+    }
+}
+
+QImage TrailStacker::preview(int maxWidth)
+{
+    if (mCount == 0) return QImage();
+    switch (mStats.dataType)
+    {
+        case TBYTE:
+            return render<uint8_t>(maxWidth);
+        case TUSHORT:
+            return render<uint16_t>(maxWidth);
+        default:
+            return render<float>(maxWidth);
+    }
+}
+
+template <typename T>
+QImage TrailStacker::render(int maxWidth)
+{
+    const T *data = reinterpret_cast<const T *>(buffer());
+    const int w = mStats.width;
+    const int h = mStats.height;
+    const int channels = mStats.channels >= 3 ? 3 : 1;
+    int step = (maxWidth > 0 && w > maxWidth) ? (w + maxWidth - 1) / maxWidth : 1;
+    int ow = w / step;
+    int oh = h / step;
+    if (ow <= 0 || oh <= 0) return QImage();
+
+    /* block max keeps thin trails visible once reduced */
+    std::vector<float> plane(static_cast<size_t>(ow) * oh);
+    QImage image(ow, oh, QImage::Format_RGB32);
+    image.fill(Qt::black);
+    for (int c = 0; c < channels; c++)
+    {
+        const T *src = data + static_cast<size_t>(c) * w * h;
+        for (int y = 0; y < oh; y++)
+        {
+            float *out = &plane[static_cast<size_t>(y) * ow];
+            for (int x = 0; x < ow; x++) out[x] = static_cast<float>(src[static_cast<size_t>(y * step) * w + x * step]);
+            for (int by = 0; by < step; by++)
+            {
+                const T *line = src + static_cast<size_t>(y * step + by) * w;
+                for (int x = 0; x < ow; x++)
+                {
+                    for (int bx = 0; bx < step; bx++) out[x] = std::max(out[x], static_cast<float>(line[x * step + bx]));
+                }
+            }
+        }
+
+        /* black and white points from a sample of the reduced plane */
+        std::vector<float> sample;
+        size_t stride = std::max<size_t>(1, plane.size() / 100000);
+        for (size_t i = 0; i < plane.size(); i += stride) sample.push_back(plane[i]);
+        size_t lo = sample.size() / 1000;
+        size_t hi = sample.size() - 1 - sample.size() / 2000;
+        std::nth_element(sample.begin(), sample.begin() + lo, sample.end());
+        float black = sample[lo];
+        std::nth_element(sample.begin(), sample.begin() + hi, sample.end());
+        float white = sample[hi];
+        float scale = white > black ? 1.0f / (white - black) : 1.0f;
+
+        int shift = channels == 1 ? -1 : 16 - 8 * c;
+        for (int y = 0; y < oh; y++)
+        {
+            const float *in = &plane[static_cast<size_t>(y) * ow];
+            QRgb *line = reinterpret_cast<QRgb *>(image.scanLine(y));
+            for (int x = 0; x < ow; x++)
+            {
+                float v = std::min(1.0f, std::max(0.0f, (in[x] - black) * scale));
+                uint32_t g = static_cast<uint32_t>(255 * std::sqrt(v));
+                if (shift < 0) line[x] = qRgb(g, g, g);
+                else line[x] |= g << shift;
+            }
+        }
+    }
+    return image;
+}
@@ -0,0 +1,80 @@
+/**
+ * @file trailstacker.h
+ * @brief Star trail stack on the native sensor buffer
+ *
+ * Frames are combined sample by sample on the buffer loaded by fileio (8,
+ * 16 bits or float, mono or planar colour), not on the stretched 8 bits
+ * preview, so the stack keeps the full dynamic range :
+ *   - Max : brightest value of every pixel, the classic star trail
+ *   - Mean : plain average, a deep sky background
+ *   - ClippedMean : running average ignoring samples more than clipSigma
+ *     away from the current mean (planes, satellites, headlights)
+ *
+ * Every mode is a single branch-free loop over contiguous arrays, which the
+ * compiler vectorizes (SSE/AVX on x86, NEON on ARM boards).
+ *
+ * The stretched preview is only rendered on request, see preview().
+ */
+
+#pragma once
+
+#include <QImage>
+#include <solver.h>
+#include <cstddef>
+#include <vector>
+
+class TrailStacker
+{
+    public:
+        enum Mode
+        {
+            Max = 0,
+            Mean = 1,
+            ClippedMean = 2
+        };
+
+        /// Drop the current stack and select the combine mode
+        void reset(Mode mode);
+        /// Combine one frame, false if format unsupported or different from the first frame
+        bool add(const FITSImage::Statistic &stats, const uint8_t *buffer);
+
+        Mode mode() const
+        {
+            return mMode;
+        }
+        int count() const
+        {
+            return mCount;
+        }
+        /// Statistics of the first frame, describing buffer()
+        const FITSImage::Statistic &stats() const
+        {
+            return mStats;
+        }
+        /// Stack in the input data type. Valid until next add/reset
+        const uint8_t *buffer();
+        /// Auto-stretched 8 bits image, reduced by block max to at most maxWidth pixels wide (0 : full size)
+        QImage preview(int maxWidth = 0);
+
+        /// Rejection threshold of the clipped mean, in standard deviations
+        float clipSigma = 3;
+
+    private:
+        template <typename T> void addMax(const T *src);
+        template <typename T> void addMean(const T *src);
+        template <typename T> void addClipped(const T *src);
+        template <typename T> void output();
+        template <typename T> QImage render(int maxWidth);
+
+        Mode mMode = Max;
+        FITSImage::Statistic mStats;
+        int mCount = 0;
+        size_t mSamples = 0;
+        bool mDirty = true;
+
+        std::vector<uint8_t> mMax;      ///< Max mode, input data type
+        std::vector<float> mMean;       ///< Mean and ClippedMean modes
+        std::vector<float> mM2;         ///< ClippedMean, sum of squared deviations
+        std::vector<uint16_t> mKept;    ///< ClippedMean, samples kept per pixel
+        std::vector<uint8_t> mOut;
+};
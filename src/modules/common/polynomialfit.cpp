@@ -0,0 +1,160 @@
+/**
+ * @file polynomialfit.cpp
+ * @brief Incremental least-squares polynomial fitting (normal equations)
+ *
+ * Replaces the former per-call GSL multifit (matrix, vectors and workspace
+ * allocated on every call, leaked on error). With degree <= 4 the normal
+ * equations are tiny and well conditioned once x is normalized, so a plain
+ * Gaussian elimination with partial pivoting on the stack is enough.
+ */
+
+#include "polynomialfit.h"
+
+#include <cmath>
+#include <utility>
+
+PolynomialFit::PolynomialFit(int degree, double origin, double scale)
+{
+    reset(degree, origin, scale);
+}
+
+void PolynomialFit::reset(int degree, double origin, double scale)
+{
+    if (degree < 0) degree = 0;
+    if (degree > MaxDegree) degree = MaxDegree;
+    mDegree = degree;
+    mOrigin = origin;
+    mScale = (scale == 0) ? 1 : scale;
+    clear();
+}
+
+void PolynomialFit::clear()
+{
+    mCount = 0;
+    mSumYY = 0;
+    for (int k = 0; k <= 2 * MaxDegree; k++) mSumT[k] = 0;
+    for (int k = 0; k <= MaxDegree; k++) mSumTY[k] = 0;
+}
+
+void PolynomialFit::addPoint(double x, double y, double weight)
+{
+    double t = (x - mOrigin) / mScale;
+    double p = weight;
+    for (int k = 0; k <= 2 * mDegree; k++)
+    {
+        mSumT[k] += p;
+        if (k <= mDegree) mSumTY[k] += p * y;
+        p *= t;
+    }
+    mSumYY += weight * y * y;
+    mCount++;
+}
+
+bool PolynomialFit::solveCentered(double *a) const
+{
+    const int n = mDegree + 1;
+    if (mCount < n) return false;
+
+    // augmented normal matrix [S | b], S(i,j) = sum t^(i+j)
+    double m[MaxDegree + 1][MaxDegree + 2];
+    for (int i = 0; i < n; i++)
+    {
+        for (int j = 0; j < n; j++) m[i][j] = mSumT[i + j];
+        m[i][n] = mSumTY[i];
+    }
+
+    for (int c = 0; c < n; c++)
+    {
+        int pivot = c;
+        for (int r = c + 1; r < n; r++)
+        {
+            if (std::fabs(m[r][c]) > std::fabs(m[pivot][c])) pivot = r;
+        }
+        if (std::fabs(m[pivot][c]) < 1e-12 * std::fabs(mSumT[0])) return false;
+        if (pivot != c)
+        {
+            for (int j = c; j <= n; j++) std::swap(m[c][j], m[pivot][j]);
+        }
+        for (int r = c + 1; r < n; r++)
+        {
+            double f = m[r][c] / m[c][c];
+            for (int j = c; j <= n; j++) m[r][j] -= f * m[c][j];
+        }
+    }
+    for (int i = n - 1; i >= 0; i--)
+    {
+        double s = m[i][n];
+        for (int j = i + 1; j < n; j++) s -= m[i][j] * a[j];
+        a[i] = s / m[i][i];
+    }
+    return true;
+}
+
+bool PolynomialFit::solve(double *coeffs) const
+{
+    double a[MaxDegree + 1];
+    if (!solveCentered(a)) return false;
+
+    // expand sum a_k ((x - o) / s)^k into powers of x
+    for (int j = 0; j <= mDegree; j++) coeffs[j] = 0;
+    double sk = 1;
+    for (int k = 0; k <= mDegree; k++)
+    {
+        double binom = 1;
+        for (int j = k; j >= 0; j--)
+        {
+            // C(k,j) * (-o)^(k-j)
+            coeffs[j] += a[k] / sk * binom * std::pow(-mOrigin, k - j);
+            binom = binom * j / (k - j + 1);
+        }
+        sk *= mScale;
+    }
+    return true;
+}
+
+bool PolynomialFit::vertex(double &x) const
+{
+    double a[MaxDegree + 1];
+    if (mDegree != 2 || !solveCentered(a) || a[2] == 0) return false;
+    x = mOrigin - mScale * a[1] / (2 * a[2]);
+    return true;
+}
+
+double PolynomialFit::evaluate(double x) const
+{
+    double a[MaxDegree + 1];
+    if (!solveCentered(a)) return 0;
+    double t = (x - mOrigin) / mScale;
+    double y = 0;
+    for (int k = mDegree; k >= 0; k--) y = y * t + a[k];
+    return y;
+}
+
+double PolynomialFit::chisq() const
+{
+    double a[MaxDegree + 1];
+    if (!solveCentered(a)) return 0;
+    // sum (y - p)² = syy - 2 a.b + a'Sa, all from the accumulated sums
+    double r = mSumYY;
+    for (int i = 0; i <= mDegree; i++)
+    {
+        r -= 2 * a[i] * mSumTY[i];
+        for (int j = 0; j <= mDegree; j++) r += a[i] * a[j] * mSumT[i + j];
+    }
+    return r < 0 ? 0 : r;
+}
+
+bool polynomialfit(int obs, int degree, double *dx, double *dy, double *store)
+{
+    if (obs < 1 || degree < 1) return false;
+    double lo = dx[0];
+    double hi = dx[0];
+    for (int i = 1; i < obs; i++)
+    {
+        if (dx[i] < lo) lo = dx[i];
+        if (dx[i] > hi) hi = dx[i];
+    }
+    PolynomialFit fit(degree - 1, (lo + hi) / 2, (hi - lo) / 2);
+    for (int i = 0; i < obs; i++) fit.addPoint(dx[i], dy[i]);
+    return fit.solve(store);
+}
@@ -0,0 +1,90 @@
+/**
+ * @file polynomialfit.h
+ * @brief Incremental least-squares polynomial fitting shared by focus and guider
+ *
+ * PolynomialFit keeps the normal equations of a weighted polynomial regression
+ * (sums of x^k and y*x^k) instead of the raw samples. Adding a point costs
+ * O(degree) and solving costs O(degree^3) on a few stack doubles: nothing is
+ * allocated, so one instance per series (global curve, each focus zone...) can
+ * be refitted after every frame for free.
+ *
+ * Abscissas are internally mapped to t = (x - origin) / scale so that large
+ * focuser positions (~30000 steps) do not ruin the conditioning of the sums.
+ * Pick origin/scale close to the data (e.g. start position and step size).
+ * Results are best read in that frame (solveCentered, vertex, evaluate) :
+ * expanding them back to powers of x (solve) brings the bad scaling back.
+ *
+ * References:
+ *   - https://www.lost-infinity.com/fofi-a-free-automatic-telescope-focus-finder-software/
+ *   - https://www.lost-infinity.com/v-curve-fitting-with-a-hyperbolic-function/
+ */
+
+#pragma once
+
+class PolynomialFit
+{
+    public:
+        static const int MaxDegree = 4;
+
+        explicit PolynomialFit(int degree = 2, double origin = 0, double scale = 1);
+
+        /// Change degree and abscissa normalization, drop all points
+        void reset(int degree, double origin = 0, double scale = 1);
+        /// Drop all points, keep degree and normalization
+        void clear();
+        /// Accumulate one sample, O(degree)
+        void addPoint(double x, double y, double weight = 1);
+
+        int count() const
+        {
+            return mCount;
+        }
+        int degree() const
+        {
+            return mDegree;
+        }
+        double origin() const
+        {
+            return mOrigin;
+        }
+        double scale() const
+        {
+            return mScale;
+        }
+
+        /**
+         * @brief Solve normal equations
+         * @param coeffs degree+1 output coefficients, y = c0 + c1*t + c2*t² + ..., t = (x - origin) / scale
+         * @return false if not enough points or singular system
+         */
+        bool solveCentered(double *coeffs) const;
+        /**
+         * @brief Solve normal equations, coefficients expanded to powers of x
+         * @param coeffs degree+1 output coefficients, y = c0 + c1*x + c2*x² + ... (x in caller units)
+         * @return false if not enough points or singular system
+         */
+        bool solve(double *coeffs) const;
+        /// Abscissa of the extremum of a degree 2 fit (caller units), false if not available
+        bool vertex(double &x) const;
+        /// Fitted value at x, 0 if fit is not available
+        double evaluate(double x) const;
+        /// Weighted sum of squared residuals of the current fit
+        double chisq() const;
+
+    private:
+        int mDegree = 2;
+        int mCount = 0;
+        double mOrigin = 0;
+        double mScale = 1;
+        double mSumT[2 * MaxDegree + 1];   ///< sum w*t^k, k = 0..2*degree
+        double mSumTY[MaxDegree + 1];      ///< sum w*y*t^k, k = 0..degree
+        double mSumYY = 0;                 ///< sum w*y², for chisq
+};
+
+/**
+ * @brief Convenience wrapper, one-shot fit of obs points
+ * @param degree number of coefficients (2 = linear, 3 = quadratic)
+ * @param store degree output coefficients [c0, c1, ...]
+ * @return false if the fit failed (not enough points, singular system)
+ */
+bool polynomialfit(int obs, int degree, double *dx, double *dy, double *store);
@@ -0,0 +1,171 @@
+/**
+ * @file zonegrid.cpp
+ * @brief Per-zone star statistics and separable smoothing
+ */
+
+#include "zonegrid.h"
+
+#include <algorithm>
+#include <cmath>
+
+ZoneGrid::ZoneGrid(int zones, int width, int height)
+{
+    mKernel = boxKernel(1);
+    reset(zones, width, height);
+}
+
+void ZoneGrid::reset(int zones, int width, int height)
+{
+    mZones = std::max(1, zones);
+    mWidth = std::max(1, width);
+    mHeight = std::max(1, height);
+    int n = size();
+    mCount.assign(n, 0);
+    mSumHfr.assign(n, 0);
+    mSumA.assign(n, 0);
+    mSumB.assign(n, 0);
+    mSumCos.assign(n, 0);
+    mSumSin.assign(n, 0);
+    mHfr.assign(n, NoValue);
+    mSmoothedHfr.assign(n, NoValue);
+    mA.assign(n, NoValue);
+    mB.assign(n, NoValue);
+    mEllipticity.assign(n, NoValue);
+    mTheta.assign(n, NoValue);
+    mStars = 0;
+    mSumAll = 0;
+}
+
+void ZoneGrid::clear()
+{
+    reset(mZones, mWidth, mHeight);
+}
+
+void ZoneGrid::add(float x, float y, float hfr, float a, float b, float theta)
+{
+    int column = std::min(mZones - 1, std::max(0, int(x * mZones / mWidth)));
+    int line = std::min(mZones - 1, std::max(0, int(y * mZones / mHeight)));
+    int zone = line * mZones + column;
+    float t = theta * float(M_PI / 90);
+
+    mCount[zone]++;
+    mSumHfr[zone] += hfr;
+    mSumA[zone] += a;
+    mSumB[zone] += b;
+    mSumCos[zone] += std::cos(t);
+    mSumSin[zone] += std::sin(t);
+    mStars++;
+    mSumAll += hfr;
+}
+
+void ZoneGrid::compute()
+{
+    int n = size();
+    for (int i = 0; i < n; i++)
+    {
+        if (mCount[i] == 0)
+        {
+            mHfr[i] = mA[i] = mB[i] = mEllipticity[i] = mTheta[i] = NoValue;
+            continue;
+        }
+        float inv = 1.0f / mCount[i];
+        mHfr[i] = mSumHfr[i] * inv;
+        mA[i] = mSumA[i] * inv;
+        mB[i] = mSumB[i] * inv;
+        mEllipticity[i] = mB[i] > 0 ? mA[i] / mB[i] - 1 : NoValue;
+        mTheta[i] = std::atan2(mSumSin[i], mSumCos[i]) * float(90 / M_PI);
+    }
+    smooth(mHfr.data(), mSmoothedHfr.data());
+}
+
+void ZoneGrid::setKernel(const std::vector<float> &kernel)
+{
+    if (kernel.empty() || kernel.size() % 2 == 0) return;
+    mKernel = kernel;
+}
+
+std::vector<float> ZoneGrid::boxKernel(int radius)
+{
+    return std::vector<float>(2 * std::max(0, radius) + 1, 1.0f);
+}
+
+std::vector<float> ZoneGrid::gaussianKernel(float sigma)
+{
+    if (sigma <= 0) return boxKernel(0);
+    int radius = int(std::ceil(3 * sigma));
+    std::vector<float> k(2 * radius + 1);
+    for (int d = -radius; d <= radius; d++) k[d + radius] = std::exp(-0.5f * d * d / (sigma * sigma));
+    return k;
+}
+
+void ZoneGrid::smooth(const float *in, float *out) const
+{
+    int nz = mZones;
+    int n = size();
+    int radius = int(mKernel.size()) / 2;
+
+    /* weighted values and weights, empty cells weigh nothing */
+    std::vector<float> value(n), weight(n);
+    for (int i = 0; i < n; i++)
+    {
+        weight[i] = in[i] != NoValue ? 1.0f : 0.0f;
+        value[i] = weight[i] > 0 ? in[i] : 0.0f;
+    }
+
+    /* along lines */
+    std::vector<float> lineValue(n, 0.0f), lineWeight(n, 0.0f);
+    for (int line = 0; line < nz; line++)
+    {
+        const float *v = &value[line * nz];
+        const float *w = &weight[line * nz];
+        float *lv = &lineValue[line * nz];
+        float *lw = &lineWeight[line * nz];
+        for (int d = -radius; d <= radius; d++)
+        {
+            float k = mKernel[d + radius];
+            int first = std::max(0, -d);
+            int last = std::min(nz, nz - d);
+            for (int column = first; column < last; column++)
+            {
+                lv[column] += k * v[column + d];
+                lw[column] += k * w[column + d];
+            }
+        }
+    }
+
+    /* along columns, whole lines at once */
+    std::vector<float> sumValue(n, 0.0f), sumWeight(n, 0.0f);
+    for (int d = -radius; d <= radius; d++)
+    {
+        float k = mKernel[d + radius];
+        int first = std::max(0, -d);
+        int last = std::min(nz, nz - d);
+        for (int line = first; line < last; line++)
+        {
+            const float *lv = &lineValue[(line + d) * nz];
+            const float *lw = &lineWeight[(line + d) * nz];
+            float *sv = &sumValue[line * nz];
+            float *sw = &sumWeight[line * nz];
+            for (int column = 0; column < nz; column++)
+            {
+                sv[column] += k * lv[column];
+                sw[column] += k * lw[column];
+            }
+        }
+    }
+
+    for (int i = 0; i < n; i++) out[i] = sumWeight[i] > 0 ? sumValue[i] / sumWeight[i] : NoValue;
+}
+
+bool ZoneGrid::range(const float *values, float &min, float &max) const
+{
+    bool found = false;
+    for (int i = 0; i < size(); i++)
+    {
+        if (values[i] == NoValue) continue;
+        if (!found || values[i] < min) min = values[i];
+        if (!found || values[i] > max) max = values[i];
+        found = true;
+    }
+    return found;
+}
@@ -0,0 +1,129 @@
+/**
+ * @file zonegrid.h
+ * @brief Per-zone star statistics over a square grid, used by inspector, reusable by focus
+ *
+ * ZoneGrid splits the frame in zones x zones cells and accumulates, in a
+ * single pass over the stars, the mean HFR, mean axes and mean orientation of
+ * each cell. Orientation is averaged on the doubled angle (cos 2θ, sin 2θ) so
+ * that -89° and +89° average to 90° and not to 0°.
+ *
+ * Values are kept in contiguous float arrays, row major, zone = line * zones
+ * + column. Cells without stars hold NoValue (99, as elsewhere in OST).
+ *
+ * smooth() applies a separable kernel over the grid: one pass along lines,
+ * one along columns, both over contiguous memory. Empty cells and cells
+ * outside the grid are left out of the weighted average rather than counted
+ * as zero, so borders and corners are renormalized automatically. With the
+ * default 3 taps box kernel this is the former "average of the 8 surrounding
+ * cells" smoothing of the inspector.
+ */
+
+#pragma once
+
+#include <vector>
+
+class ZoneGrid
+{
+    public:
+        static constexpr float NoValue = 99;
+
+        explicit ZoneGrid(int zones = 1, int width = 1, int height = 1);
+
+        /// Change the grid and frame size, drop all stars
+        void reset(int zones, int width, int height);
+        /// Drop all stars, keep grid and kernel
+        void clear();
+        /// Accumulate one star, frame pixel coordinates, theta in degrees
+        void add(float x, float y, float hfr, float a, float b, float theta);
+        /// Accumulate any list of FITSImage::Star like objects
+        template<typename Stars>
+        void addStars(const Stars &stars)
+        {
+            for (const auto &s : stars) add(s.x, s.y, s.HFR, s.a, s.b, s.theta);
+        }
+        /// Turn sums into means and smooth the HFR map, call once all stars are added
+        void compute();
+
+        /// Odd number of taps, applied along lines then columns
+        void setKernel(const std::vector<float> &kernel);
+        static std::vector<float> boxKernel(int radius);
+        static std::vector<float> gaussianKernel(float sigma);
+
+        /// Smooth any zones x zones map, NoValue cells are ignored
+        void smooth(const float *in, float *out) const;
+
+        int zones() const
+        {
+            return mZones;
+        }
+        int size() const
+        {
+            return mZones * mZones;
+        }
+        int stars() const
+        {
+            return mStars;
+        }
+        int count(int zone) const
+        {
+            return mCount[zone];
+        }
+        /// Mean HFR (pixels) per zone
+        const float *hfr() const
+        {
+            return mHfr.data();
+        }
+        /// Mean HFR after smoothing
+        const float *smoothedHfr() const
+        {
+            return mSmoothedHfr.data();
+        }
+        /// Mean major and minor axes per zone
+        const float *a() const
+        {
+            return mA.data();
+        }
+        const float *b() const
+        {
+            return mB.data();
+        }
+        /// a/b - 1 from mean axes
+        const float *ellipticity() const
+        {
+            return mEllipticity.data();
+        }
+        /// Mean orientation per zone, degrees in ]-90, 90]
+        const float *theta() const
+        {
+            return mTheta.data();
+        }
+        /// Mean HFR over all stars, NoValue if none
+        float hfrAvg() const
+        {
+            return mStars > 0 ? mSumAll / mStars : NoValue;
+        }
+        /// Smallest and largest valid value of a map, false if the map is empty
+        bool range(const float *values, float &min, float &max) const;
+
+    private:
+        int mZones = 1;
+        int mWidth = 1;
+        int mHeight = 1;
+        int mStars = 0;
+        double mSumAll = 0;
+        std::vector<float> mKernel;
+
+        std::vector<int> mCount;
+        std::vector<float> mSumHfr;
+        std::vector<float> mSumA;
+        std::vector<float> mSumB;
+        std::vector<float> mSumCos;
+        std::vector<float> mSumSin;
+
+        std::vector<float> mHfr;
+        std::vector<float> mSmoothedHfr;
+        std::vector<float> mA;
+        std::vector<float> mB;
+        std::vector<float> mEllipticity;
+        std::vector<float> mTheta;
+};
@@ -0,0 +1,287 @@
+/**
+ * @file focusbench.cpp
+ * @brief Autofocus benchmark on synthetic star fields, no hardware nor INDI needed
+ *
+ * Replays the Focus state machine sequence (backlash, goto start, N positions
+ * x loopIterations frames, backlash, goto best, final exposure) against
+ * StarField frames. Frames go through the same path as in the module :
+ * FITS loaded by fileio, stars extracted by Solver (SEP), then FocusCurve
+ * (SMComputeLoopFrame / SMCompute / zone fits).
+ *
+ * Reports number of exposures and moves, simulated session time, final
+ * position error and per zone errors. Exit code is 1 when the final error
+ * exceeds --tolerance, so it can be used to catch regressions.
+ *
+ * Example : focusbench --iterations 7 --steps 1000 --tilt-x 400 --zoning 3
+ */
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QTemporaryDir>
+#include <QTimer>
+#include <QTextStream>
+
+#include <fitsio.h>
+#include <fileio.h>
+#include <solver.h>
+
+#include <cmath>
+
+#include "focuscurve.h"
+#include "moveplanner.h"
+#include "starfield.h"
+#include "tiltsolver.h"
+
+namespace
+{
+
+struct Session
+{
+    double exposure = 2;        ///< s
+    double download = 1;        ///< s per frame
+    double moveOverhead = 2;    ///< s per focuser round trip
+    double moveSpeed = 1000;    ///< steps per second
+    double sampling = 1;        ///< arcsec per pixel
+
+    int exposures = 0;
+    int moves = 0;
+    double simulated = 0;       ///< s
+    double position = 0;
+    qint64 renderMs = 0;
+    qint64 analysisMs = 0;
+    qint64 curveUs = 0;
+};
+
+void moveTo(Session &session, double position)
+{
+    session.moves++;
+    session.simulated += session.moveOverhead + std::fabs(position - session.position) / session.moveSpeed;
+    session.position = position;
+}
+
+bool writeFits(const QString &path, const std::vector<uint16_t> &frame, int width, int height)
+{
+    fitsfile *fptr = nullptr;
+    int status = 0;
+    long naxes[2] = {width, height};
+    QByteArray name = ("!" + path).toLocal8Bit();
+    fits_create_file(&fptr, name.constData(), &status);
+    fits_create_img(fptr, USHORT_IMG, 2, naxes, &status);
+    fits_write_img(fptr, TUSHORT, 1, frame.size(), const_cast<uint16_t *>(frame.data()), &status);
+    fits_close_file(fptr, &status);
+    return status == 0;
+}
+
+/// Shoot and analyze one frame, as Focus::newBLOB + SMFindStars + OnSucessSEP
+bool shoot(Session &session, const StarField &field, int zoning, unsigned int seed, const QString &dir,
+           Solver &solver)
+{
+    session.exposures++;
+    session.simulated += session.exposure + session.download;
+
+    QElapsedTimer timer;
+    timer.start();
+    std::vector<uint16_t> frame;
+    field.render(session.position, seed, frame);
+    QString path = dir + "/frame" + QString::number(session.exposures) + ".fits";
+    if (!writeFits(path, frame, field.params().width, field.params().height)) return false;
+    session.renderMs += timer.restart();
+
+    fileio image;
+    image.loadFits(path);
+    FITSImage::Statistic stats = image.getStats();
+
+    bool done = false;
+    QEventLoop loop;
+    QMetaObject::Connection connection = QObject::connect(&solver, &Solver::successSEP, &loop, [&]()
+    {
+        done = true;
+        loop.quit();
+    });
+    solver.ResetSolver(stats, image.getImageBuffer(), zoning);
+    solver.FindStars(solver.stellarSolverProfiles[0]);
+    if (!done)
+    {
+        QTimer::singleShot(60000, &loop, &QEventLoop::quit);
+        loop.exec();
+    }
+    QObject::disconnect(connection);
+    session.analysisMs += timer.elapsed();
+    return done;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("focusbench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Autofocus benchmark on synthetic defocused star fields");
+    parser.addHelpOption();
+    auto opt = [&parser](const QString & name, const QString & help, const QString & def)
+    {
+        parser.addOption(QCommandLineOption(name, help + " (default " + def + ")", "value", def));
+    };
+    opt("width", "Frame width (px)", "1600");
+    opt("height", "Frame height (px)", "1200");
+    opt("stars", "Number of stars", "150");
+    opt("seed", "Random seed", "1");
+    opt("best", "True best focus position at center", "31000");
+    opt("steps-per-pixel", "Focuser steps per pixel of defocus radius", "250");
+    opt("seeing", "Seeing FWHM (px)", "2.5");
+    opt("seeing-jitter", "Relative frame to frame seeing variation", "0.1");
+    opt("obstruction", "Central obstruction ratio", "0.35");
+    opt("tilt-x", "Best position shift center to right edge (steps)", "0");
+    opt("tilt-y", "Best position shift center to bottom edge (steps)", "0");
+    opt("curvature", "Best position shift center to corner (steps)", "0");
+    opt("background", "Sky background (ADU)", "800");
+    opt("read-noise", "Read noise (ADU)", "8");
+    opt("start", "Initial focuser position, scan is centered on it (aroundinitial)", "30500");
+    opt("steps", "Steps gap", "1000");
+    opt("iterations", "Iterations", "7");
+    opt("loop", "Frames averaged per position (loopIterations)", "2");
+    opt("backlash", "Backlash overshoot", "100");
+    opt("zoning", "Zoning", "2");
+    opt("exposure", "Exposure time (s)", "2");
+    opt("download", "Download time per frame (s)", "1");
+    opt("move-overhead", "Focuser round trip overhead (s)", "2");
+    opt("move-speed", "Focuser speed (steps/s)", "1000");
+    opt("sampling", "Sampling (arcsec/px)", "1");
+    opt("tolerance", "Max final position error (steps) for success", "200");
+    parser.addOption(QCommandLineOption("keep", "Keep generated FITS frames in <dir>", "dir"));
+    parser.process(app);
+
+    auto num = [&parser](const QString & name)
+    {
+        return parser.value(name).toDouble();
+    };
+
+    StarFieldParams p;
+    p.width = num("width");
+    p.height = num("height");
+    p.stars = num("stars");
+    p.seed = num("seed");
+    p.bestPos = num("best");
+    p.stepsPerPixel = num("steps-per-pixel");
+    p.seeing = num("seeing");
+    p.seeingJitter = num("seeing-jitter");
+    p.obstruction = num("obstruction");
+    p.tiltX = num("tilt-x");
+    p.tiltY = num("tilt-y");
+    p.curvature = num("curvature");
+    p.background = num("background");
+    p.readNoise = num("read-noise");
+    StarField field(p);
+
+    Session session;
+    session.exposure = num("exposure");
+    session.download = num("download");
+    session.moveOverhead = num("move-overhead");
+    session.moveSpeed = num("move-speed");
+    session.sampling = num("sampling");
+
+    int steps = num("steps");
+    int iterations = num("iterations");
+    int loopIterations = num("loop");
+    int backlash = num("backlash");
+    int zoning = num("zoning");
+    double startpos = num("start") - steps * iterations / 2;
+    session.position = num("start");
+
+    QTemporaryDir tmp;
+    QString dir = parser.isSet("keep") ? parser.value("keep") : tmp.path();
+    QDir().mkpath(dir);
+
+    Solver solver;
+    FocusCurve curve;
+    MovePlanner planner;
+    QElapsedTimer timer;
+    unsigned int seed = p.seed * 1000;
+    QTextStream out(stdout);
+
+    // Init : RequestBacklash (only on direction reversal), RequestGotoStart
+    curve.reset(zoning, startpos, steps);
+    planner.setBacklash(backlash);
+    planner.setPosition(session.position);
+    for (double move : planner.plan(startpos)) moveTo(session, move);
+    planner.moved(startpos);
+
+    // Loop : LoopFrame (RequestExposure, FindStars, ComputeLoopFrame) x loop, Compute, RequestGotoNext
+    for (int iteration = 0; iteration < iterations; iteration++)
+    {
+        double pos = startpos + iteration * steps;
+        if (iteration > 0)
+        {
+            moveTo(session, pos);
+            planner.moved(pos);
+        }
+        curve.startPosition();
+        for (int i = 0; i < loopIterations; i++)
+        {
+            if (!shoot(session, field, zoning, seed++, dir, solver))
+            {
+                out << "Star extraction failed at position " << pos << "\n";
+                return 2;
+            }
+            timer.start();
+            curve.addFrame(solver.HFRavg, solver.HFRavgZone, session.sampling);
+            session.curveUs += timer.nsecsElapsed() / 1000;
+        }
+        timer.start();
+        curve.closePosition(pos);
+        session.curveUs += timer.nsecsElapsed() / 1000;
+        out << QString("pos %1  hfr %2''  fit %3").arg(pos, 8).arg(curve.positionHfr(), 6, 'f', 3)
+            .arg(curve.bestPosFit(), 9, 'f', 1) << "\n";
+    }
+
+    // Finish : RequestBacklashBest (only on direction reversal), RequestGotoBest, RequestExposureBest, FindStarsFinal
+    double best = curve.hasFit() ? curve.bestPosFit() : curve.bestPos();
+    for (double move : planner.plan(best)) moveTo(session, move);
+    shoot(session, field, zoning, seed++, dir, solver);
+    double finalHfr = solver.HFRavg * session.sampling;
+
+    double error = best - field.bestPosAt(p.width / 2.0, p.height / 2.0);
+    out << "\n";
+    out << "exposures        " << session.exposures << "\n";
+    out << "focuser moves    " << session.moves << "\n";
+    out << "simulated time   " << QString::number(session.simulated, 'f', 1) << " s\n";
+    out << "final position   " << QString::number(best, 'f', 1) << " (true " << p.bestPos << ")\n";
+    out << "position error   " << QString::number(error, 'f', 1) << " steps\n";
+    out << "final HFR        " << QString::number(finalHfr, 'f', 3) << "''\n";
+    out << "render time      " << session.renderMs << " ms\n";
+    out << "analysis time    " << session.analysisMs << " ms\n";
+    out << "curve/fit time   " << session.curveUs << " us\n";
+
+    for (int zone = 0; zone < curve.zoneCount(); zone++)
+    {
+        double zx = (zone % zoning + 0.5) * p.width / zoning;
+        double zy = (zone / zoning + 0.5) * p.height / zoning;
+        out << QString("zone %1  fit %2  true %3  error %4").arg(zone + 1, 2)
+            .arg(curve.zoneBestPosFit(zone), 9, 'f', 1)
+            .arg(field.bestPosAt(zx, zy), 9, 'f', 1)
+            .arg(curve.zoneBestPosFit(zone) - field.bestPosAt(zx, zy), 7, 'f', 1) << "\n";
+    }
+
+    // tilt in focuser steps : 1 µm steps, sensor size is irrelevant for edge/corner shifts
+    std::vector<double> zoneFocus;
+    for (int zone = 0; zone < curve.zoneCount(); zone++)
+    {
+        zoneFocus.push_back(curve.zoneHasFit(zone) ? curve.zoneBestPosFit(zone) : std::nan(""));
+    }
+    TiltSolver tilt;
+    if (tilt.solve(zoning, zoneFocus, p.width / 1000.0, p.height / 1000.0))
+    {
+        out << QString("tilt x %1 (true %2)  tilt y %3 (true %4)  curvature %5 (true %6)  rms %7 steps")
+            .arg(tilt.tiltX(), 0, 'f', 1).arg(p.tiltX).arg(tilt.tiltY(), 0, 'f', 1).arg(p.tiltY)
+            .arg(tilt.hasCurvature() ? tilt.curvature() : 0, 0, 'f', 1).arg(p.curvature)
+            .arg(tilt.rms(), 0, 'f', 1) << "\n";
+    }
+    out.flush();
+
+    return std::fabs(error) <= num("tolerance") ? 0 : 1;
+}
@@ -0,0 +1,98 @@
+#include "starfield.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+StarField::StarField(const StarFieldParams &params) : mParams(params)
+{
+    std::mt19937 rng(mParams.seed);
+    std::uniform_real_distribution<double> ux(20, mParams.width - 20);
+    std::uniform_real_distribution<double> uy(20, mParams.height - 20);
+    std::uniform_real_distribution<double> u01(0, 1);
+    for (int i = 0; i < mParams.stars; i++)
+    {
+        // log-uniform fluxes : many faint stars, a few bright ones
+        double flux = mParams.fluxMin * std::pow(mParams.fluxMax / mParams.fluxMin, u01(rng));
+        mStars.push_back({ux(rng), uy(rng), flux});
+    }
+}
+
+double StarField::bestPosAt(double x, double y) const
+{
+    double dx = (x - mParams.width / 2.0) / (mParams.width / 2.0);
+    double dy = (y - mParams.height / 2.0) / (mParams.height / 2.0);
+    return mParams.bestPos + mParams.tiltX * dx + mParams.tiltY * dy + mParams.curvature * (dx * dx + dy * dy) / 2;
+}
+
+void StarField::render(double focuserPosition, unsigned int frameSeed, std::vector<uint16_t> &frame) const
+{
+    const int w = mParams.width;
+    const int h = mParams.height;
+    std::mt19937 rng(frameSeed);
+    std::normal_distribution<double> gauss(0, 1);
+
+    double seeing = mParams.seeing * std::max(0.3, 1 + mParams.seeingJitter * gauss(rng));
+    double sigma = seeing / 2.3548;
+    double beta = mParams.moffatBeta;
+
+    std::vector<double> img(static_cast<size_t>(w) * h, mParams.background);
+    std::vector<double> stamp;
+
+    for (const Star &s : mStars)
+    {
+        // defocus disc radius, blended from Moffat (in focus) to donut (defocused)
+        double radius = std::fabs(focuserPosition - bestPosAt(s.x, s.y)) / mParams.stepsPerPixel;
+        double inner = mParams.obstruction * radius;
+        double blend = std::exp(-std::pow(2 * radius / seeing, 2));
+        double fwhm = std::sqrt(seeing * seeing + radius * radius);
+        double alpha = fwhm / (2 * std::sqrt(std::pow(2, 1 / beta) - 1));
+
+        // Moffat wings only matter while the star is not a donut yet
+        double extent = (blend > 1e-3) ? std::max(radius + 4 * seeing, 4 * fwhm) : radius + 4 * seeing;
+        int half = static_cast<int>(std::ceil(extent)) + 1;
+        int x0 = std::max(0, static_cast<int>(s.x) - half);
+        int x1 = std::min(w - 1, static_cast<int>(s.x) + half);
+        int y0 = std::max(0, static_cast<int>(s.y) - half);
+        int y1 = std::min(h - 1, static_cast<int>(s.y) + half);
+        int sw = x1 - x0 + 1;
+
+        stamp.assign(static_cast<size_t>(sw) * (y1 - y0 + 1), 0);
+        double total = 0;
+        for (int y = y0; y <= y1; y++)
+        {
+            for (int x = x0; x <= x1; x++)
+            {
+                double r = std::hypot(x + 0.5 - s.x, y + 0.5 - s.y);
+                double moffat = 0;
+                if (blend > 1e-3) moffat = std::pow(1 + (r / alpha) * (r / alpha), -beta);
+                double donut = 0;
+                if (blend < 1)
+                {
+                    donut = 0.5 * (std::erf((radius - r) / (M_SQRT2 * sigma)) - std::erf((inner - r) / (M_SQRT2 * sigma)));
+                }
+                double v = blend * moffat + (1 - blend) * donut;
+                stamp[(y - y0) * sw + (x - x0)] = v;
+                total += v;
+            }
+        }
+        if (total <= 0) continue;
+        double k = s.flux / total;
+        for (int y = y0; y <= y1; y++)
+        {
+            for (int x = x0; x <= x1; x++)
+            {
+                img[static_cast<size_t>(y) * w + x] += k * stamp[(y - y0) * sw + (x - x0)];
+            }
+        }
+    }
+
+    frame.resize(img.size());
+    for (size_t i = 0; i < img.size(); i++)
+    {
+        double v = img[i];
+        double noise = std::sqrt(mParams.readNoise * mParams.readNoise + v / mParams.gain);
+        v += noise * gauss(rng);
+        frame[i] = static_cast<uint16_t>(std::min(65535.0, std::max(0.0, v)));
+    }
+}
@@ -0,0 +1,67 @@
+/**
+ * @file starfield.h
+ * @brief Synthetic defocused star field renderer for the focus benchmark
+ *
+ * Renders 16 bits frames of a fixed random star field as seen through a
+ * focuser at a given position : stars are Moffat profiles near focus and
+ * turn into donuts (central obstruction) when defocused. Best focus position
+ * may vary across the field (tilt, field curvature), seeing jitters from
+ * frame to frame, shot and read noise are added.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+struct StarFieldParams
+{
+    int width = 1600;
+    int height = 1200;
+    int stars = 150;
+    unsigned int seed = 1;
+
+    double bestPos = 31000;         ///< best focuser position at frame center
+    double stepsPerPixel = 250;     ///< defocus disc radius grows 1 pixel every N steps
+    double seeing = 2.5;            ///< seeing FWHM (pixels)
+    double seeingJitter = 0.1;      ///< relative frame to frame seeing variation
+    double moffatBeta = 3;
+    double obstruction = 0.35;      ///< central obstruction ratio
+
+    double tiltX = 0;               ///< best position shift (steps) from center to right edge
+    double tiltY = 0;               ///< best position shift (steps) from center to bottom edge
+    double curvature = 0;           ///< best position shift (steps) from center to corner, radial
+
+    double background = 800;        ///< sky level (ADU)
+    double readNoise = 8;           ///< ADU
+    double gain = 1;                ///< e-/ADU, shot noise
+    double fluxMin = 2e4;           ///< star total flux range (ADU)
+    double fluxMax = 4e5;
+};
+
+class StarField
+{
+    public:
+        explicit StarField(const StarFieldParams &params);
+
+        /// Render frame at focuser position, frameSeed drives noise and seeing jitter
+        void render(double focuserPosition, unsigned int frameSeed, std::vector<uint16_t> &frame) const;
+        /// True best focuser position at pixel (x, y)
+        double bestPosAt(double x, double y) const;
+
+        const StarFieldParams &params() const
+        {
+            return mParams;
+        }
+
+    private:
+        struct Star
+        {
+            double x;
+            double y;
+            double flux;
+        };
+
+        StarFieldParams mParams;
+        std::vector<Star> mStars;
+};
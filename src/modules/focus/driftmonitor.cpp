@@ -0,0 +1,104 @@
+#include "driftmonitor.h"
+
+#include <algorithm>
+#include <cmath>
+
+void DriftMonitor::setWindow(int frames)
+{
+    mWindow = std::max(1, frames);
+    for (auto &f : mFilters)
+    {
+        while (f.window.size() > mWindow) f.window.removeFirst();
+    }
+}
+
+void DriftMonitor::setThresholds(double hfrRatio, double temperature)
+{
+    mHfrRatio = hfrRatio;
+    mTemperature = temperature;
+}
+
+void DriftMonitor::setReference(const QString &filter, double hfr, double temperature)
+{
+    FilterState &f = mFilters[filter];
+    f.hasReference = hfr > 0;
+    f.refHfr = hfr;
+    f.hasRefTemperature = !std::isnan(temperature);
+    f.refTemperature = temperature;
+    f.window.clear();
+}
+
+DriftMonitor::Verdict DriftMonitor::addFrame(const QString &filter, double hfr, double temperature)
+{
+    FilterState &f = mFilters[filter];
+
+    if (mTemperature > 0 && !std::isnan(temperature))
+    {
+        if (!f.hasRefTemperature)
+        {
+            f.refTemperature = temperature;
+            f.hasRefTemperature = true;
+        }
+        else if (std::fabs(temperature - f.refTemperature) > mTemperature)
+        {
+            // advise once per drift : the next advice needs another delta from here
+            f.refTemperature = temperature;
+            return TemperatureDrift;
+        }
+    }
+
+    if (hfr <= 0) return None;
+    f.window.append(hfr);
+    if (f.window.size() > mWindow) f.window.removeFirst();
+    if (f.window.size() < mWindow) return None;
+
+    double m = median(f.window);
+    if (!f.hasReference)
+    {
+        // no autofocus yet for this filter : first full window is the baseline
+        f.hasReference = true;
+        f.refHfr = m;
+        return None;
+    }
+    if (m > f.refHfr * (1 + mHfrRatio)) return HfrDrift;
+    return None;
+}
+
+bool DriftMonitor::hasReference(const QString &filter) const
+{
+    return mFilters.contains(filter) && mFilters[filter].hasReference;
+}
+
+double DriftMonitor::reference(const QString &filter) const
+{
+    return hasReference(filter) ? mFilters[filter].refHfr : 0;
+}
+
+double DriftMonitor::trend(const QString &filter) const
+{
+    if (!mFilters.contains(filter) || mFilters[filter].window.isEmpty()) return 0;
+    return median(mFilters[filter].window);
+}
+
+void DriftMonitor::clearWindow(const QString &filter)
+{
+    if (mFilters.contains(filter)) mFilters[filter].window.clear();
+}
+
+void DriftMonitor::clear()
+{
+    mFilters.clear();
+}
+
+double DriftMonitor::median(QVector<double> values)
+{
+    if (values.isEmpty()) return 0;
+    int n = values.size();
+    std::nth_element(values.begin(), values.begin() + n / 2, values.end());
+    double m = values[n / 2];
+    if (n % 2 == 0)
+    {
+        m = (m + *std::max_element(values.begin(), values.begin() + n / 2)) / 2;
+    }
+    return m;
+}
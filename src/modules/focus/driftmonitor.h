@@ -0,0 +1,63 @@
+/**
+ * @file driftmonitor.h
+ * @brief Passive focus drift detection from frames shot by other modules
+ *
+ * For each filter, keeps a reference (HFR and temperature at last autofocus,
+ * or first stable window when no autofocus has been run yet) and a rolling
+ * window of recent HFR measurements. The median of the window is compared to
+ * the reference, so a single bad frame (cloud, guiding glitch, satellite)
+ * cannot trigger a refocus.
+ */
+
+#pragma once
+
+#include <QMap>
+#include <QString>
+#include <QVector>
+
+class DriftMonitor
+{
+    public:
+        enum Verdict
+        {
+            None,
+            HfrDrift,
+            TemperatureDrift
+        };
+
+        void setWindow(int frames);
+        /// hfrRatio : relative degradation (0.15 = +15%), temperature : absolute delta in °C (<=0 disables)
+        void setThresholds(double hfrRatio, double temperature);
+
+        /// Set filter reference, typically after autofocus. temperature may be NaN if unknown
+        void setReference(const QString &filter, double hfr, double temperature);
+        /// Feed one frame measurement, hfr <= 0 (no stars) is ignored.
+        /// A TemperatureDrift moves the temperature reference to temperature
+        Verdict addFrame(const QString &filter, double hfr, double temperature);
+
+        bool hasReference(const QString &filter) const;
+        double reference(const QString &filter) const;
+        /// Median of the current window, 0 if empty
+        double trend(const QString &filter) const;
+
+        /// Forget recent frames of a filter (e.g. once a refocus has been advised)
+        void clearWindow(const QString &filter);
+        void clear();
+
+    private:
+        struct FilterState
+        {
+            bool hasReference = false;
+            double refHfr = 0;
+            double refTemperature = 0;
+            bool hasRefTemperature = false;
+            QVector<double> window;
+        };
+
+        static double median(QVector<double> values);
+
+        QMap<QString, FilterState> mFilters;
+        int mWindow = 5;
+        double mHfrRatio = 0.15;
+        double mTemperature = 1;
+};
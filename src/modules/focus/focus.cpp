@@ -1,6 +1,10 @@
 #include "focus.h"
-#include "polynomialfit.h"
 #include "versionModule.cc"
+#include <algorithm>
+#include <cmath>
+#include <QDir>
+#include <QFile>
+#include <QJsonDocument>
 
 Focus *initialize(QString name, QString label, QString profile, QVariantMap availableModuleLibs)
 {
@@ -38,6 +42,7 @@ Focus::Focus(QString name, QString label, QString profile, QVariantMap available
     pMachine->connectToState("ComputeLoopFrame", QScxmlStateMachine::onEntry(this, &Focus::SMComputeLoopFrame));
     pMachine->connectToState("InitLoopFrame", QScxmlStateMachine::onEntry(this, &Focus::SMInitLoopFrame));
     pMachine->connectToState("FindStarsFinal", QScxmlStateMachine::onEntry(this, &Focus::SMFindStars));
+    pMachine->connectToState("Final_1", QScxmlStateMachine::onEntry(this, &Focus::SMRunEnded));
 
 
     _startpos =          getEltInt("parameters", "startpos")->value();
@@ -45,6 +50,7 @@ Focus::Focus(QString name, QString label, QString profile, QVariantMap available
     _iterations =        getEltInt("parameters", "iterations")->value();
     _loopIterations =    getEltInt("parameters", "loopIterations")->value();
     _backlash =          getEltInt("parameters", "backlash")->value();
+    mStackFrames = getBool("parameters", "stackframes") && _loopIterations > 1;
 
     defineMeAsFocuser();
     giveMeADevice("camera", "Camera", INDI::BaseDevice::CCD_INTERFACE);
@@ -55,7 +61,7 @@ Focus::Focus(QString name, QString label, QString profile, QVariantMap available
 
 Focus::~Focus()
 {
-
+    stopMonitorAnalysis();
 }
 void Focus::OnMyExternalEvent(const QString &eventType, const QString  &eventModule, const QString  &eventKey,
                               const QVariantMap &eventData)
@@ -71,6 +77,19 @@ void Focus::OnMyExternalEvent(const QString &eventType, const QString  &eventMod
         return;
     }
 
+    // the sequencer will not act on the advice : monitor again
+    if (eventType == "focusadvisedrejected" && getModuleName() == eventModule)
+    {
+        mDriftAdvised = false;
+        return;
+    }
+
+    if (eventType == "afterinit" && getModuleName() == eventModule)
+    {
+        if (getBool("monitor", "enabled")) startMonitor();
+        return;
+    }
+
     if (getModuleName() == eventModule)
     {
         foreach(const QString &keyprop, eventData.keys())
@@ -99,6 +118,7 @@ void Focus::OnMyExternalEvent(const QString &eventType, const QString  &eventMod
                             getProperty("devices")->enable();
                             getProperty("parameters")->enable();
 
+                            mMoves.clear();
                             pMachine->submitEvent("abort");
                         }
                     }
@@ -111,6 +131,10 @@ void Focus::OnMyExternalEvent(const QString &eventType, const QString  &eventMod
                     }
 
                 }
+                if (keyprop == "monitor" && keyelt == "enabled" && val.toBool())
+                {
+                    startMonitor();
+                }
             }
         }
     }
@@ -134,7 +158,12 @@ void Focus::updateProperty(INDI::Property p)
         INDI::PropertyNumber n = p;
         getEltInt("values", "focpos")->setValue(n[0].value, true);
 
-        if (n.getState() == IPS_OK)
+        // within a planned sequence, the next step is sent right away : the state machine only sees its end
+        if (n.getState() == IPS_OK && !mMoves.isEmpty())
+        {
+            if (!sendMoves(mMoves)) pMachine->submitEvent("abort");
+        }
+        else if (n.getState() == IPS_OK)
         {
             pMachine->submitEvent("GotoBestDone");
             pMachine->submitEvent("BacklashBestDone");
@@ -170,7 +199,8 @@ void Focus::newBLOB(INDI::PropertyBlob b)
         (QString(b.getDeviceName()) == getString("devices", "camera"))
     )
     {
-        delete _image;
+        // the monitor's frame is released by OnMonitorSEP
+        if (_image != mMonitorImage) delete _image;
         _image = new fileio();
         _image->loadBlob(b, 64);
         getProperty("image")->setState(OST::Ok);
@@ -184,9 +214,14 @@ void Focus::newBLOB(INDI::PropertyBlob b)
 
         if (pMachine->isRunning())
         {
+            mExposureMs += mStepTimer.elapsed();
             pMachine->submitEvent("ExposureDone");
             pMachine->submitEvent("ExposureBestDone");
         }
+        else if (getBool("monitor", "enabled"))
+        {
+            monitorFrame();
+        }
 
     }
 }
@@ -196,8 +231,17 @@ void Focus::SMAbort()
     pMachine->stop();
 }
 
+void Focus::SMRunEnded()
+{
+    // successful runs are recorded by SMFocusDone, anything else reaching the final state was aborted
+    if (!mRunTimer.isValid()) return;
+    appendHistory(focusRecord("aborted"));
+    mRunTimer.invalidate();
+}
+
 void Focus::startCoarse()
 {
+    stopMonitorAnalysis();
     getProperty("values")->clearGrid();
     getProperty("parms")->disable();
     getProperty("devices")->disable();
@@ -213,35 +257,25 @@ void Focus::startCoarse()
     }
     enableDirectBlobAccess(getString("devices", "camera").toStdString().c_str(), nullptr);
 
-    _posvector.clear();
-    _hfdvector.clear();
-    _coefficients.clear();
-
-    _zonePosvector.clear();
-    _zoneHfdvector.clear();
-    _zoneCoefficients.clear();
-
-
     _iteration = 0;
-    _besthfr = 99;
-    _bestposfit = 0;
-    _zoneBestposfit.clear();
+    mMoves.clear();
+    mRunStart = QDateTime::currentDateTimeUtc();
+    mRunTimer.start();
+    mScanMs = 0;
+    mExposureMs = 0;
+    mAnalysisMs = 0;
+    mTiltSolved = false;
 
     mZoning =  getInt("parameters", "zoning");
     getProperty("zones")->clearGrid();
 
-
-    for (int i = 0; i < mZoning * mZoning; i++)
-    {
-        _zoneBestposfit.append(0);
-    }
-
     _steps =             getEltInt("parameters", "steps")->value();
     _iterations =        getEltInt("parameters", "iterations")->value();
+    double p = 0;
+    bool positionKnown = getModNumber(getString("devices", "focuser"), "ABS_FOCUS_POSITION", "FOCUS_ABSOLUTE_POSITION", p);
     if (getBool("parameters", "aroundinitial"))
     {
-        double p = 0;
-        if (!getModNumber(getString("devices", "focuser"), "ABS_FOCUS_POSITION", "FOCUS_ABSOLUTE_POSITION", p))
+        if (!positionKnown)
         {
             pMachine->submitEvent("abort");
             return;
@@ -254,6 +288,13 @@ void Focus::startCoarse()
     }
     _loopIterations =    getEltInt("parameters", "loopIterations")->value();
     _backlash =          getEltInt("parameters", "backlash")->value();
+    mStackFrames = getBool("parameters", "stackframes") && _loopIterations > 1;
+
+    mPlanner.setBacklash(_backlash);
+    if (positionKnown) mPlanner.setPosition(p);
+    else mPlanner.reset();
+
+    mCurve.reset(mZoning, _startpos, _steps);
 
     //pMachine = QScxmlStateMachine::fromFile(":focus.scxml");
 
@@ -279,8 +320,15 @@ void Focus::SMRequestFrameReset()
 void Focus::SMRequestBacklash()
 {
     //sendMessage("SMRequestBacklash");
-    if (!sendModNewNumber(getString("devices", "focuser"), "ABS_FOCUS_POSITION", "FOCUS_ABSOLUTE_POSITION",
-                          _startpos - _backlash))
+    QList<double> moves = mPlanner.plan(_startpos);
+    if (moves.size() < 2)
+    {
+        // already below start position : straight approach, no overshoot round trip
+        pMachine->submitEvent("BacklashDone");
+        return;
+    }
+    // overshoot and approach in one sequence, RequestGotoStart then finds the focuser there
+    if (!sendMoves(moves))
     {
         pMachine->submitEvent("abort");
         return;
@@ -292,11 +340,17 @@ void Focus::SMRequestBacklash()
 void Focus::SMRequestGotoStart()
 {
     //sendMessage("SMRequestGotoStart");
+    if (mPlanner.isAt(_startpos))
+    {
+        pMachine->submitEvent("GotoStartDone");
+        return;
+    }
     if (!sendModNewNumber(getString("devices", "focuser"), "ABS_FOCUS_POSITION", "FOCUS_ABSOLUTE_POSITION", _startpos))
     {
         pMachine->submitEvent("abort");
         return;
     }
+    mPlanner.moved(_startpos);
     pMachine->submitEvent("RequestGotoStartDone");
 
 }
@@ -309,6 +363,7 @@ void Focus::SMRequestExposure()
         emit abort();
         return;
     }
+    mStepTimer.start();
     pMachine->submitEvent("RequestExposureDone");
 
 }
@@ -317,6 +372,30 @@ void Focus::SMFindStars()
 {
     //sendMessage("SMFindStars");
     stats = _image->getStats();
+    mStepTimer.start();
+    if (mStackFrames && !pMachine->isActive("FindStarsFinal"))
+    {
+        if (!mStacker.add(stats, _image->getImageBuffer()))
+        {
+            sendWarning("Frame can't be stacked, measuring each frame");
+            mStackFrames = false;
+        }
+        else if (mStacker.count() < _loopIterations)
+        {
+            // measured once the stack is complete
+            mAnalysisMs += mStepTimer.elapsed();
+            pMachine->submitEvent("FindStarsDone");
+            return;
+        }
+        else
+        {
+            stats = mStacker.stats();
+            _solver.ResetSolver(stats, mStacker.buffer(), getInt("parameters", "zoning"));
+            connect(&_solver, &Solver::successSEP, this, &Focus::OnSucessSEP);
+            _solver.FindStars(_solver.stellarSolverProfiles[0]);
+            return;
+        }
+    }
     _solver.ResetSolver(stats, _image->getImageBuffer(), getInt("parameters", "zoning"));
     connect(&_solver, &Solver::successSEP, this, &Focus::OnSucessSEP);
     _solver.FindStars(_solver.stellarSolverProfiles[0]);
@@ -325,6 +404,7 @@ void Focus::SMFindStars()
 void Focus::OnSucessSEP()
 {
     disconnect(&_solver, &Solver::successSEP, this, &Focus::OnSucessSEP);
+    mAnalysisMs += mStepTimer.elapsed();
     OST::ImgData dta = getEltImg("image", "image")->value();
     double ech = getSampling();
     dta.HFRavg = _solver.HFRavg * ech;
@@ -337,44 +417,11 @@ void Focus::SMCompute()
 {
     //sendMessage("SMCompute");
 
-    _posvector.push_back(_startpos + _iteration * _steps);
-    _hfdvector.push_back(_loopHFRavg);
+    mCurve.closePosition(_startpos + _iteration * _steps);
 
-    for (int i = 0; i < mZoning * mZoning; i++)
-    {
-        if (_zoneloopHFRavg[i] != 99)
-        {
-            _zonePosvector[i].push_back(_startpos + _iteration * _steps);
-            _zoneHfdvector[i].push_back(_zoneloopHFRavg[i]);
-        }
-    }
-
-    if (_posvector.size() > 2)
-    {
-        double coeff[3];
-        polynomialfit(_posvector.size(), 3, _posvector.data(), _hfdvector.data(), coeff);
-        _bestposfit = -coeff[1] / (2 * coeff[2]);
-    }
-
-    for (int i = 0; i < mZoning * mZoning; i++)
-    {
-        if (_zoneHfdvector[i].size() > 2)
-        {
-            double coeff[3];
-            polynomialfit(_posvector.size(), 3, _posvector.data(), _zoneHfdvector[i].data(), coeff);
-            _zoneBestposfit[i] = -coeff[1] / (2 * coeff[2]);
-        }
-    }
-
-    if ( _loopHFRavg < _besthfr )
-    {
-        _besthfr = _loopHFRavg;
-        _bestpos = _startpos + _iteration * _steps;
-    }
-
-    getEltFloat("values", "loopHFRavg")->setValue(_loopHFRavg);
-    getEltInt("values", "bestpos")->setValue(_bestpos);
-    getEltFloat("values", "bestposfit")->setValue(_bestposfit);
+    getEltFloat("values", "loopHFRavg")->setValue(mCurve.positionHfr());
+    getEltInt("values", "bestpos")->setValue(mCurve.bestPos());
+    getEltFloat("values", "bestposfit")->setValue(mCurve.bestPosFit());
     getEltInt("values", "focpos")->setValue(_startpos + _iteration * _steps);
     getEltInt("values", "iteration")->setValue(_iteration, true);
 
@@ -389,6 +436,7 @@ void Focus::SMCompute()
     }
     else
     {
+        mScanMs = mRunTimer.elapsed();
         pMachine->submitEvent("LoopFinished");
     }
 }
@@ -402,14 +450,23 @@ void Focus::SMRequestGotoNext()
         pMachine->submitEvent("abort");
         return;
     }
+    mPlanner.moved(_startpos + _iteration * _steps);
     pMachine->submitEvent("RequestGotoNextDone");
 }
 
 void Focus::SMRequestBacklashBest()
 {
     //sendMessage("SMRequestBacklashBest");
-    if (!sendModNewNumber(getString("devices", "focuser"), "ABS_FOCUS_POSITION", "FOCUS_ABSOLUTE_POSITION",
-                          _bestpos - _backlash))
+    // final target is planned once : overshoot (if any) is relative to it, not to the best measured point
+    mBestTarget = mCurve.hasFit() ? mCurve.bestPosFit() : mCurve.bestPos();
+    QList<double> moves = mPlanner.plan(mBestTarget);
+    if (moves.size() < 2)
+    {
+        pMachine->submitEvent("BacklashBestDone");
+        return;
+    }
+    // the scan ends above best : overshoot and final approach go out as one sequence
+    if (!sendMoves(moves))
     {
         pMachine->submitEvent("abort");
         return;
@@ -420,15 +477,34 @@ void Focus::SMRequestBacklashBest()
 void Focus::SMRequestGotoBest()
 {
     //sendMessage("SMRequestGotoBest");
-    if (_bestposfit == 99 ) _bestposfit = _bestpos;
-    if (!sendModNewNumber(getString("devices", "focuser"), "ABS_FOCUS_POSITION", "FOCUS_ABSOLUTE_POSITION", _bestposfit))
+    if (mPlanner.isAt(mBestTarget))
+    {
+        pMachine->submitEvent("GotoBestDone");
+        return;
+    }
+    if (!sendModNewNumber(getString("devices", "focuser"), "ABS_FOCUS_POSITION", "FOCUS_ABSOLUTE_POSITION", mBestTarget))
     {
         pMachine->submitEvent("abort");
         return;
     }
+    mPlanner.moved(mBestTarget);
     pMachine->submitEvent("RequestGotoBestDone");
 }
 
+bool Focus::sendMoves(const QList<double> &moves)
+{
+    mMoves = moves;
+    if (mMoves.isEmpty()) return true;
+    double position = mMoves.takeFirst();
+    if (!sendModNewNumber(getString("devices", "focuser"), "ABS_FOCUS_POSITION", "FOCUS_ABSOLUTE_POSITION", position))
+    {
+        mMoves.clear();
+        return false;
+    }
+    mPlanner.moved(position);
+    return true;
+}
+
 void Focus::SMRequestExposureBest()
 {
     //sendMessage("SMRequestExposureBest");
@@ -445,6 +521,7 @@ void Focus::SMRequestExposureBest()
         return;
     }
     getEltFloat("results", "pos")->setValue(mFinalPos, true);
+    mStepTimer.start();
     pMachine->submitEvent("RequestExposureBestDone");
 }
 
@@ -465,13 +542,52 @@ void Focus::SMComputeResult()
     getEltPrg("progress", "global")->setPrgValue(100, true);
     getEltPrg("progress", "global")->setDynLabel("Finished", true);
 
-    getProperty("zones")->clearGrid();
+    computeTilt();
+
+    getProperty("parms")->enable();
+    getProperty("devices")->enable();
+    getProperty("parameters")->enable();
+
+
+}
+
+
+
+
+void Focus::computeTilt()
+{
+    double stepSize = getFloat("tiltsetup", "stepsize");
+    std::vector<double> zoneFocus;
+    for (int i = 0; i < mZoning * mZoning; i++)
+    {
+        zoneFocus.push_back(mCurve.zoneHasFit(i) ? mCurve.zoneBestPosFit(i) * stepSize : std::nan(""));
+    }
+
+    double pix = 0;
+    bool solved = false;
+    if (!getModNumber(getString("devices", "camera"), "CCD_INFO", "CCD_PIXEL_SIZE", pix) || pix <= 0)
+    {
+        if (mZoning > 1) sendWarning("Can't find camera pixel size, tilt not computed");
+    }
+    else
+    {
+        // binned frames : one image pixel covers bin sensor pixels
+        double binX = 1, binY = 1;
+        getModNumber(getString("devices", "camera"), "CCD_BINNING", "HOR_BIN", binX);
+        getModNumber(getString("devices", "camera"), "CCD_BINNING", "VER_BIN", binY);
+        binX = std::max(1.0, binX);
+        binY = std::max(1.0, binY);
+        solved = mTilt.solve(mZoning, zoneFocus, stats.width * pix * binX / 1000, stats.height * pix * binY / 1000);
+    }
+    mTiltSolved = solved;
 
+    getProperty("zones")->clearGrid();
     for (int i = 0; i < mZoning * mZoning; i++)
     {
         if ((mZoning != 2) && (mZoning != 3))
         {
-            getEltString("zones", "zone")->setValue(QString::number(i + 1), false);
+            getEltString("zones", "zone")->setValue("Row " + QString::number(i / mZoning + 1) + " col " + QString::number(
+                    i % mZoning + 1), false);
         }
         if (mZoning == 2)
         {
@@ -493,36 +609,45 @@ void Focus::SMComputeResult()
             if (i == 8) getEltString("zones", "zone")->setValue("Lower right", false);
         }
 
-
-        getEltFloat("zones", "bestpos")->setValue(_zoneBestposfit[i], false);
+        getEltFloat("zones", "bestpos")->setValue(mCurve.zoneHasFit(i) ? mCurve.zoneBestPosFit(i) : 99, false);
+        getEltFloat("zones", "shift")->setValue(solved && mCurve.zoneHasFit(i) ? zoneFocus[i] - mTilt.center() : 99, false);
         getProperty("zones")->push();
     }
 
-    getProperty("parms")->enable();
-    getProperty("devices")->enable();
-    getProperty("parameters")->enable();
-
+    getProperty("screws")->clearGrid();
+    if (!solved)
+    {
+        if (mZoning > 1 && pix > 0) sendWarning("Not enough zones with a valid curve to compute tilt");
+        return;
+    }
 
+    getEltFloat("tilt", "tiltx")->setValue(mTilt.tiltX(), false);
+    getEltFloat("tilt", "tilty")->setValue(mTilt.tiltY(), false);
+    getEltFloat("tilt", "angle")->setValue(mTilt.tiltAngle(), false);
+    getEltFloat("tilt", "curvature")->setValue(mTilt.hasCurvature() ? mTilt.curvature() : 99, false);
+    getEltFloat("tilt", "rms")->setValue(mTilt.rms(), true);
+
+    int screws = getInt("tiltsetup", "screws");
+    double angle = getFloat("tiltsetup", "screwangle");
+    std::vector<double> turns = mTilt.screwTurns(screws, getFloat("tiltsetup", "screwradius"),
+                                angle, getFloat("tiltsetup", "screwpitch"));
+    for (size_t i = 0; i < turns.size(); i++)
+    {
+        getEltString("screws", "screw")->setValue(QString::number(i + 1), false);
+        getEltFloat("screws", "angle")->setValue(std::fmod(angle + 360.0 * i / screws, 360), false);
+        getEltFloat("screws", "turns")->setValue(turns[i], false);
+        getProperty("screws")->push();
+    }
+    sendMessage(QString("Tilt %1 µm over %2 zones, curvature %3 µm").arg(mTilt.tilt(), 0, 'f', 1).arg(mTilt.zones())
+                .arg(mTilt.hasCurvature() ? mTilt.curvature() : 0, 0, 'f', 1));
 }
 
-
-
-
 void Focus::SMInitLoopFrame()
 {
     //sendMessage("SMInitLoopFrame");
-    _loopIteration = 0;
-    _loopHFRavg = 99;
-    _zoneloopHFRavg.clear();
-    _zoneLoopIteration.clear();
-    for (int i = 0; i < mZoning * mZoning; i++)
-    {
-        _zoneloopHFRavg.append(99);
-        _zoneLoopIteration.append(0);
-        _zonePosvector.append(std::vector<double>());
-        _zoneHfdvector.append(std::vector<double>());
-    }
-    getEltFloat("values", "loopHFRavg")->setValue(_loopHFRavg, true);
+    mCurve.startPosition();
+    mStacker.reset();
+    getEltFloat("values", "loopHFRavg")->setValue(mCurve.positionHfr(), true);
 
     pMachine->submitEvent("InitLoopFrameDone");
 
@@ -531,26 +656,16 @@ void Focus::SMInitLoopFrame()
 void Focus::SMComputeLoopFrame()
 {
     //sendMessage("SMComputeLoopFrame");
-    double ech = getSampling();
-    _loopIteration++;
-    _loopHFRavg = ((_loopIteration - 1) * _loopHFRavg + _solver.HFRavg * ech) / _loopIteration;
-    for (int i = 0; i < mZoning * mZoning; i++)
+    if (mStackFrames && mStacker.count() < _loopIterations)
     {
-        if (_solver.HFRavgZone[i] != 99)
-        {
-            _zoneloopHFRavg[i] = (_zoneLoopIteration[i] * _zoneloopHFRavg[i] + _solver.HFRavgZone[i] * ech) /
-                                 (_zoneLoopIteration[i] + 1);
-            _zoneLoopIteration[i]++;
-
-        }
+        pMachine->submitEvent("NextFrame");
+        return;
     }
-    getEltFloat("values", "loopHFRavg")->setValue(_loopHFRavg, true);
+    mCurve.addFrame(_solver.HFRavg, _solver.HFRavgZone, getSampling());
+    getEltFloat("values", "loopHFRavg")->setValue(mCurve.positionHfr(), true);
     getEltFloat("values", "imgHFR")->setValue(_solver.HFRavg, true);
 
-    //qDebug() << "Loop    " << _loopIteration << "/" << _loopIterations << " = " <<  _solver.HFRavg;
-
-
-    if (_loopIteration < _loopIterations )
+    if (!mStackFrames && mCurve.frames() < _loopIterations )
     {
         pMachine->submitEvent("NextFrame");
     }
@@ -563,6 +678,7 @@ void Focus::SMComputeLoopFrame()
 void Focus::SMAlert()
 {
     sendMessage("SMAlert");
+    mMoves.clear();
     pMachine->submitEvent("abort");
 }
 
@@ -582,6 +698,10 @@ void Focus::SMFocusDone()
     QVariantMap hfrMap;
     QVariantMap posMap;
 
+    // new reference for drift monitoring
+    mDriftMonitor.setReference(currentFilter(), _solver.HFRavg * ech, currentTemperature());
+    mDriftAdvised = false;
+
     hfrMap["value"] = _solver.HFRavg * ech;
     posMap["value"] = getFloat("results", "pos");
     elementsMap["hfr"] = hfrMap;
@@ -589,8 +709,266 @@ void Focus::SMFocusDone()
     resultsMap["elements"] = elementsMap;
     eventData["results"] = resultsMap;
 
+    QVariantMap record = focusRecord("ok");
+    eventData["record"] = record;
+    appendHistory(record);
+    mRunTimer.invalidate();
+
     emit moduleEvent("focusdone", getModuleName(), "results", eventData);
 
     // Stop state machine AFTER emitting the event
     pMachine->stop();
 }
+
+QVariantMap Focus::focusRecord(const QString &status)
+{
+    QVariantMap record;
+    record["module"] = getModuleName();
+    record["status"] = status;
+    record["start"] = mRunStart.toString(Qt::ISODate);
+    record["filter"] = currentFilter();
+    double temperature = currentTemperature();
+    if (!std::isnan(temperature)) record["temperature"] = temperature;
+
+    QVariantMap parameters;
+    parameters["startpos"] = _startpos;
+    parameters["steps"] = _steps;
+    parameters["iterations"] = _iterations;
+    parameters["loopIterations"] = _loopIterations;
+    parameters["stacked"] = mStackFrames;
+    parameters["backlash"] = _backlash;
+    parameters["exposure"] = getFloat("parms", "exposure");
+    parameters["zoning"] = mZoning;
+    record["parameters"] = parameters;
+
+    QVariantList positions;
+    QVariantList hfrs;
+    for (size_t i = 0; i < mCurve.positions().size(); i++)
+    {
+        positions.append(mCurve.positions()[i]);
+        hfrs.append(mCurve.hfrs()[i]);
+    }
+    QVariantMap curve;
+    curve["positions"] = positions;
+    curve["hfrs"] = hfrs;
+    curve["bestpos"] = mCurve.bestPos();
+    curve["besthfr"] = mCurve.bestHfr();
+    record["curve"] = curve;
+
+    // hfr = a0 + a1*t + a2*t², t = (pos - origin) / scale : raw powers of pos would be badly scaled
+    double coeffs[PolynomialFit::MaxDegree + 1];
+    if (mCurve.hasFit() && mCurve.fit().solveCentered(coeffs))
+    {
+        QVariantMap fit;
+        fit["a0"] = coeffs[0];
+        fit["a1"] = coeffs[1];
+        fit["a2"] = coeffs[2];
+        fit["origin"] = mCurve.fit().origin();
+        fit["scale"] = mCurve.fit().scale();
+        fit["chisq"] = mCurve.fit().chisq();
+        fit["bestpos"] = mCurve.bestPosFit();
+        fit["besthfr"] = mCurve.fit().evaluate(mCurve.bestPosFit());
+        record["fit"] = fit;
+    }
+    record["confidence"] = mCurve.confidence();
+
+    if (status == "ok")
+    {
+        record["hfr"] = getFloat("results", "hfr");
+        record["pos"] = getFloat("results", "pos");
+    }
+
+    QVariantList zones;
+    for (int i = 0; i < mCurve.zoneCount(); i++)
+    {
+        QVariantMap zone;
+        zone["zone"] = i + 1;
+        if (mCurve.zoneHasFit(i)) zone["bestpos"] = mCurve.zoneBestPosFit(i);
+        zones.append(zone);
+    }
+    record["zones"] = zones;
+    if (status == "ok" && mTiltSolved)
+    {
+        QVariantMap tilt;
+        tilt["tiltx"] = mTilt.tiltX();
+        tilt["tilty"] = mTilt.tiltY();
+        tilt["angle"] = mTilt.tiltAngle();
+        if (mTilt.hasCurvature()) tilt["curvature"] = mTilt.curvature();
+        tilt["rms"] = mTilt.rms();
+        record["tilt"] = tilt;
+    }
+
+    // ms, "final" is backlash + goto best + last exposure, "other" mostly focuser moves
+    qint64 total = mRunTimer.isValid() ? mRunTimer.elapsed() : 0;
+    QVariantMap timings;
+    timings["total"] = total;
+    timings["scan"] = mScanMs;
+    timings["final"] = mScanMs > 0 ? total - mScanMs : 0;
+    timings["exposure"] = mExposureMs;
+    timings["analysis"] = mAnalysisMs;
+    timings["other"] = total - mExposureMs - mAnalysisMs;
+    record["timings"] = timings;
+
+    return record;
+}
+
+void Focus::appendHistory(const QVariantMap &record)
+{
+    if (!getBool("parameters", "history")) return;
+
+    QDir dir;
+    dir.mkdir(getWebroot() + "/" + getModuleName());
+    QFile file(getWebroot() + "/" + getModuleName() + "/history.jsonl");
+    if (!file.open(QIODevice::Append | QIODevice::Text))
+    {
+        sendWarning("Can't write focus history " + file.fileName());
+        return;
+    }
+    file.write(QJsonDocument::fromVariant(record).toJson(QJsonDocument::Compact) + "\n");
+}
+
+void Focus::startMonitor()
+{
+    if (!isServerConnected()) connectIndi();
+    connectDevice(getString("devices", "camera"));
+    connectDevice(getString("devices", "focuser"));
+    connectDevice(getString("devices", "filter"));
+    setBLOBMode(B_ALSO, getString("devices", "camera").toStdString().c_str(), nullptr);
+    enableDirectBlobAccess(getString("devices", "camera").toStdString().c_str(), nullptr);
+    mDriftAdvised = false;
+    sendMessage("Drift monitor enabled - watching frames from " + getString("devices", "camera"));
+}
+
+void Focus::monitorFrame()
+{
+    // one refocus at a time : wait for focusdone, a reject, or a few windows before advising again
+    if (mDriftAdvised)
+    {
+        if (++mAdvisedFrames < 3 * getInt("monitor", "window")) return;
+        mDriftAdvised = false;
+    }
+
+    // darks, flats and bias shot by the sequencer say nothing about focus
+    if (!isLightFrame()) return;
+
+    // SEP reads the frame from its own thread : keep it until done, drop newer frames meanwhile
+    if (mMonitorBusy)
+    {
+        if (mMonitorTimer.elapsed() < 120000) return;
+        sendWarning("Drift monitor : star extraction lost, restarting");
+        stopMonitorAnalysis();
+    }
+
+    mMonitorImage = _image;
+    mMonitorBusy = true;
+    mMonitorTimer.start();
+    stats = mMonitorImage->getStats();
+    _solver.ResetSolver(stats, mMonitorImage->getImageBuffer());
+    connect(&_solver, &Solver::successSEP, this, &Focus::OnMonitorSEP, Qt::UniqueConnection);
+    _solver.FindStars(_solver.stellarSolverProfiles[0]);
+}
+
+void Focus::stopMonitorAnalysis()
+{
+    disconnect(&_solver, &Solver::successSEP, this, &Focus::OnMonitorSEP);
+    if (mMonitorBusy) _solver.stellarSolver.abortAndWait();
+    mMonitorBusy = false;
+    if (mMonitorImage != _image) delete mMonitorImage;
+    mMonitorImage = nullptr;
+}
+
+void Focus::OnMonitorSEP()
+{
+    disconnect(&_solver, &Solver::successSEP, this, &Focus::OnMonitorSEP);
+    mMonitorBusy = false;
+    if (mMonitorImage != _image) delete mMonitorImage;
+    mMonitorImage = nullptr;
+    if (pMachine->isRunning()) return;
+
+    // 99 is SEP's "no star" value : checked before scaling to arcsec
+    double hfr = (_solver.stars.size() == 0 || _solver.HFRavg <= 0 || _solver.HFRavg == 99) ? 0 :
+                 _solver.HFRavg * getSampling();
+    QString filter = currentFilter();
+    double temperature = currentTemperature();
+
+    mDriftMonitor.setWindow(getInt("monitor", "window"));
+    mDriftMonitor.setThresholds(getFloat("monitor", "hfrdrift") / 100, getFloat("monitor", "tempdrift"));
+    DriftMonitor::Verdict verdict = mDriftMonitor.addFrame(filter, hfr, temperature);
+
+    getEltString("drift", "filter")->setValue(filter, false);
+    getEltFloat("drift", "reference")->setValue(mDriftMonitor.reference(filter), false);
+    getEltFloat("drift", "trend")->setValue(mDriftMonitor.trend(filter), false);
+    if (!std::isnan(temperature)) getEltFloat("drift", "temperature")->setValue(temperature, false);
+    getEltFloat("drift", "imgHFR")->setValue(hfr, true);
+
+    if (verdict == DriftMonitor::None) return;
+
+    double trend = mDriftMonitor.trend(filter);
+    QString reason;
+    if (verdict == DriftMonitor::HfrDrift)
+    {
+        reason = "HFR drift on filter " + filter + " (" + QString::number(trend, 'f', 2)
+                 + "'' vs " + QString::number(mDriftMonitor.reference(filter), 'f', 2) + "'')";
+    }
+    else
+    {
+        reason = "Temperature drift (" + QString::number(temperature, 'f', 1) + "°C)";
+    }
+    mDriftAdvised = true;
+    mAdvisedFrames = 0;
+    mDriftMonitor.clearWindow(filter);
+
+    QString sequencer = getString("monitor", "sequencermodule");
+    if (!sequencer.isEmpty())
+    {
+        // let the sequencer choose when to refocus (between two frames)
+        sendMessage(reason + " - advising " + sequencer);
+        QVariantMap eventData;
+        eventData["reason"] = reason;
+        eventData["filter"] = filter;
+        eventData["hfr"] = trend;
+        eventData["reference"] = mDriftMonitor.reference(filter);
+        eventData["focusmodule"] = getModuleName();
+        emit moduleEvent("focusadvised", sequencer, "", eventData);
+    }
+    else
+    {
+        sendMessage(reason + " - starting autofocus");
+        getProperty("actions")->setState(OST::Busy);
+        startCoarse();
+    }
+}
+
+bool Focus::isLightFrame()
+{
+    INDI::BaseDevice dp = getDevice(getString("devices", "camera").toStdString().c_str());
+    if (!dp.isValid()) return true;
+    INDI::PropertySwitch type = dp.getSwitch("CCD_FRAME_TYPE");
+    if (!type.isValid()) return true;
+    auto on = type.findOnSwitch();
+    return !on || QString(on->getName()) == "FRAME_LIGHT";
+}
+
+QString Focus::currentFilter()
+{
+    INDI::BaseDevice dp = getDevice(getString("devices", "filter").toStdString().c_str());
+    if (!dp.isValid()) return "";
+    INDI::PropertyNumber slot = dp.getNumber("FILTER_SLOT");
+    if (!slot.isValid()) return "";
+    int i = slot[0].getValue();
+    INDI::PropertyText names = dp.getText("FILTER_NAME");
+    if (names.isValid() && i >= 1 && i <= static_cast<int>(names.count()))
+    {
+        return names[i - 1].getText();
+    }
+    return QString::number(i);
+}
+
+double Focus::currentTemperature()
+{
+    INDI::BaseDevice dp = getDevice(getString("devices", "focuser").toStdString().c_str());
+    if (!dp.isValid()) return std::nan("");
+    INDI::PropertyNumber t = dp.getNumber("FOCUS_TEMPERATURE");
+    if (!t.isValid()) return std::nan("");
+    return t[0].getValue();
+}
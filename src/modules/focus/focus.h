@@ -4,6 +4,13 @@
 #include <fileio.h>
 #include <solver.h>
 #include <QScxmlStateMachine>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include "focuscurve.h"
+#include "driftmonitor.h"
+#include "moveplanner.h"
+#include "framestacker.h"
+#include "tiltsolver.h"
 
 #if defined(FOCUS_MODULE)
 #  define MODULE_INIT Q_DECL_EXPORT
@@ -29,6 +36,7 @@ class MODULE_INIT Focus : public IndiModule
         void OnMyExternalEvent(const QString &eventType, const QString  &eventModule, const QString  &eventKey,
                                const QVariantMap &eventData) override;
         void OnSucessSEP();
+        void OnMonitorSEP();
 
     private:
         void updateProperty(INDI::Property p) override;
@@ -55,8 +63,21 @@ class MODULE_INIT Focus : public IndiModule
         //void SMLoadblob(IBLOB *bp);
         void SMLoadblob();
         void SMAbort();
+        void SMRunEnded();
         void startCoarse();
 
+        void computeTilt();
+        QVariantMap focusRecord(const QString &status);
+        void appendHistory(const QVariantMap &record);
+
+        void startMonitor();
+        void monitorFrame();
+        void stopMonitorAnalysis();
+        bool isLightFrame();
+        bool sendMoves(const QList<double> &moves);
+        QString currentFilter();
+        double currentTemperature();
+
 
         bool    _newblob;
 
@@ -65,27 +86,35 @@ class MODULE_INIT Focus : public IndiModule
         int    _iterations = 3;
         int    _steps = 3000;
         int    _loopIterations = 2;
-        int    _loopIteration;
-        QList<int> _zoneLoopIteration;
-        double _loopHFRavg;
         int mZoning = 2;
-        QList<double> _zoneloopHFRavg;
 
         int    _iteration;
-        double _bestpos;
-        double _bestposfit;
-        QList<double> _zoneBestposfit;
-        double _besthfr;
         double  _focuserPosition;
         QScxmlStateMachine *pMachine;
 
-        std::vector<double> _posvector;
-        std::vector<double> _hfdvector;
-        std::vector<double> _coefficients;
-
-        QList<std::vector<double>> _zonePosvector;
-        QList<std::vector<double>> _zoneHfdvector;
-        QList<std::vector<double>> _zoneCoefficients;
+        FocusCurve mCurve;
+        MovePlanner mPlanner;
+        QList<double> mMoves;       ///< rest of the planned sequence being sent
+        double mBestTarget = 0;
+        TiltSolver mTilt;
+        bool mTiltSolved = false;
+        FrameStacker mStacker;
+        bool mStackFrames = false;
+
+        QDateTime mRunStart;
+        QElapsedTimer mRunTimer;
+        QElapsedTimer mStepTimer;
+        qint64 mScanMs = 0;
+        qint64 mExposureMs = 0;
+        qint64 mAnalysisMs = 0;
+
+        DriftMonitor mDriftMonitor;
+        bool mDriftAdvised = false;
+        int mAdvisedFrames = 0;
+        /// Frame SEP is measuring for the monitor, kept alive until OnMonitorSEP
+        QPointer<fileio> mMonitorImage;
+        bool mMonitorBusy = false;
+        QElapsedTimer mMonitorTimer;
 
         QPointer<fileio> _image;
         Solver _solver;
@@ -0,0 +1,137 @@
+#include "focuscurve.h"
+
+#include <algorithm>
+
+void FocusCurve::reset(int zoning, double startpos, double steps)
+{
+    mZoning = zoning < 1 ? 1 : zoning;
+
+    mPositions.clear();
+    mHfrs.clear();
+    mZonePositions.clear();
+    mZoneHfrs.clear();
+    mZoneFits.clear();
+    mZoneBestPosFit.clear();
+    mZoneHasFit.clear();
+
+    // fits are normalized around the scanned range to keep normal equations well conditioned
+    mFit.reset(2, startpos, steps);
+    for (int i = 0; i < zoneCount(); i++)
+    {
+        mZonePositions.push_back(std::vector<double>());
+        mZoneHfrs.push_back(std::vector<double>());
+        mZoneFits.push_back(PolynomialFit(2, startpos, steps));
+        mZoneBestPosFit.push_back(0);
+        mZoneHasFit.push_back(false);
+    }
+
+    mBestPos = startpos;
+    mBestHfr = 99;
+    mHasFit = false;
+    mBestPosFit = 0;
+    startPosition();
+}
+
+void FocusCurve::startPosition()
+{
+    mFrames = 0;
+    mValidFrames = 0;
+    mPositionHfr = 99;
+    mZoneFrames.clear();
+    mZonePositionHfr.clear();
+    for (int i = 0; i < zoneCount(); i++)
+    {
+        mZoneFrames.append(0);
+        mZonePositionHfr.append(99);
+    }
+}
+
+void FocusCurve::addFrame(double hfr, const QList<float> &zoneHfr, double sampling)
+{
+    mFrames++;
+    if (hfr > 0 && hfr != 99)
+    {
+        mValidFrames++;
+        mPositionHfr = ((mValidFrames - 1) * mPositionHfr + hfr * sampling) / mValidFrames;
+    }
+    for (int i = 0; i < zoneCount() && i < zoneHfr.size(); i++)
+    {
+        if (zoneHfr[i] != 99)
+        {
+            mZonePositionHfr[i] = (mZoneFrames[i] * mZonePositionHfr[i] + zoneHfr[i] * sampling) / (mZoneFrames[i] + 1);
+            mZoneFrames[i]++;
+        }
+    }
+}
+
+void FocusCurve::closePosition(double pos)
+{
+    mPositions.push_back(pos);
+    mHfrs.push_back(mPositionHfr);
+    if (mPositionHfr != 99)
+    {
+        mFit.addPoint(pos, mPositionHfr);
+        mFitMin = mFit.count() == 1 ? pos : std::min(mFitMin, pos);
+        mFitMax = mFit.count() == 1 ? pos : std::max(mFitMax, pos);
+    }
+
+    // incremental fits : only the new point was accumulated, solving is a 3x3 system
+    double vertex;
+    mHasFit = minimum(mFit, mFitMin, mFitMax, vertex);
+    if (mHasFit) mBestPosFit = vertex;
+
+    // same rules per zone, a zone without a valid minimum does not keep an older one
+    for (int i = 0; i < zoneCount(); i++)
+    {
+        if (mZonePositionHfr[i] != 99)
+        {
+            mZonePositions[i].push_back(pos);
+            mZoneHfrs[i].push_back(mZonePositionHfr[i]);
+            mZoneFits[i].addPoint(pos, mZonePositionHfr[i]);
+        }
+
+        double zoneVertex;
+        mZoneHasFit[i] = !mZonePositions[i].empty()
+                         && minimum(mZoneFits[i], *std::min_element(mZonePositions[i].begin(), mZonePositions[i].end()),
+                                    *std::max_element(mZonePositions[i].begin(), mZonePositions[i].end()), zoneVertex);
+        mZoneBestPosFit[i] = mZoneHasFit[i] ? zoneVertex : 0;
+    }
+
+    if (mPositionHfr < mBestHfr)
+    {
+        mBestHfr = mPositionHfr;
+        mBestPos = pos;
+    }
+}
+
+bool FocusCurve::minimum(const PolynomialFit &fit, double lo, double hi, double &vertex)
+{
+    // a maximum, or a minimum outside the scanned range, is not a focus position : bestPos is used instead
+    // the curvature sign is read in the fit's centred frame, well scaled whatever the focuser positions
+    double coeffs[PolynomialFit::MaxDegree + 1];
+    return fit.count() > 2 && fit.solveCentered(coeffs) && coeffs[2] > 0 && fit.vertex(vertex)
+           && vertex >= lo && vertex <= hi;
+}
+
+double FocusCurve::confidence() const
+{
+    if (!mHasFit || mPositions.size() < 3) return 0;
+
+    double mean = 0;
+    int n = 0;
+    for (double h : mHfrs)
+    {
+        if (h == 99) continue;
+        mean += h;
+        n++;
+    }
+    if (n == 0) return 0;
+    mean /= n;
+    double total = 0;
+    for (double h : mHfrs)
+    {
+        if (h != 99) total += (h - mean) * (h - mean);
+    }
+    double r2 = total > 0 ? 1 - mFit.chisq() / total : 0;
+    return r2 < 0 ? 0 : (r2 > 1 ? 1 : r2);
+}
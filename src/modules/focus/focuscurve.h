@@ -0,0 +1,137 @@
+/**
+ * @file focuscurve.h
+ * @brief Focus V-curve bookkeeping, independent from INDI and state machine
+ *
+ * Holds what the Focus state machine computes between frames : average HFR
+ * over the frames of one focuser position (global and per zone), measured
+ * points of the curve, incremental quadratic fits and best positions.
+ * Focus drives it from SMInitLoopFrame / SMComputeLoopFrame / SMCompute,
+ * the focus benchmark drives it with synthetic frames.
+ *
+ * HFR values are stored in arcsec (pixel HFR * sampling), 99 means "no value".
+ * Fits are updated incrementally, refreshing a zone is a 3x3 solve : even
+ * fine zonings (up to 9x9) take microseconds between two exposures.
+ */
+
+#pragma once
+
+#include <QList>
+#include <vector>
+#include "common/polynomialfit.h"
+
+class FocusCurve
+{
+    public:
+        /// Start a new curve : zoning x zoning zones, positions start + i * steps
+        void reset(int zoning, double startpos, double steps);
+
+        /// Start averaging frames of a new focuser position
+        void startPosition();
+        /// Add one analyzed frame at current position, HFR in pixels, 99 (no star) frames are not averaged
+        void addFrame(double hfr, const QList<float> &zoneHfr, double sampling);
+        /// Store the averaged point for position pos and refit
+        void closePosition(double pos);
+
+        int zoning() const
+        {
+            return mZoning;
+        }
+        int zoneCount() const
+        {
+            return mZoning * mZoning;
+        }
+        int frames() const
+        {
+            return mFrames;
+        }
+        double positionHfr() const
+        {
+            return mPositionHfr;
+        }
+        double zonePositionHfr(int zone) const
+        {
+            return mZonePositionHfr[zone];
+        }
+
+        double bestPos() const
+        {
+            return mBestPos;
+        }
+        double bestHfr() const
+        {
+            return mBestHfr;
+        }
+        bool hasFit() const
+        {
+            return mHasFit;
+        }
+        double bestPosFit() const
+        {
+            return mBestPosFit;
+        }
+        double zoneBestPosFit(int zone) const
+        {
+            return mZoneBestPosFit[zone];
+        }
+        /// 0..1 : fit r², 0 without a minimum inside the scanned range
+        double confidence() const;
+        /// Zone fit exists and is a minimum
+        bool zoneHasFit(int zone) const
+        {
+            return mZoneHasFit[zone];
+        }
+
+        const std::vector<double> &positions() const
+        {
+            return mPositions;
+        }
+        const std::vector<double> &hfrs() const
+        {
+            return mHfrs;
+        }
+        const std::vector<double> &zonePositions(int zone) const
+        {
+            return mZonePositions[zone];
+        }
+        const std::vector<double> &zoneHfrs(int zone) const
+        {
+            return mZoneHfrs[zone];
+        }
+        const PolynomialFit &fit() const
+        {
+            return mFit;
+        }
+        const PolynomialFit &zoneFit(int zone) const
+        {
+            return mZoneFits[zone];
+        }
+
+    private:
+        /// Upward parabola with its vertex within [lo, hi]
+        static bool minimum(const PolynomialFit &fit, double lo, double hi, double &vertex);
+
+        int mZoning = 2;
+
+        int mFrames = 0;
+        int mValidFrames = 0;
+        double mPositionHfr = 99;
+        QList<int> mZoneFrames;
+        QList<double> mZonePositionHfr;
+
+        std::vector<double> mPositions;
+        std::vector<double> mHfrs;
+        std::vector<std::vector<double>> mZonePositions;
+        std::vector<std::vector<double>> mZoneHfrs;
+
+        PolynomialFit mFit;
+        double mFitMin = 0;     ///< scanned range of the fitted points
+        double mFitMax = 0;
+        std::vector<PolynomialFit> mZoneFits;
+
+        double mBestPos = 0;
+        double mBestHfr = 99;
+        bool mHasFit = false;
+        double mBestPosFit = 0;
+        std::vector<double> mZoneBestPosFit;
+        std::vector<char> mZoneHasFit;
+};
@@ -0,0 +1,161 @@
+#include "framestacker.h"
+
+#include <fitsio.h>
+#include <algorithm>
+#include <cstring>
+
+void FrameStacker::reset()
+{
+    mCount = 0;
+    mSum.clear();
+    mRefRows.clear();
+    mRefCols.clear();
+}
+
+bool FrameStacker::add(const FITSImage::Statistic &stats, const uint8_t *buffer)
+{
+    if (stats.channels != 1) return false;
+    if (stats.dataType != TBYTE && stats.dataType != TUSHORT && stats.dataType != TFLOAT) return false;
+
+    if (mCount == 0)
+    {
+        mStats = stats;
+        mWidth = stats.width;
+        mHeight = stats.height;
+        mThreshold = stats.mean[0] + 3 * stats.stddev[0];
+        mSum.assign(static_cast<size_t>(mWidth) * mHeight, 0);
+    }
+    else if (stats.width != mWidth || stats.height != mHeight || stats.dataType != mStats.dataType)
+    {
+        return false;
+    }
+
+    std::vector<double> rows;
+    std::vector<double> cols;
+    switch (stats.dataType)
+    {
+        case TBYTE:
+            project(buffer, rows, cols);
+            break;
+        case TUSHORT:
+            project(reinterpret_cast<const uint16_t *>(buffer), rows, cols);
+            break;
+        default:
+            project(reinterpret_cast<const float *>(buffer), rows, cols);
+            break;
+    }
+
+    int dx = 0;
+    int dy = 0;
+    if (mCount == 0)
+    {
+        mRefRows = rows;
+        mRefCols = cols;
+    }
+    else
+    {
+        dx = bestShift(mRefCols, cols, maxShift);
+        dy = bestShift(mRefRows, rows, maxShift);
+    }
+
+    switch (stats.dataType)
+    {
+        case TBYTE:
+            accumulate(buffer, dx, dy);
+            break;
+        case TUSHORT:
+            accumulate(reinterpret_cast<const uint16_t *>(buffer), dx, dy);
+            break;
+        default:
+            accumulate(reinterpret_cast<const float *>(buffer), dx, dy);
+            break;
+    }
+    mCount++;
+    return true;
+}
+
+const uint8_t *FrameStacker::buffer()
+{
+    switch (mStats.dataType)
+    {
+        case TBYTE:
+            output<uint8_t>();
+            break;
+        case TUSHORT:
+            output<uint16_t>();
+            break;
+        default:
+            output<float>();
+            break;
+    }
+    return mOut.data();
+}
+
+template <typename T>
+void FrameStacker::project(const T *src, std::vector<double> &rows, std::vector<double> &cols) const
+{
+    rows.assign(mHeight, 0);
+    cols.assign(mWidth, 0);
+    for (int y = 0; y < mHeight; y++)
+    {
+        const T *line = src + static_cast<size_t>(y) * mWidth;
+        for (int x = 0; x < mWidth; x++)
+        {
+            double v = line[x] - mThreshold;
+            if (v > 0)
+            {
+                rows[y] += v;
+                cols[x] += v;
+            }
+        }
+    }
+}
+
+template <typename T>
+void FrameStacker::accumulate(const T *src, int dx, int dy)
+{
+    // pixel (x, y) of the reference is (x + dx, y + dy) in this frame, edges are replicated
+    for (int y = 0; y < mHeight; y++)
+    {
+        int sy = std::min(mHeight - 1, std::max(0, y + dy));
+        const T *line = src + static_cast<size_t>(sy) * mWidth;
+        float *sum = mSum.data() + static_cast<size_t>(y) * mWidth;
+        int x0 = std::max(0, -dx);
+        int x1 = std::min(mWidth, mWidth - dx);
+        for (int x = 0; x < x0; x++) sum[x] += line[0];
+        for (int x = x0; x < x1; x++) sum[x] += line[x + dx];
+        for (int x = x1; x < mWidth; x++) sum[x] += line[mWidth - 1];
+    }
+}
+
+template <typename T>
+void FrameStacker::output()
+{
+    mOut.resize(mSum.size() * sizeof(T));
+    T *out = reinterpret_cast<T *>(mOut.data());
+    float k = mCount > 0 ? 1.0f / mCount : 0;
+    for (size_t i = 0; i < mSum.size(); i++)
+    {
+        out[i] = static_cast<T>(mSum[i] * k);
+    }
+}
+
+int FrameStacker::bestShift(const std::vector<double> &ref, const std::vector<double> &cur, int maxShift)
+{
+    int best = 0;
+    double bestScore = -1;
+    int n = static_cast<int>(ref.size());
+    for (int s = -maxShift; s <= maxShift; s++)
+    {
+        double score = 0;
+        int i0 = std::max(0, -s);
+        int i1 = std::min(n, n - s);
+        for (int i = i0; i < i1; i++) score += ref[i] * cur[i + s];
+        if (score > bestScore)
+        {
+            bestScore = score;
+            best = s;
+        }
+    }
+    return best;
+}
@@ -0,0 +1,58 @@
+/**
+ * @file framestacker.h
+ * @brief In memory co-addition of short focus exposures
+ *
+ * Frames of one focuser position are aligned on the first one and averaged,
+ * so HFR is measured once on the stack instead of once per frame. Alignment
+ * is translation only, found by cross-correlating row and column projections
+ * of star pixels (above mean + 3 sigma) : one pass over the frame, no star
+ * extraction needed.
+ *
+ * Supports mono 8 bits, 16 bits and float frames. The stack is exposed in the
+ * same data type as the input, ready for Solver::ResetSolver.
+ */
+
+#pragma once
+
+#include <solver.h>
+#include <vector>
+
+class FrameStacker
+{
+    public:
+        /// Drop current stack
+        void reset();
+        /// Co-add one frame, false if format unsupported or different from the first frame
+        bool add(const FITSImage::Statistic &stats, const uint8_t *buffer);
+
+        int count() const
+        {
+            return mCount;
+        }
+        /// Mean of stacked frames, in the input data type. Valid until next add/reset
+        const uint8_t *buffer();
+        /// Statistics of the first frame, describing buffer()
+        const FITSImage::Statistic &stats() const
+        {
+            return mStats;
+        }
+
+        /// Max alignment shift searched, pixels
+        int maxShift = 20;
+
+    private:
+        template <typename T> void project(const T *src, std::vector<double> &rows, std::vector<double> &cols) const;
+        template <typename T> void accumulate(const T *src, int dx, int dy);
+        template <typename T> void output();
+        static int bestShift(const std::vector<double> &ref, const std::vector<double> &cur, int maxShift);
+
+        FITSImage::Statistic mStats;
+        int mCount = 0;
+        int mWidth = 0;
+        int mHeight = 0;
+        double mThreshold = 0;
+        std::vector<double> mRefRows;
+        std::vector<double> mRefCols;
+        std::vector<float> mSum;
+        std::vector<uint8_t> mOut;
+};
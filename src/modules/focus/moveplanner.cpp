@@ -0,0 +1,13 @@
+#include "moveplanner.h"
+
+QList<double> MovePlanner::plan(double target) const
+{
+    QList<double> moves;
+    // direction reversal (or unknown position) : take up the slack below target first
+    if (mBacklash > 0 && (!mKnown || target < mPosition))
+    {
+        moves.append(target - mBacklash);
+    }
+    moves.append(target);
+    return moves;
+}
@@ -0,0 +1,53 @@
+/**
+ * @file moveplanner.h
+ * @brief Backlash aware focuser move planning
+ *
+ * Focus always takes its measurements moving outward (increasing positions),
+ * so every final approach must be done in that direction. Overshooting by
+ * the backlash is only needed when the requested target is behind the
+ * current position : otherwise the focuser goes straight to the target,
+ * saving a full round trip (5-10 s on slow focusers). When it is needed,
+ * Focus sends the overshoot and the target as one chained sequence.
+ */
+
+#pragma once
+
+#include <QList>
+
+class MovePlanner
+{
+    public:
+        void setBacklash(double backlash)
+        {
+            mBacklash = backlash;
+        }
+        /// Current focuser position, if known
+        void setPosition(double position)
+        {
+            mPosition = position;
+            mKnown = true;
+        }
+        /// Forget position, next plan will overshoot
+        void reset()
+        {
+            mKnown = false;
+        }
+
+        /// Moves to perform to reach target approaching from below : [target] or [target - backlash, target]
+        QList<double> plan(double target) const;
+        /// Last move sent was to position
+        bool isAt(double position) const
+        {
+            return mKnown && mPosition == position;
+        }
+        /// Record a move sent to the focuser
+        void moved(double position)
+        {
+            setPosition(position);
+        }
+
+    private:
+        double mBacklash = 0;
+        double mPosition = 0;
+        bool mKnown = false;
+};
@@ -0,0 +1,109 @@
+#include "tiltsolver.h"
+
+#include <cmath>
+
+namespace
+{
+// Gaussian elimination with partial pivoting, n <= 4
+bool solveLinear(double m[4][4], double *b, int n)
+{
+    for (int col = 0; col < n; col++)
+    {
+        int pivot = col;
+        for (int r = col + 1; r < n; r++)
+            if (std::fabs(m[r][col]) > std::fabs(m[pivot][col])) pivot = r;
+        if (std::fabs(m[pivot][col]) < 1e-12) return false;
+        if (pivot != col)
+        {
+            for (int c = 0; c < n; c++) std::swap(m[col][c], m[pivot][c]);
+            std::swap(b[col], b[pivot]);
+        }
+        for (int r = col + 1; r < n; r++)
+        {
+            double f = m[r][col] / m[col][col];
+            for (int c = col; c < n; c++) m[r][c] -= f * m[col][c];
+            b[r] -= f * b[col];
+        }
+    }
+    for (int r = n - 1; r >= 0; r--)
+    {
+        for (int c = r + 1; c < n; c++) b[r] -= m[r][c] * b[c];
+        b[r] /= m[r][r];
+    }
+    return true;
+}
+}
+
+bool TiltSolver::solve(int zoning, const std::vector<double> &zoneFocus, double widthMm, double heightMm)
+{
+    mWidth = widthMm;
+    mHeight = heightMm;
+    mZones = 0;
+    for (double z : zoneFocus)
+        if (!std::isnan(z)) mZones++;
+
+    mHasCurvature = zoning >= 3 && mZones >= 5;
+    int n = mHasCurvature ? 4 : 3;
+    if (zoning < 2 || mZones < 3 || widthMm <= 0 || heightMm <= 0) return false;
+
+    double m[4][4] = {};
+    double b[4] = {};
+    for (size_t i = 0; i < zoneFocus.size(); i++)
+    {
+        if (std::isnan(zoneFocus[i])) continue;
+        double x = ((i % zoning) + 0.5) * widthMm / zoning - widthMm / 2;
+        double y = ((i / zoning) + 0.5) * heightMm / zoning - heightMm / 2;
+        double f[4] = {1, x, y, x * x + y * y};
+        for (int r = 0; r < n; r++)
+        {
+            for (int c = 0; c < n; c++) m[r][c] += f[r] * f[c];
+            b[r] += f[r] * zoneFocus[i];
+        }
+    }
+    if (!solveLinear(m, b, n)) return false;
+
+    mCenter = b[0];
+    mSlopeX = b[1];
+    mSlopeY = b[2];
+    double k = mHasCurvature ? b[3] : 0;
+    mTiltX = mSlopeX * widthMm / 2;
+    mTiltY = mSlopeY * heightMm / 2;
+    mCurvature = k * (widthMm * widthMm + heightMm * heightMm) / 4;
+
+    double sum = 0;
+    for (size_t i = 0; i < zoneFocus.size(); i++)
+    {
+        if (std::isnan(zoneFocus[i])) continue;
+        double x = ((i % zoning) + 0.5) * widthMm / zoning - widthMm / 2;
+        double y = ((i / zoning) + 0.5) * heightMm / zoning - heightMm / 2;
+        double d = zoneFocus[i] - (mCenter + mSlopeX * x + mSlopeY * y + k * (x * x + y * y));
+        sum += d * d;
+    }
+    mRms = std::sqrt(sum / mZones);
+    return true;
+}
+
+std::vector<double> TiltSolver::screwTurns(int screws, double radius, double angle, double pitch) const
+{
+    std::vector<double> turns;
+    if (screws < 1 || pitch <= 0) return turns;
+    for (int i = 0; i < screws; i++)
+    {
+        double a = (angle + 360.0 * i / screws) * M_PI / 180;
+        // remove the plane under each screw
+        turns.push_back(-(mSlopeX * radius * std::cos(a) + mSlopeY * radius * std::sin(a)) / pitch);
+    }
+    return turns;
+}
+
+double TiltSolver::tilt() const
+{
+    double half = std::fmin(mWidth, mHeight) / 2;
+    return std::hypot(mSlopeX, mSlopeY) * half;
+}
+
+double TiltSolver::tiltAngle() const
+{
+    // slope is µm per mm
+    return std::atan(std::hypot(mSlopeX, mSlopeY) / 1000) * 180 / M_PI * 60;
+}
@@ -0,0 +1,79 @@
+/**
+ * @file tiltsolver.h
+ * @brief Sensor tilt and field curvature from per zone best focus positions
+ *
+ * Best focus of each zone of a zoning x zoning grid is fitted with
+ *     z(x, y) = z0 + tx * x + ty * y + k * (x² + y²)
+ * x, y in mm from sensor center (y downwards, as image rows), z in µm of
+ * focuser travel. Curvature is only fitted from 3x3 zoning upwards, 2x2
+ * zones are all at the same radius.
+ *
+ * Results follow the focus benchmark conventions : tilt is the focus shift
+ * from center to the right / bottom edge, curvature is the shift from center
+ * to a corner.
+ */
+
+#pragma once
+
+#include <vector>
+
+class TiltSolver
+{
+    public:
+        /// Sensor size in mm, zone values in µm, NaN for zones without fit
+        bool solve(int zoning, const std::vector<double> &zoneFocus, double widthMm, double heightMm);
+
+        /// Tilt correction for n screws on a circle of radius mm, first screw at angle (degrees,
+        /// clockwise from the right edge), pitch in µm per turn. Positive turns move the sensor
+        /// like an increasing focuser position. Turns add up to zero : a common amount on all
+        /// screws only shifts focus.
+        std::vector<double> screwTurns(int screws, double radius, double angle, double pitch) const;
+
+        double center() const
+        {
+            return mCenter;
+        }
+        double tiltX() const
+        {
+            return mTiltX;
+        }
+        double tiltY() const
+        {
+            return mTiltY;
+        }
+        /// Total tilt, µm from center to edge along the steepest direction of the shorter side
+        double tilt() const;
+        /// Tilt angle, arcmin
+        double tiltAngle() const;
+        double curvature() const
+        {
+            return mCurvature;
+        }
+        bool hasCurvature() const
+        {
+            return mHasCurvature;
+        }
+        /// Residual rms of zone best focus around the model, µm
+        double rms() const
+        {
+            return mRms;
+        }
+        int zones() const
+        {
+            return mZones;
+        }
+
+    private:
+        double mWidth = 0;
+        double mHeight = 0;
+        double mCenter = 0;
+        double mTiltX = 0;
+        double mTiltY = 0;
+        double mCurvature = 0;
+        bool mHasCurvature = false;
+        double mRms = 0;
+        int mZones = 0;
+        // plane slopes, µm / mm
+        double mSlopeX = 0;
+        double mSlopeY = 0;
+};
@@ -24,7 +24,7 @@
 
 #include "guider.h"
 #include "versionModule.cc"
-//#include "polynomialfit.h"
+//#include "common/polynomialfit.h"
 #define PI 3.14159265
 
 /**
@@ -1,7 +1,279 @@
 #include "inspector.h"
+#include <QFile>
 #include <QPainter>
+#include <QTextStream>
+#include <QtConcurrent>
+#include <algorithm>
+#include <cmath>
+#include "psfsurface.h"
 #include "versionModule.cc"
 
+namespace
+{
+
+/* read-only copy of one analysed frame, shared by the renderings */
+struct RenderInput
+{
+    QImage image;       ///< RGB32, converted once for every rendering
+    QList<FITSImage::Star> stars;
+    std::vector<float> HFRZone;
+    std::vector<float> eZone;
+    std::vector<float> thetaZone;
+    int zones;
+    int width;
+    int height;
+    double ech;
+    double HFRavg;
+    double upperLeftHFR;
+    double upperRightHFR;
+    double lowerLeftHFR;
+    double lowerRightHFR;
+    int cornerSize;
+    QString path;
+    QString caption;   ///< averaging status, empty for a single frame
+    std::vector<PsfStar> catalogue;
+    PsfSurface psf;
+};
+
+void drawCaption(QImage &image, const QString &caption)
+{
+    if (caption.isEmpty()) return;
+    QPainter p(&image);
+    p.setPen(QPen(Qt::white));
+    p.setFont(QFont("Courrier", image.width() / 80, QFont::Normal));
+    p.drawText(QRect(0, 0, image.width(), image.height()), Qt::AlignLeft | Qt::AlignBottom, caption);
+}
+typedef void (*RenderJob)(const RenderInput &);
+
+void renderImage(const RenderInput &in)
+{
+    in.image.save(in.path + ".jpeg", "JPG", 100);
+}
+
+void renderHFR(const RenderInput &in)
+{
+    QImage imHFR = in.image;
+
+    /* calculate min & max HFR */
+    float minHFR = ZoneGrid::NoValue;
+    float maxHFR = ZoneGrid::NoValue;
+    for (float hfr : in.HFRZone)
+    {
+        if (hfr == ZoneGrid::NoValue) continue;
+        if (minHFR == ZoneGrid::NoValue || hfr < minHFR) minHFR = hfr;
+        if (maxHFR == ZoneGrid::NoValue || hfr > maxHFR) maxHFR = hfr;
+    }
+    float spanHFR = maxHFR > minHFR ? maxHFR - minHFR : 1;
+
+    /*zoning*/
+    QPainter p;
+    p.begin(&imHFR);
+    p.setOpacity(0.5);
+    for (int line = 0; line < in.zones ; line++)
+    {
+        for (int column = 0; column < in.zones; column++)
+        {
+            int zone = in.zones * line + column;
+            if (in.HFRZone[zone] == ZoneGrid::NoValue) continue;
+
+            int x = (in.width / in.zones) * (column) ;
+            int y = (in.height / in.zones) * (line) ;
+            int dx = in.width / in.zones;
+            int dy = in.height / in.zones;
+
+            unsigned int r = 255 * (in.HFRZone[zone] - minHFR) / spanHFR;
+            p.fillRect(QRect(x / 2, y / 2, dx / 2, dy / 2), qRgb(r, 0, 0));
+        }
+    }
+    p.setOpacity(1);
+
+    /*surround stars*/
+    p.setPen(QPen(Qt::blue, 10));
+    foreach( FITSImage::Star s, in.stars )
+    {
+        int x = s.x;
+        int y = s.y;
+        int hfr = s.HFR;
+        p.drawEllipse(QPoint(x / 2, y / 2), hfr, hfr);
+    }
+
+    /* HFR rectangle*/
+    p.setPen(QPen(Qt::white));
+    int mul = 200;
+    double avg = in.HFRavg * in.ech;
+    int w = imHFR.width();
+    int h = imHFR.height();
+    QVector<QPointF> hexPoints;
+    hexPoints << QPointF(1 * w / 4 - mul * (in.upperLeftHFR - avg),
+                         1 * h / 4 - mul * (in.upperLeftHFR - avg));
+    hexPoints << QPointF(3 * w / 4 + mul * (in.upperRightHFR - avg),
+                         1 * h / 4 - mul * (in.upperRightHFR - avg));
+    hexPoints << QPointF(3 * w / 4 - mul * (in.lowerRightHFR - avg),
+                         3 * h / 4 + mul * (in.lowerRightHFR - avg));
+    hexPoints << QPointF(1 * w / 4 + mul * (in.lowerLeftHFR - avg),
+                         3 * h / 4 + mul * (in.lowerLeftHFR - avg));
+    p.drawPolygon(hexPoints);
+    p.setFont(QFont("Courrier", w / 50, QFont::Normal));
+    p.drawText(  QRect(0, 0, w, h), Qt::AlignCenter, QString::number(avg, 'f', 3) + "''");
+    p.drawText(1 * w / 4, 1 * h / 4, QString::number(in.upperLeftHFR, 'f', 3) + "''");
+    p.drawText(3 * w / 4, 1 * h / 4, QString::number(in.upperRightHFR, 'f', 3) + "''");
+    p.drawText(1 * w / 4, 3 * h / 4, QString::number(in.lowerLeftHFR, 'f', 3) + "''");
+    p.drawText(3 * w / 4, 3 * h / 4, QString::number(in.lowerRightHFR, 'f', 3) + "''");
+    p.end();
+    drawCaption(imHFR, in.caption);
+
+    imHFR.save(in.path + "HFR.jpeg", "JPG", 100);
+}
+
+void renderCorners(const RenderInput &in)
+{
+    int s = in.cornerSize;
+    int h = in.image.height();
+    int w = in.image.width();
+
+    QImage corners = QImage(3 * s, 3 * s, QImage::Format_RGB32);
+    corners.fill(Qt::green);
+    QPainter painter(&corners);
+
+    painter.drawImage(QRect(0 * s, 0 * s, s, s), in.image, QRect(0, 0, s, s)); //upper left
+    painter.drawImage(QRect(1 * s, 0 * s, s, s), in.image, QRect(w / 2 - s / 2, 0, s, s)); //upper middle
+    painter.drawImage(QRect(2 * s, 0 * s, s, s), in.image, QRect(w - s, 0, s, s)); //upper right
+
+    painter.drawImage(QRect(0 * s, 1 * s, s, s), in.image, QRect(0, h / 2 - s / 2, s, s)); //middle left
+    painter.drawImage(QRect(1 * s, 1 * s, s, s), in.image, QRect(w / 2 - s / 2, h / 2 - s / 2, s, s)); //middle middle
+    painter.drawImage(QRect(2 * s, 1 * s, s, s), in.image, QRect(w - s, h / 2 - s / 2, s, s)); //middle right
+
+    painter.drawImage(QRect(0 * s, 2 * s, s, s), in.image, QRect(0, h - s, s, s)); //lower left
+    painter.drawImage(QRect(1 * s, 2 * s, s, s), in.image, QRect(w / 2 - s / 2, h - s, s, s)); //lower middle
+    painter.drawImage(QRect(2 * s, 2 * s, s, s), in.image, QRect(w - s, h - s, s, s)); //lower right
+
+    painter.setPen(QPen(Qt::red));
+    painter.drawRect(QRect(s, 0, s, 3 * s - 1));
+    painter.drawRect(QRect(0, s, 3 * s - 1, s));
+    painter.drawRect(QRect(0, 0, 3 * s - 1, 3 * s - 1));
+
+    painter.end();
+    corners.save(in.path + "corners.jpeg", "JPG", 100);
+}
+
+void renderPSF(const RenderInput &in)
+{
+    /* star catalogue, one line per star */
+    QFile file(in.path + "psf.csv");
+    if (file.open(QIODevice::WriteOnly | QIODevice::Text))
+    {
+        QTextStream out(&file);
+        out << "x,y,hfr,a,b,theta,hfrmodel\n";
+        for (const PsfStar &s : in.catalogue)
+        {
+            out << s.x << "," << s.y << "," << s.hfr << "," << s.a << "," << s.b << "," << s.theta << ","
+                << (in.psf.valid() ? in.psf.hfr(s.x, s.y) : 0) << "\n";
+        }
+        file.close();
+    }
+
+    QImage imPSF = in.image;
+    if (!in.psf.valid())
+    {
+        imPSF.save(in.path + "psf.jpeg", "JPG", 100);
+        return;
+    }
+
+    /* HFR from the model, blue = best, red = worst, evaluated at 1/8 and smoothly upscaled */
+    int columns = std::max(1, imPSF.width() / 8);
+    int lines = std::max(1, imPSF.height() / 8);
+    std::vector<float> hfr, ecc;
+    in.psf.evaluate(columns, lines, hfr, ecc);
+    float minHFR = *std::min_element(hfr.begin(), hfr.end());
+    float maxHFR = *std::max_element(hfr.begin(), hfr.end());
+    float span = maxHFR > minHFR ? maxHFR - minHFR : 1;
+    QImage map(columns, lines, QImage::Format_RGB32);
+    for (int l = 0; l < lines; l++)
+    {
+        QRgb *row = reinterpret_cast<QRgb *>(map.scanLine(l));
+        for (int c = 0; c < columns; c++)
+        {
+            int level = 255 * (hfr[l * columns + c] - minHFR) / span;
+            row[c] = qRgb(level, 0, 255 - level);
+        }
+    }
+
+    QPainter p(&imPSF);
+    p.setOpacity(0.5);
+    p.drawImage(imPSF.rect(), map.scaled(imPSF.size(), Qt::IgnoreAspectRatio, Qt::SmoothTransformation));
+    p.setOpacity(1);
+
+    /* eccentricity whiskers, length 1 = half a cell */
+    p.setPen(QPen(Qt::white, 3));
+    int cells = 16;
+    float cell = float(imPSF.width()) / cells;
+    for (float y = cell / 2; y < imPSF.height(); y += cell)
+    {
+        for (float x = cell / 2; x < imPSF.width(); x += cell)
+        {
+            double fx = x * in.width / imPSF.width();
+            double fy = y * in.height / imPSF.height();
+            double e = std::min(1.0, in.psf.eccentricity(fx, fy));
+            double t = in.psf.theta(fx, fy) * M_PI / 180;
+            float dx = 0.5 * cell * e * cos(t);
+            float dy = 0.5 * cell * e * sin(t);
+            p.drawLine(QPointF(x - dx, y - dy), QPointF(x + dx, y + dy));
+        }
+    }
+
+    p.setFont(QFont("Courrier", imPSF.width() / 80, QFont::Normal));
+    p.drawText(QRect(0, 0, imPSF.width(), imPSF.height()), Qt::AlignLeft | Qt::AlignTop,
+               QString("HFR %1'' - %2''  tilt %3'' / %4''  curvature %5''")
+               .arg(minHFR * in.ech, 0, 'f', 2).arg(maxHFR * in.ech, 0, 'f', 2)
+               .arg(in.psf.tiltX() * in.ech, 0, 'f', 2).arg(in.psf.tiltY() * in.ech, 0, 'f', 2)
+               .arg(in.psf.curvature() * in.ech, 0, 'f', 2));
+    p.end();
+    imPSF.save(in.path + "psf.jpeg", "JPG", 100);
+}
+
+void renderShape(const RenderInput &in)
+{
+    QImage imShape = in.image;
+
+    /* min and max aberations */
+    float eMin = ZoneGrid::NoValue;
+    float eMax = ZoneGrid::NoValue;
+    for (float e : in.eZone)
+    {
+        if (e == ZoneGrid::NoValue) continue;
+        if (eMin == ZoneGrid::NoValue || e < eMin) eMin = e;
+        if (eMax == ZoneGrid::NoValue || e > eMax) eMax = e;
+    }
+    float eSpan = eMax > eMin ? eMax - eMin : 1;
+
+    /* draw aberations, segment along the mean orientation, length from ellipticity */
+    QPainter p;
+    p.begin(&imShape);
+    p.setOpacity(0.5);
+    p.setPen(QPen(Qt::red, 10));
+    for (int line = 0; line < in.zones ; line++)
+    {
+        for (int column = 0; column < in.zones; column++)
+        {
+            int zone = in.zones * line + column;
+            if (in.eZone[zone] == ZoneGrid::NoValue) continue;
+
+            int x = (in.width / in.zones) * (column + 0.5) ;
+            int y = (in.height / in.zones) * (line + 0.5) ;
+            float e = in.eZone[zone];
+            float dx = (0.5 * in.width / in.zones) * ((e - eMin) / eSpan) * cos(in.thetaZone[zone] * M_PI / 180);
+            float dy = (0.5 * in.width / in.zones) * ((e - eMin) / eSpan) * sin(in.thetaZone[zone] * M_PI / 180);
+
+            p.drawLine(x / 2 - dx, y / 2 - dy, x / 2 + dx, y / 2 + dy);
+        }
+    }
+    p.end();
+    drawCaption(imShape, in.caption);
+    imShape.save(in.path + "shape.jpeg", "JPG", 100);
+}
+
+}
+
 Inspector *initialize(QString name, QString label, QString profile, QVariantMap availableModuleLibs)
 {
     Inspector *basemodule = new Inspector(name, label, profile, availableModuleLibs);
@@ -41,6 +313,10 @@ Inspector::Inspector(QString name, QString label, QString profile, QVariantMap a
     b->setValue(false, false);
     getProperty("actions")->addElt("abort", b);
 
+    b = new OST::ElementBool("Reset average", "4", "");
+    b->setValue(false, false);
+    getProperty("actions")->addElt("resetaverage", b);
+
     getProperty("actions")->deleteElt("startsequence");
     getProperty("actions")->deleteElt("abortsequence");
 
@@ -53,11 +329,13 @@ Inspector::Inspector(QString name, QString label, QString profile, QVariantMap a
 
     getProperty("parms")->addElt("cornersize", i);
     connect(this, &Inspector::newImage, this, &Inspector::OnNewImage);
+    connect(&mRenderWatcher, &QFutureWatcher<void>::finished, this, &Inspector::OnRenderDone);
 
 }
 
 Inspector::~Inspector()
 {
+    mRenderWatcher.waitForFinished();
 
 }
 void Inspector::OnMyExternalEvent(const QString &eventType, const QString  &eventModule, const QString  &eventKey,
@@ -89,6 +367,8 @@ void Inspector::OnMyExternalEvent(const QString &eventType, const QString  &even
                         if (getEltBool(keyprop, keyelt)->setValue(true, true))
                         {
                             mState = "loop";
+                            mDroppedFrames = 0;
+                            mAccumulator.clear();
                             initIndi();
                             Shoot();
                         }
@@ -97,7 +377,23 @@ void Inspector::OnMyExternalEvent(const QString &eventType, const QString  &even
                     {
                         if (getEltBool(keyprop, keyelt)->setValue(false, true))
                         {
-                            emit newImage();
+                            if (isAnalysing())
+                            {
+                                sendWarning("Analysis in progress, reload ignored");
+                            }
+                            else
+                            {
+                                mAnalysing = true;
+                                emit newImage();
+                            }
+                        }
+                    }
+                    if (keyelt == "resetaverage")
+                    {
+                        if (getEltBool(keyprop, keyelt)->setValue(false, true))
+                        {
+                            mAccumulator.clear();
+                            updateConvergence();
                         }
                     }
                     if (keyelt == "abort")
@@ -106,7 +402,9 @@ void Inspector::OnMyExternalEvent(const QString &eventType, const QString  &even
                         {
                             getEltBool("actions", "loop")->setValue(false, true);
                             emit Abort();
+                            stopAnalysis();
                             mState = "idle";
+                            delete mPendingImage;
                             getProperty("actions")->setState(OST::Ok);
                         }
                     }
@@ -119,12 +417,10 @@ void Inspector::OnMyExternalEvent(const QString &eventType, const QString  &even
                         if (eventType == "Fposticon")
                         {
                             getProperty("actions")->setState(OST::Ok);
-                            delete _image;
-                            _image = new fileio();
-                            _image->loadFits(getString("fileselect", "name"));
-                            _image->generateQImage();
-                            stats = _image->getStats();
-                            emit newImage();
+                            fileio *image = new fileio();
+                            image->loadFits(getString("fileselect", "name"));
+                            image->generateQImage();
+                            analyse(image);
                         }
                     }
                 }
@@ -141,18 +437,76 @@ void Inspector::newBLOB(INDI::PropertyBlob pblob)
     )
     {
         getProperty("actions")->setState(OST::Ok);
-        delete _image;
-        _image = new fileio();
-        _image->loadBlob(pblob, 64);
+        fileio *image = new fileio();
+        image->loadBlob(pblob, 64);
         // testing : load fits, comment previous and uncomment **2** lines below
-        //_image->loadFits("/pathoftheimage/Light_LLL_008.fits");
-        //_image->generateQImage();
+        //image->loadFits("/pathoftheimage/Light_LLL_008.fits");
+        //image->generateQImage();
+
+        /* camera is free again : expose frame N+1 while frame N is analysed */
+        if (mState == "loop")
+        {
+            Shoot();
+        }
+        analyse(image);
+    }
+
+
+
+}
+
+void Inspector::analyse(fileio *image)
+{
+    if (!isAnalysing())
+    {
+        delete _image;
+        _image = image;
         stats = _image->getStats();
+        mAnalysing = true;
         emit newImage();
+        return;
     }
 
+    /* still busy with a previous frame : keep only the most recent one */
+    if (mPendingImage)
+    {
+        delete mPendingImage;
+        mDroppedFrames++;
+        sendMessage("Analysis behind camera, " + QString::number(mDroppedFrames) + " frame(s) dropped");
+    }
+    mPendingImage = image;
+}
 
+bool Inspector::isAnalysing()
+{
+    // SEP never answered : give up on that frame rather than refusing every next one
+    if (mAnalysing && !mRenderWatcher.isRunning() && mAnalyseTimer.elapsed() > 120000)
+    {
+        sendWarning("Star extraction lost, analysis restarted");
+        stopAnalysis();
+    }
+    return mAnalysing;
+}
 
+void Inspector::stopAnalysis()
+{
+    disconnect(&_solver, &Solver::successSEP, this, &Inspector::OnSucessSEP);
+    disconnect(mSolveFinished);
+    if (_solver.stellarSolver.isRunning()) _solver.stellarSolver.abortAndWait();
+    // renderings work on their own snapshot, OnRenderDone clears the busy state
+    if (!mRenderWatcher.isRunning()) mAnalysing = false;
+}
+
+void Inspector::analysisDone()
+{
+    /* next capture was already requested when the blob came in, pick up what arrived meanwhile */
+    mAnalysing = false;
+    if (mPendingImage)
+    {
+        fileio *image = mPendingImage;
+        mPendingImage = nullptr;
+        analyse(image);
+    }
 }
 
 void Inspector::updateProperty(INDI::Property property)
@@ -214,339 +568,131 @@ void Inspector::OnSucessSEP()
 {
     //qDebug() << "OnSucessSEP";
 
-    getProperty("actions")->setState(OST::Ok);
+    if (mState != "loop") getProperty("actions")->setState(OST::Ok);
 
     disconnect(&_solver, &Solver::successSEP, this, &Inspector::OnSucessSEP);
 
-
-    //image->saveMapToJpeg(_webroot+"/"+_modulename+".jpeg",100,_solver.stars);
-    QList<fileio::Record> rec = _image->getRecords();
     QImage rawImage = _image->getRawQImage();
-    QImage im = rawImage.convertToFormat(QImage::Format_RGB32);
-    im.setColorTable(rawImage.colorTable());
-    QImage imHFR = rawImage.convertToFormat(QImage::Format_ARGB32);
-    //imHFR.setColorTable(rawImage.colorTable());
-    QImage imShape = rawImage.convertToFormat(QImage::Format_RGB32);
-    imShape.setColorTable(rawImage.colorTable());
-    int imgWidth = _image->getStats().width;
-    int imgHeight = _image->getStats().height;
-
     double ech = getSampling();
 
-    /****************************************************************** HFR */
-    /****************************************************************** HFR */
-    /****************************************************************** HFR */
-    /****************************************************************** HFR */
+    int imgWidth = _image->getStats().width;
+    int imgHeight = _image->getStats().height;
 
-    /* smoothing avg 8 surround cell */
-    QList<float> smoothedHFR = _solver.HFRavgZone;
-    for (int line = 1; line < _solver.HFRZones - 1 ; line++)
+    /* zones and quadrants in one pass each */
+    mZoneGrid.reset(_solver.HFRZones, imgWidth, imgHeight);
+    mZoneGrid.addStars(_solver.stars);
+    mZoneGrid.compute();
+    mQuadrants.reset(2, imgWidth, imgHeight);
+    mQuadrants.addStars(_solver.stars);
+    mQuadrants.compute();
+    upperLeftHFR = mQuadrants.hfr()[0] == ZoneGrid::NoValue ? _solver.HFRavg * ech : mQuadrants.hfr()[0] * ech;
+    upperRightHFR = mQuadrants.hfr()[1] == ZoneGrid::NoValue ? _solver.HFRavg * ech : mQuadrants.hfr()[1] * ech;
+    lowerLeftHFR = mQuadrants.hfr()[2] == ZoneGrid::NoValue ? _solver.HFRavg * ech : mQuadrants.hfr()[2] * ech;
+    lowerRightHFR = mQuadrants.hfr()[3] == ZoneGrid::NoValue ? _solver.HFRavg * ech : mQuadrants.hfr()[3] * ech;
+
+    /* snapshot for the renderers, the solver and the image may change before they are done */
+    RenderInput in;
+    in.image = rawImage;
+    in.stars = _solver.stars;
+    in.zones = mZoneGrid.zones();
+    in.width = imgWidth;
+    in.height = imgHeight;
+    in.ech = ech;
+    in.HFRavg = _solver.HFRavg;
+    in.upperLeftHFR = upperLeftHFR;
+    in.upperRightHFR = upperRightHFR;
+    in.lowerLeftHFR = lowerLeftHFR;
+    in.lowerRightHFR = lowerRightHFR;
+    in.cornerSize = getInt("parms", "cornersize");
+    in.path = getWebroot() + "/" + getModuleName();
+    in.HFRZone = std::vector<float>(mZoneGrid.smoothedHfr(), mZoneGrid.smoothedHfr() + mZoneGrid.size());
+    in.eZone = std::vector<float>(mZoneGrid.ellipticity(), mZoneGrid.ellipticity() + mZoneGrid.size());
+    in.thetaZone = std::vector<float>(mZoneGrid.theta(), mZoneGrid.theta() + mZoneGrid.size());
+
+    /* multi-frame average replaces the single frame maps */
+    ZoneAccumulator::Mode mode = static_cast<ZoneAccumulator::Mode>(getInt("accumulate", "mode"));
+    if (mode != mAccumulator.mode() || getInt("accumulate", "frames") != mAccumulatorFrames
+            || mZoneGrid.zones() != mAccumulator.zones())
     {
-        for (int column = 1; column < _solver.HFRZones - 1; column++)
-        {
-            int i = _solver.HFRZones * line + column;
-            smoothedHFR[i] = smoothedHFR[i] + _solver.HFRavgZone[_solver.HFRZones * (line - 1) + column - 1];
-            smoothedHFR[i] = smoothedHFR[i] + _solver.HFRavgZone[_solver.HFRZones * (line - 1) + column - 0];
-            smoothedHFR[i] = smoothedHFR[i] + _solver.HFRavgZone[_solver.HFRZones * (line - 1) + column + 1];
-            smoothedHFR[i] = smoothedHFR[i] + _solver.HFRavgZone[_solver.HFRZones * (line - 0) + column - 1];
-            smoothedHFR[i] = smoothedHFR[i] + _solver.HFRavgZone[_solver.HFRZones * (line - 0) + column + 1];
-            smoothedHFR[i] = smoothedHFR[i] + _solver.HFRavgZone[_solver.HFRZones * (line + 1) + column - 1];
-            smoothedHFR[i] = smoothedHFR[i] + _solver.HFRavgZone[_solver.HFRZones * (line + 1) + column - 0];
-            smoothedHFR[i] = smoothedHFR[i] + _solver.HFRavgZone[_solver.HFRZones * (line + 1) + column + 1];
-            smoothedHFR[i] = smoothedHFR[i] / 9;
-        }
-    }
-    /* first row */
-    for (int column = 1; column < _solver.HFRZones - 1; column++)
-    {
-        int line = 0;
-        int i = _solver.HFRZones * line + column;
-        smoothedHFR[i] = smoothedHFR[i] + _solver.HFRavgZone[_solver.HFRZones * (line - 0) + column - 1];
-        smoothedHFR[i] = smoothedHFR[i] + _solver.HFRavgZone[_solver.HFRZones * (line - 0) + column + 1];
-        smoothedHFR[i] = smoothedHFR[i] + _solver.HFRavgZone[_solver.HFRZones * (line + 1) + column - 1];
-        smoothedHFR[i] = smoothedHFR[i] + _solver.HFRavgZone[_solver.HFRZones * (line + 1) + column - 0];
-        smoothedHFR[i] = smoothedHFR[i] + _solver.HFRavgZone[_solver.HFRZones * (line + 1) + column + 1];
-        smoothedHFR[i] = smoothedHFR[i] / 6;
+        mAccumulatorFrames = getInt("accumulate", "frames");
+        mAccumulator.setup(mode, mAccumulatorFrames, mZoneGrid.zones());
     }
-    /* last row */
-    for (int column = 1; column < _solver.HFRZones - 1; column++)
+    if (mode != ZoneAccumulator::Off)
     {
-        int line = _solver.HFRZones - 1;
-        int i = _solver.HFRZones * line + column;
-        smoothedHFR[i] = smoothedHFR[i] + _solver.HFRavgZone[_solver.HFRZones * (line - 1) + column - 1];
-        smoothedHFR[i] = smoothedHFR[i] + _solver.HFRavgZone[_solver.HFRZones * (line - 1) + column - 0];
-        smoothedHFR[i] = smoothedHFR[i] + _solver.HFRavgZone[_solver.HFRZones * (line - 1) + column + 1];
-        smoothedHFR[i] = smoothedHFR[i] + _solver.HFRavgZone[_solver.HFRZones * (line - 0) + column - 1];
-        smoothedHFR[i] = smoothedHFR[i] + _solver.HFRavgZone[_solver.HFRZones * (line - 0) + column + 1];
-        smoothedHFR[i] = smoothedHFR[i] / 6;
+        mAccumulator.add(mZoneGrid);
+        mZoneGrid.smooth(mAccumulator.hfr(), in.HFRZone.data());
+        in.eZone.assign(mAccumulator.ellipticity(), mAccumulator.ellipticity() + mZoneGrid.size());
+        in.thetaZone.assign(mAccumulator.theta(), mAccumulator.theta() + mZoneGrid.size());
+        in.caption = QString("%1 frames - HFR ±%2% - ellipticity ±%3").arg(mAccumulator.frames())
+                     .arg(mAccumulator.hfrError(), 0, 'f', 2).arg(mAccumulator.shapeError(), 0, 'f', 3);
     }
-    /* first column */
-    for (int line = 1; line < _solver.HFRZones - 1 ; line++)
-    {
-        int column = 0;
-        int i = _solver.HFRZones * line + column;
-        smoothedHFR[i] = smoothedHFR[i] + _solver.HFRavgZone[_solver.HFRZones * (line - 1) + column - 0];
-        smoothedHFR[i] = smoothedHFR[i] + _solver.HFRavgZone[_solver.HFRZones * (line - 1) + column + 1];
-        smoothedHFR[i] = smoothedHFR[i] + _solver.HFRavgZone[_solver.HFRZones * (line - 0) + column + 1];
-        smoothedHFR[i] = smoothedHFR[i] + _solver.HFRavgZone[_solver.HFRZones * (line + 1) + column - 0];
-        smoothedHFR[i] = smoothedHFR[i] + _solver.HFRavgZone[_solver.HFRZones * (line + 1) + column + 1];
-        smoothedHFR[i] = smoothedHFR[i] / 6;
-    }
-    /* last column */
-    for (int line = 1; line < _solver.HFRZones - 1 ; line++)
-    {
-        int column = _solver.HFRZones - 1;
-        int i = _solver.HFRZones * line + column;
-        smoothedHFR[i] = smoothedHFR[i] + _solver.HFRavgZone[_solver.HFRZones * (line - 1) + column - 1];
-        smoothedHFR[i] = smoothedHFR[i] + _solver.HFRavgZone[_solver.HFRZones * (line - 1) + column - 0];
-        smoothedHFR[i] = smoothedHFR[i] + _solver.HFRavgZone[_solver.HFRZones * (line - 0) + column - 1];
-        smoothedHFR[i] = smoothedHFR[i] + _solver.HFRavgZone[_solver.HFRZones * (line + 1) + column - 1];
-        smoothedHFR[i] = smoothedHFR[i] + _solver.HFRavgZone[_solver.HFRZones * (line + 1) + column - 0];
-        smoothedHFR[i] = smoothedHFR[i] / 6;
-    }
-    /*corners*/
-    {
-        /* upper left */
-        int line = 0;
-        int column = 0;
-        int i = _solver.HFRZones * line + column;
-        smoothedHFR[i] = smoothedHFR[i] + _solver.HFRavgZone[_solver.HFRZones * (line - 0) + column + 1];
-        smoothedHFR[i] = smoothedHFR[i] + _solver.HFRavgZone[_solver.HFRZones * (line + 1) + column + 0];
-        smoothedHFR[i] = smoothedHFR[i] + _solver.HFRavgZone[_solver.HFRZones * (line + 1) + column + 1];
-        smoothedHFR[i] = smoothedHFR[i] / 4;
-        /* upper right */
-        line = 0;
-        column = _solver.HFRZones - 1;
-        i = _solver.HFRZones * line + column;
-        smoothedHFR[i] = smoothedHFR[i] + _solver.HFRavgZone[_solver.HFRZones * (line - 0) + column - 1];
-        smoothedHFR[i] = smoothedHFR[i] + _solver.HFRavgZone[_solver.HFRZones * (line + 1) + column + 0];
-        smoothedHFR[i] = smoothedHFR[i] + _solver.HFRavgZone[_solver.HFRZones * (line + 1) + column - 1];
-        smoothedHFR[i] = smoothedHFR[i] / 4;
-        /* lower left */
-        line = _solver.HFRZones - 1;
-        column = 0;
-        i = _solver.HFRZones * line + column;
-        smoothedHFR[i] = smoothedHFR[i] + _solver.HFRavgZone[_solver.HFRZones * (line - 1) + column + 0];
-        smoothedHFR[i] = smoothedHFR[i] + _solver.HFRavgZone[_solver.HFRZones * (line - 1) + column + 1];
-        smoothedHFR[i] = smoothedHFR[i] + _solver.HFRavgZone[_solver.HFRZones * (line + 0) + column + 1];
-        smoothedHFR[i] = smoothedHFR[i] / 4;
-        /* lower right */
-        line = _solver.HFRZones - 1;
-        column = _solver.HFRZones - 1;
-        i = _solver.HFRZones * line + column;
-        smoothedHFR[i] = smoothedHFR[i] + _solver.HFRavgZone[_solver.HFRZones * (line - 1) + column + 0];
-        smoothedHFR[i] = smoothedHFR[i] + _solver.HFRavgZone[_solver.HFRZones * (line - 1) + column - 1];
-        smoothedHFR[i] = smoothedHFR[i] + _solver.HFRavgZone[_solver.HFRZones * (line + 0) + column - 1];
-        smoothedHFR[i] = smoothedHFR[i] / 4;
-    }
-    /* calculate min & max HFR */
-    float minHFR = 99;
-    float maxHFR = 0;
-    for (int i = 0; i < _solver.HFRZones * _solver.HFRZones ; i++)
-    {
-        if (smoothedHFR[i] < minHFR) minHFR = smoothedHFR[i];
-        if ((smoothedHFR[i] > maxHFR) && (smoothedHFR[i] < 99)) maxHFR = smoothedHFR[i];
-    }
-    /*zoning*/
-    QPainter p2;
-    p2.begin(&imHFR);
-    p2.setOpacity(0.5);
-    for (int line = 0; line < _solver.HFRZones ; line++)
-    {
-        for (int column = 0; column < _solver.HFRZones; column++)
-        {
-            int zone = _solver.HFRZones * line + column;
-
-            int x = (imgWidth / _solver.HFRZones) * (column) ;
-            int y = (imgHeight / _solver.HFRZones) * (line) ;
-            int dx = imgWidth / _solver.HFRZones;
-            int dy = imgHeight / _solver.HFRZones;
-
-            qreal alpha = 1 * (smoothedHFR[zone] - minHFR) / (maxHFR - minHFR);
-            unsigned int r = 255 * (smoothedHFR[zone] - minHFR) / (maxHFR - minHFR);
-            unsigned int g = 255 * (maxHFR - smoothedHFR[zone]) / (maxHFR - minHFR);
-            p2.fillRect(QRect(x / 2, y / 2, dx / 2, dy / 2), qRgb(r, 0, 0));
-
-
-        }
-    }
-    p2.end();
+    updateConvergence();
 
-    /*surround stars*/
-    p2.begin(&imHFR);
-    p2.setPen(QPen(Qt::blue, 10));
+    /* full field PSF model from every star */
+    in.catalogue.reserve(_solver.stars.size());
     foreach( FITSImage::Star s, _solver.stars )
     {
-        QPainter p2;
-        int x = s.x;
-        int y = s.y;
-        int hfr = s.HFR;
-        p2.drawEllipse(QPoint(x / 2, y / 2), hfr, hfr);
+        in.catalogue.push_back({s.x, s.y, s.HFR, s.a, s.b, s.theta});
     }
-    p2.end();
-
-
-
-
-    /* HFR rectangle*/
-    QPainter p;
-    p.begin(&imHFR);
-    p.setPen(QPen(Qt::red));
-    int upperLeftI = 0;
-    int lowerLeftI = 0;
-    int upperRightI = 0;
-    int lowerRightI = 0;
-    upperLeftHFR = 0;
-    lowerLeftHFR = 0;
-    upperRightHFR = 0;
-    lowerRightHFR = 0;
-    foreach( FITSImage::Star s, _solver.stars )
+    in.psf.fit(in.catalogue, imgWidth, imgHeight, getInt("parameters", "psfdegree"));
+    getEltInt("psf", "stars")->setValue(in.psf.used(), false);
+    getEltInt("psf", "rejected")->setValue(in.psf.rejected(), false);
+    getEltFloat("psf", "rms")->setValue(in.psf.valid() ? in.psf.rms() * ech : 99, false);
+    getEltFloat("psf", "center")->setValue(in.psf.valid() ? in.psf.centerHfr() * ech : 99, false);
+    getEltFloat("psf", "tiltx")->setValue(in.psf.valid() ? in.psf.tiltX() * ech : 99, false);
+    getEltFloat("psf", "tilty")->setValue(in.psf.valid() ? in.psf.tiltY() * ech : 99, false);
+    getEltFloat("psf", "curvature")->setValue(in.psf.valid() && in.psf.degree() >= 2 ? in.psf.curvature() * ech : 99, false);
+    getEltFloat("psf", "eccentricity")->setValue(in.psf.valid() ? in.psf.eccentricity(imgWidth / 2.0, imgHeight / 2.0) : 99, true);
+
+    mImgData = _image->ImgStats();
+    mImgData.HFRavg = ech * _solver.HFRavg;
+    mImgData.starsCount = _solver.stars.size();
+
+    /* each rendering paints and encodes its own jpeg, they all run side by side */
+    mRenderWatcher.setFuture(QtConcurrent::run([in]() mutable
     {
-        if ( (s.x < (im.width() / 2)) && (s.y < (im.height() / 2) ))
-        {
-            upperLeftHFR = ( upperLeftI * upperLeftHFR + s.HFR * ech) / (upperLeftI + 1);
-            upperLeftI++;
-        }
-        if ( (s.x > (im.width() / 2)) && (s.y < (im.height() / 2) ))
+        // one conversion, the renderings paint on their own (copy on write) copy
+        in.image = in.image.convertToFormat(QImage::Format_RGB32);
+        QVector<RenderJob> jobs = {renderImage, renderHFR, renderShape, renderCorners, renderPSF};
+        QtConcurrent::blockingMap(jobs, [&in](RenderJob & job)
         {
-            upperRightHFR = (upperRightI * upperRightHFR + s.HFR * ech ) / (upperRightI + 1);
-            upperRightI++;
-        }
-        if ( (s.x < (im.width() / 2)) && (s.y > (im.height() / 2) ))
-        {
-            lowerLeftHFR = (lowerLeftI * lowerLeftHFR + s.HFR * ech) / (lowerLeftI + 1);
-            lowerLeftI++;
-        }
-        if ( (s.x > (im.width() / 2)) && (s.y > (im.height() / 2) ))
-        {
-            lowerRightHFR = (lowerRightI * lowerRightHFR + s.HFR * ech) / (lowerRightI + 1);
-            lowerRightI++;
-        }
-    };
-
-    p.setPen(QPen(Qt::white));
-    int mul = 200;
-    QVector<QPointF> hexPoints;
-    hexPoints << QPointF(1 * im.width() / 4 - mul * (upperLeftHFR - _solver.HFRavg * ech),
-                         1 * im.height() / 4 - mul * (upperLeftHFR - _solver.HFRavg * ech));
-    hexPoints << QPointF(3 * im.width() / 4 + mul * (upperRightHFR - _solver.HFRavg * ech),
-                         1 * im.height() / 4 - mul * (upperRightHFR - _solver.HFRavg * ech));
-    hexPoints << QPointF(3 * im.width() / 4 - mul * (lowerRightHFR - _solver.HFRavg * ech),
-                         3 * im.height() / 4 + mul * (lowerRightHFR - _solver.HFRavg * ech));
-    hexPoints << QPointF(1 * im.width() / 4 + mul * (lowerLeftHFR - _solver.HFRavg * ech),
-                         3 * im.height() / 4 + mul * (lowerLeftHFR - _solver.HFRavg * ech));
-    p.drawPolygon(hexPoints);
-    p.setFont(QFont("Courrier", im.width() / 50, QFont::Normal));
-    p.drawText(  QRect(0, 0, im.width(), im.height()), Qt::AlignCenter, QString::number(_solver.HFRavg * ech, 'f', 3) + "''");
-    p.drawText(1 * im.width() / 4, 1 * im.height() / 4, QString::number(upperLeftHFR, 'f', 3) + "''");
-    p.drawText(3 * im.width() / 4, 1 * im.height() / 4, QString::number(upperRightHFR, 'f', 3) + "''");
-    p.drawText(1 * im.width() / 4, 3 * im.height() / 4, QString::number(lowerLeftHFR, 'f', 3) + "''");
-    p.drawText(3 * im.width() / 4, 3 * im.height() / 4, QString::number(lowerRightHFR, 'f', 3) + "''");
-
-    p.end();
-
-    imHFR.save(getWebroot() + "/" + getModuleName() + "HFR.jpeg", "JPG", 100);
-
-    /****************************************************************** corners */
-    /****************************************************************** corners */
-    /****************************************************************** corners */
-    /****************************************************************** corners */
-
-    int s = getInt("parms", "cornersize");
-    int h = rawImage.height();
-    int w = rawImage.width();
-
-    QImage corners = QImage(3 * s, 3 * s, QImage::Format_RGB32);
-    corners.setColorTable(rawImage.colorTable());
-    corners.fill(Qt::green);
-    QPainter painter(&corners);
-
-    painter.drawImage(QRect(0 * s, 0 * s, s, s), rawImage, QRect(0, 0, s, s)); //upper left
-    painter.drawImage(QRect(1 * s, 0 * s, s, s), rawImage, QRect(w / 2 - s / 2, 0, s, s)); //upper middle
-    painter.drawImage(QRect(2 * s, 0 * s, s, s), rawImage, QRect(w - s, 0, s, s)); //upper right
-
-    painter.drawImage(QRect(0 * s, 1 * s, s, s), rawImage, QRect(0, h / 2 - s / 2, s, s)); //middle left
-    painter.drawImage(QRect(1 * s, 1 * s, s, s), rawImage, QRect(w / 2 - s / 2, h / 2 - s / 2, s, s)); //middle middle
-    painter.drawImage(QRect(2 * s, 1 * s, s, s), rawImage, QRect(w - s, h / 2 - s / 2, s, s)); //middle right
-
-    painter.drawImage(QRect(0 * s, 2 * s, s, s), rawImage, QRect(0, h - s, s, s)); //lower left
-    painter.drawImage(QRect(1 * s, 2 * s, s, s), rawImage, QRect(w / 2 - s / 2, h - s, s, s)); //lower middle
-    painter.drawImage(QRect(2 * s, 2 * s, s, s), rawImage, QRect(w - s, h - s, s, s)); //lower right
-
-    painter.setPen(QPen(Qt::red));
-    painter.drawRect(QRect(s, 0, s, 3 * s - 1));
-    painter.drawRect(QRect(0, s, 3 * s - 1, s));
-    painter.drawRect(QRect(0, 0, 3 * s - 1, 3 * s - 1));
-
-    painter.end();
-    corners.save(getWebroot() + "/" + getModuleName() + "corners.jpeg", "JPG", 100);
-    im.save(getWebroot()  + "/" + getModuleName() + ".jpeg", "JPG", 100);
+            job(in);
+        });
+    }));
 
-    /****************************************************************** aberations */
-    /****************************************************************** aberations */
-    /****************************************************************** aberations */
-    /****************************************************************** aberations */
-
-    int ellipseSize = 0.20 * imgHeight / _solver.HFRZones;
-
-    /* min and max aberations */
-    float eMin = 99;
-    float eMax = 0;
-    for (int line = 0; line < _solver.HFRZones ; line++)
-    {
-        for (int column = 0; column < _solver.HFRZones; column++)
-        {
-            int zone = _solver.HFRZones * line + column;
-            float e = _solver.aAxeAvgZone[zone] / _solver.bAxeAvgZone[zone] - 1;
-            if (e < eMin) eMin = e;
-            if (e > eMax) eMax = e;
-        }
-    }
-
-    /* draw aberations */
-    p2.begin(&imShape);
-    p2.setOpacity(0.5);
-    p2.setPen(QPen(Qt::red, 10));
-    for (int line = 0; line < _solver.HFRZones ; line++)
-    {
-        for (int column = 0; column < _solver.HFRZones; column++)
-        {
-            int zone = _solver.HFRZones * line + column;
-
-            int x = (imgWidth / _solver.HFRZones) * (column + 0.5) ;
-            int y = (imgHeight / _solver.HFRZones) * (line + 0.5) ;
-            float e = _solver.aAxeAvgZone[zone] / _solver.bAxeAvgZone[zone] - 1;
-            float dx = (0.5 * imgWidth / _solver.HFRZones) * ((e - eMin) / (eMax - eMin)) * cos(_solver.thetaAvgZone[zone] * 3.14159 /
-                       360);
-            float dy = (0.5 * imgWidth / _solver.HFRZones) * ((e - eMin) / (eMax - eMin)) * sin(_solver.thetaAvgZone[zone] * 3.14159 /
-                       360);
-
-            p2.drawLine(x / 2 - dx, y / 2 - dy, x / 2 + dx, y / 2 + dy);
-        }
-    }
-    p2.end();
-    imShape.save(getWebroot() + "/" + getModuleName() + "shape.jpeg", "JPG", 100);
-
-
-    OST::ImgData dta = _image->ImgStats();
+}
+void Inspector::updateConvergence()
+{
+    getEltInt("convergence", "frames")->setValue(mAccumulator.frames(), false);
+    getEltFloat("convergence", "hfrerror")->setValue(mAccumulator.hfrError(), false);
+    getEltFloat("convergence", "shapeerror")->setValue(mAccumulator.shapeError(), false);
+    if (mAccumulator.mode() == ZoneAccumulator::Off || mAccumulator.frames() == 0)
+        getEltLight("convergence", "converged")->setValue(OST::Idle, true);
+    else if (mAccumulator.converged(getFloat("accumulate", "target")))
+        getEltLight("convergence", "converged")->setValue(OST::Ok, true);
+    else
+        getEltLight("convergence", "converged")->setValue(OST::Busy, true);
+}
+void Inspector::OnRenderDone()
+{
+    OST::ImgData dta = mImgData;
     dta.mUrlJpeg = getModuleName() + ".jpeg";
-    dta.HFRavg = ech * _solver.HFRavg;
-    dta.starsCount = _solver.stars.size();
     dta.mAlternates.clear();
     dta.mAlternates.push_front(getModuleName() + "corners.jpeg");
     dta.mAlternates.push_front(getModuleName() + "HFR.jpeg");
     dta.mAlternates.push_front(getModuleName() + "shape.jpeg");
+    dta.mAlternates.push_front(getModuleName() + "psf.jpeg");
     getEltImg("image", "image")->setValue(dta, true);
 
-    dta = _image->ImgStats();
+    dta = mImgData;
     dta.mUrlJpeg = getModuleName() + "corners.jpeg";
     getEltImg("corners", "image")->setValue(dta, true);
     dta.mUrlJpeg = getModuleName() + "HFR.jpeg";
     getEltImg("hfr", "image")->setValue(dta, true);
     dta.mUrlJpeg = getModuleName() + "shape.jpeg";
     getEltImg("shape", "image")->setValue(dta, true);
-
-
+    dta.mUrlJpeg = getModuleName() + "psf.jpeg";
+    getEltImg("psfmap", "image")->setValue(dta, true);
 
     emit FindStarsDone();
 
@@ -554,16 +700,28 @@ void Inspector::OnSucessSEP()
     {
         mState = "idle";
     }
-    if (mState == "loop")
-    {
-        Shoot();
-    }
 
+    analysisDone();
 
 }
 void Inspector::OnNewImage()
 {
+    mAnalyseTimer.start();
     _solver.ResetSolver(stats, _image->getImageBuffer(), getInt("parameters", "zoning"));
-    connect(&_solver, &Solver::successSEP, this, &Inspector::OnSucessSEP);
+    connect(&_solver, &Solver::successSEP, this, &Inspector::OnSucessSEP, Qt::UniqueConnection);
+    disconnect(mSolveFinished);
+    mSolveFinished = connect(&_solver.stellarSolver, &StellarSolver::finished, this, &Inspector::OnSolverFinished);
     _solver.FindStars(_solver.stellarSolverProfiles[0]);
 }
+void Inspector::OnSolverFinished()
+{
+    disconnect(mSolveFinished);
+    if (!_solver.stellarSolver.failed()) return;
+
+    /* no successSEP will come for this frame */
+    disconnect(&_solver, &Solver::successSEP, this, &Inspector::OnSucessSEP);
+    sendWarning("Star extraction failed");
+    if (mState != "loop") getProperty("actions")->setState(OST::Ok);
+    if (mState == "single") mState = "idle";
+    analysisDone();
+}
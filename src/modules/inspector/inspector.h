@@ -3,6 +3,10 @@
 #include <indimodule.h>
 #include <fileio.h>
 #include <solver.h>
+#include <QElapsedTimer>
+#include <QFutureWatcher>
+#include "common/zonegrid.h"
+#include "zoneaccumulator.h"
 
 #if defined(INSPECTOR_MODULE)
 #  define MODULE_INIT Q_DECL_EXPORT
@@ -47,7 +51,9 @@ class MODULE_INIT Inspector : public IndiModule
         void OnMyExternalEvent(const QString &eventType, const QString  &eventModule, const QString  &eventKey,
                                const QVariantMap &eventData) override;
         void OnSucessSEP();
+        void OnRenderDone();
         void OnNewImage();
+        void OnSolverFinished();
 
 
     private:
@@ -57,6 +63,11 @@ class MODULE_INIT Inspector : public IndiModule
         void initIndi(void);
 
         void Shoot();
+        void analyse(fileio *image);
+        bool isAnalysing();
+        void stopAnalysis();
+        void analysisDone();
+        void updateConvergence();
         void SMAlert();
         //void SMLoadblob(IBLOB *bp);
         void SMLoadblob();
@@ -66,6 +77,11 @@ class MODULE_INIT Inspector : public IndiModule
         bool    _newblob;
 
         QPointer<fileio> _image;
+        QPointer<fileio> mPendingImage;
+        bool mAnalysing = false;
+        QElapsedTimer mAnalyseTimer;
+        QMetaObject::Connection mSolveFinished;
+        int mDroppedFrames = 0;
         Solver _solver;
         FITSImage::Statistic stats;
 
@@ -85,6 +101,13 @@ class MODULE_INIT Inspector : public IndiModule
         double upperRightHFR;
         double lowerRightHFR;
 
+        ZoneGrid mZoneGrid;
+        ZoneGrid mQuadrants;
+        ZoneAccumulator mAccumulator;
+        int mAccumulatorFrames = 0;
+        QFutureWatcher<void> mRenderWatcher;
+        OST::ImgData mImgData;
+
 };
 
 extern "C" MODULE_INIT Inspector *initialize(QString name, QString label, QString profile,
@@ -0,0 +1,220 @@
+/**
+ * @file psfsurface.cpp
+ * @brief Least-squares 2D polynomial fit of HFR and shape over the field
+ */
+
+#include "psfsurface.h"
+
+#include <algorithm>
+#include <cmath>
+
+void PsfSurface::basis(double u, double v, double *phi) const
+{
+    int k = 0;
+    for (int d = 0; d <= mDegree; d++)
+    {
+        for (int j = 0; j <= d; j++)
+        {
+            phi[k++] = std::pow(u, d - j) * std::pow(v, j);
+        }
+    }
+}
+
+double PsfSurface::value(const double *coeffs, double x, double y) const
+{
+    double phi[MaxTerms];
+    basis(x / mHalfWidth - 1, y / mHalfHeight - 1, phi);
+    double sum = 0;
+    for (int k = 0; k < mTerms; k++) sum += coeffs[k] * phi[k];
+    return sum;
+}
+
+bool PsfSurface::fit(const std::vector<PsfStar> &stars, int width, int height, int degree)
+{
+    mDegree = std::max(1, std::min(MaxDegree, degree));
+    mTerms = (mDegree + 1) * (mDegree + 2) / 2;
+    mHalfWidth = std::max(1, width) / 2.0;
+    mHalfHeight = std::max(1, height) / 2.0;
+    mValid = false;
+    mRejected = 0;
+
+    std::vector<char> keep(stars.size(), 1);
+    for (size_t i = 0; i < stars.size(); i++)
+    {
+        if (!(stars[i].hfr > 0) || !(stars[i].a > 0)) keep[i] = 0;
+    }
+    if (!solve(stars, keep)) return false;
+
+    /* one rejection pass on the HFR residuals */
+    int rejected = 0;
+    for (size_t i = 0; i < stars.size(); i++)
+    {
+        if (!keep[i]) continue;
+        if (std::fabs(stars[i].hfr - value(mHfr, stars[i].x, stars[i].y)) > 3 * mRms)
+        {
+            keep[i] = 0;
+            rejected++;
+        }
+    }
+    if (rejected > 0 && !solve(stars, keep)) return false;
+    mRejected = rejected;
+    mValid = true;
+    return true;
+}
+
+bool PsfSurface::solve(const std::vector<PsfStar> &stars, const std::vector<char> &keep)
+{
+    const int m = mTerms;
+    double ata[MaxTerms][MaxTerms] = {};
+    double rhs[3][MaxTerms] = {};
+    double phi[MaxTerms];
+    int used = 0;
+
+    for (size_t i = 0; i < stars.size(); i++)
+    {
+        if (!keep[i]) continue;
+        const PsfStar &s = stars[i];
+        double ratio = std::min(1.0, double(s.b) / s.a);
+        double ecc = std::sqrt(1 - ratio * ratio);
+        double t = s.theta * M_PI / 90;
+        double y[3] = {s.hfr, ecc * std::cos(t), ecc * std::sin(t)};
+
+        basis(s.x / mHalfWidth - 1, s.y / mHalfHeight - 1, phi);
+        for (int r = 0; r < m; r++)
+        {
+            for (int c = r; c < m; c++) ata[r][c] += phi[r] * phi[c];
+            for (int q = 0; q < 3; q++) rhs[q][r] += phi[r] * y[q];
+        }
+        used++;
+    }
+    if (used < 2 * m) return false;
+    for (int r = 0; r < m; r++)
+        for (int c = 0; c < r; c++) ata[r][c] = ata[c][r];
+
+    /* Gaussian elimination with partial pivoting, three right hand sides */
+    for (int col = 0; col < m; col++)
+    {
+        int pivot = col;
+        for (int r = col + 1; r < m; r++)
+            if (std::fabs(ata[r][col]) > std::fabs(ata[pivot][col])) pivot = r;
+        if (std::fabs(ata[pivot][col]) < 1e-12) return false;
+        if (pivot != col)
+        {
+            for (int c = 0; c < m; c++) std::swap(ata[pivot][c], ata[col][c]);
+            for (int q = 0; q < 3; q++) std::swap(rhs[q][pivot], rhs[q][col]);
+        }
+        for (int r = col + 1; r < m; r++)
+        {
+            double f = ata[r][col] / ata[col][col];
+            for (int c = col; c < m; c++) ata[r][c] -= f * ata[col][c];
+            for (int q = 0; q < 3; q++) rhs[q][r] -= f * rhs[q][col];
+        }
+    }
+    double *out[3] = {mHfr, mEx, mEy};
+    for (int q = 0; q < 3; q++)
+    {
+        for (int r = m - 1; r >= 0; r--)
+        {
+            double sum = rhs[q][r];
+            for (int c = r + 1; c < m; c++) sum -= ata[r][c] * out[q][c];
+            out[q][r] = sum / ata[r][r];
+        }
+        for (int r = m; r < MaxTerms; r++) out[q][r] = 0;
+    }
+
+    double sum2 = 0;
+    for (size_t i = 0; i < stars.size(); i++)
+    {
+        if (!keep[i]) continue;
+        double d = stars[i].hfr - value(mHfr, stars[i].x, stars[i].y);
+        sum2 += d * d;
+    }
+    mUsed = used;
+    mRms = std::sqrt(sum2 / std::max(1, used - m));
+    return true;
+}
+
+double PsfSurface::hfr(double x, double y) const
+{
+    return value(mHfr, x, y);
+}
+
+double PsfSurface::eccentricity(double x, double y) const
+{
+    return std::max(0.0, std::hypot(value(mEx, x, y), value(mEy, x, y)));
+}
+
+double PsfSurface::theta(double x, double y) const
+{
+    return std::atan2(value(mEy, x, y), value(mEx, x, y)) * 90 / M_PI;
+}
+
+void PsfSurface::evaluate(int columns, int lines, std::vector<float> &hfr, std::vector<float> &eccentricity) const
+{
+    columns = std::max(1, columns);
+    lines = std::max(1, lines);
+    hfr.assign(columns * lines, 0);
+    eccentricity.assign(columns * lines, 0);
+
+    /* powers of u for every column, contiguous per power */
+    std::vector<float> upow((mDegree + 1) * columns);
+    for (int c = 0; c < columns; c++)
+    {
+        float u = 2.0f * (c + 0.5f) / columns - 1;
+        float p = 1;
+        for (int i = 0; i <= mDegree; i++)
+        {
+            upow[i * columns + c] = p;
+            p *= u;
+        }
+    }
+
+    std::vector<float> ex(columns), ey(columns);
+    for (int l = 0; l < lines; l++)
+    {
+        float v = 2.0f * (l + 0.5f) / lines - 1;
+        float vpow[MaxDegree + 1];
+        vpow[0] = 1;
+        for (int j = 1; j <= mDegree; j++) vpow[j] = vpow[j - 1] * v;
+
+        float *h = &hfr[l * columns];
+        std::fill(ex.begin(), ex.end(), 0.0f);
+        std::fill(ey.begin(), ey.end(), 0.0f);
+        int k = 0;
+        for (int d = 0; d <= mDegree; d++)
+        {
+            for (int j = 0; j <= d; j++, k++)
+            {
+                const float *u = &upow[(d - j) * columns];
+                float sh = mHfr[k] * vpow[j];
+                float sx = mEx[k] * vpow[j];
+                float sy = mEy[k] * vpow[j];
+                for (int c = 0; c < columns; c++)
+                {
+                    h[c] += sh * u[c];
+                    ex[c] += sx * u[c];
+                    ey[c] += sy * u[c];
+                }
+            }
+        }
+        float *e = &eccentricity[l * columns];
+        for (int c = 0; c < columns; c++) e[c] = std::sqrt(ex[c] * ex[c] + ey[c] * ey[c]);
+    }
+}
+
+double PsfSurface::tiltX() const
+{
+    return value(mHfr, 2 * mHalfWidth, mHalfHeight) - value(mHfr, 0, mHalfHeight);
+}
+
+double PsfSurface::tiltY() const
+{
+    return value(mHfr, mHalfWidth, 2 * mHalfHeight) - value(mHfr, mHalfWidth, 0);
+}
+
+double PsfSurface::curvature() const
+{
+    double corners = value(mHfr, 0, 0) + value(mHfr, 2 * mHalfWidth, 0)
+                     + value(mHfr, 0, 2 * mHalfHeight) + value(mHfr, 2 * mHalfWidth, 2 * mHalfHeight);
+    return corners / 4 - mHfr[0];
+}
@@ -0,0 +1,114 @@
+/**
+ * @file psfsurface.h
+ * @brief Smooth 2D polynomial model of the PSF over the whole field
+ *
+ * PsfSurface fits, by linear least squares, the HFR and the shape vector of
+ * every star (ex = e.cos 2θ, ey = e.sin 2θ, e = eccentricity) with
+ * polynomials of degree 1 to 4 in normalized coordinates u, v in [-1, 1]
+ * centered on the frame.
+ *
+ * All three quantities share the same design matrix, so a single pass over
+ * the catalogue accumulates one normal matrix (15x15 at most) and three
+ * right hand sides. Stars further than 3 sigma from the HFR surface
+ * (blends, hot pixels, saturated stars) are rejected once and the system is
+ * rebuilt. Cost is O(stars * terms²), a few ms for thousands of stars.
+ *
+ * For degree >= 2 the HFR coefficients read directly as optics numbers:
+ * tiltX/tiltY are the HFR difference between opposite edges, curvature the
+ * HFR difference between the mean of the corners and the center.
+ */
+
+#pragma once
+
+#include <vector>
+
+struct PsfStar
+{
+    float x;
+    float y;
+    float hfr;
+    float a;
+    float b;
+    float theta;   ///< degrees
+};
+
+class PsfSurface
+{
+    public:
+        static const int MaxDegree = 4;
+        static const int MaxTerms = (MaxDegree + 1) * (MaxDegree + 2) / 2;
+
+        /// Fit the catalogue, width/height of the frame in the same units as x, y
+        bool fit(const std::vector<PsfStar> &stars, int width, int height, int degree = 2);
+
+        bool valid() const
+        {
+            return mValid;
+        }
+        int degree() const
+        {
+            return mDegree;
+        }
+        int terms() const
+        {
+            return mTerms;
+        }
+        int used() const
+        {
+            return mUsed;
+        }
+        int rejected() const
+        {
+            return mRejected;
+        }
+        /// RMS of the HFR residuals of the stars kept
+        double rms() const
+        {
+            return mRms;
+        }
+        /// HFR coefficients, order 1, u, v, u², uv, v², u³ ...
+        const double *hfrCoefficients() const
+        {
+            return mHfr;
+        }
+
+        /// Model at frame coordinates
+        double hfr(double x, double y) const;
+        double eccentricity(double x, double y) const;
+        /// Orientation of the elongation, degrees
+        double theta(double x, double y) const;
+
+        /**
+         * @brief Evaluate HFR and eccentricity on a columns x lines grid covering the frame
+         * Rows are evaluated with precomputed powers, no per pixel basis rebuild.
+         */
+        void evaluate(int columns, int lines, std::vector<float> &hfr, std::vector<float> &eccentricity) const;
+
+        /// Model at the center of the frame
+        double centerHfr() const
+        {
+            return mHfr[0];
+        }
+        /// HFR right edge minus left edge, and bottom minus top
+        double tiltX() const;
+        double tiltY() const;
+        /// Mean HFR of the four corners minus the center
+        double curvature() const;
+
+    private:
+        void basis(double u, double v, double *phi) const;
+        double value(const double *coeffs, double x, double y) const;
+        bool solve(const std::vector<PsfStar> &stars, const std::vector<char> &keep);
+
+        int mDegree = 2;
+        int mTerms = 6;
+        double mHalfWidth = 1;
+        double mHalfHeight = 1;
+        bool mValid = false;
+        int mUsed = 0;
+        int mRejected = 0;
+        double mRms = 0;
+        double mHfr[MaxTerms] = {};
+        double mEx[MaxTerms] = {};
+        double mEy[MaxTerms] = {};
+};
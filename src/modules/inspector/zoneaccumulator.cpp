@@ -0,0 +1,135 @@
+/**
+ * @file zoneaccumulator.cpp
+ * @brief Multi-frame averaging of the inspector zone maps
+ */
+
+#include "zoneaccumulator.h"
+#include "common/zonegrid.h"
+
+#include <algorithm>
+#include <cmath>
+
+void ZoneAccumulator::setup(Mode mode, int frames, int zones)
+{
+    mMode = mode;
+    mLength = std::max(2, frames);
+    mZones = std::max(1, zones);
+    clear();
+}
+
+void ZoneAccumulator::clear()
+{
+    int n = mZones * mZones;
+    mFrames = 0;
+    mNext = 0;
+    mHfrError = 0;
+    mShapeError = 0;
+    mRing.clear();
+    mCount.assign(n * Channels, 0);
+    mMean.assign(n * Channels, 0);
+    mVar.assign(n * Channels, 0);
+    mVarMean.assign(n * Channels, 0);
+    mHfr.assign(n, ZoneGrid::NoValue);
+    mEllipticity.assign(n, ZoneGrid::NoValue);
+    mTheta.assign(n, ZoneGrid::NoValue);
+}
+
+void ZoneAccumulator::add(const ZoneGrid &grid)
+{
+    if (mMode == Off) return;
+    if (grid.zones() != mZones) setup(mMode, mLength, grid.zones());
+
+    int n = mZones * mZones;
+    std::vector<float> sample(n * Channels, ZoneGrid::NoValue);
+    for (int i = 0; i < n; i++)
+    {
+        if (grid.hfr()[i] == ZoneGrid::NoValue || grid.ellipticity()[i] == ZoneGrid::NoValue) continue;
+        float t = grid.theta()[i] * float(M_PI / 90);
+        sample[i * Channels + 0] = grid.hfr()[i];
+        sample[i * Channels + 1] = grid.ellipticity()[i] * std::cos(t);
+        sample[i * Channels + 2] = grid.ellipticity()[i] * std::sin(t);
+    }
+    mFrames++;
+
+    if (mMode == Window)
+    {
+        if (int(mRing.size()) < mLength)
+        {
+            mRing.push_back(sample);
+        }
+        else
+        {
+            mRing[mNext] = sample;
+            mNext = (mNext + 1) % mLength;
+        }
+        mFrames = mRing.size();
+        updateWindow();
+    }
+    else
+    {
+        /* exponential : exact running mean until N frames, then weight 1/N */
+        float alpha = 2.0f / (mLength + 1);
+        for (int k = 0; k < n * Channels; k++)
+        {
+            if (sample[k] == ZoneGrid::NoValue) continue;
+            mCount[k]++;
+            float a = std::max(alpha, 1.0f / mCount[k]);
+            float d = sample[k] - mMean[k];
+            mMean[k] += a * d;
+            mVar[k] = (1 - a) * (mVar[k] + a * d * d);
+            /* variance of the mean : plain mean while filling, then the exponential window */
+            if (a > alpha) mVarMean[k] = mVar[k] / std::max(1, mCount[k] - 1);
+            else mVarMean[k] = mVar[k] * a / (2 - a);
+        }
+    }
+    updateMaps();
+}
+
+void ZoneAccumulator::updateWindow()
+{
+    int size = mZones * mZones * Channels;
+    for (int k = 0; k < size; k++)
+    {
+        int count = 0;
+        double sum = 0;
+        double sum2 = 0;
+        for (const std::vector<float> &frame : mRing)
+        {
+            if (frame[k] == ZoneGrid::NoValue) continue;
+            count++;
+            sum += frame[k];
+            sum2 += double(frame[k]) * frame[k];
+        }
+        mCount[k] = count;
+        mMean[k] = count > 0 ? sum / count : 0;
+        double var = count > 1 ? (sum2 - sum * sum / count) / (count - 1) : 0;
+        mVarMean[k] = count > 1 ? std::max(0.0, var) / count : 0;
+    }
+}
+
+void ZoneAccumulator::updateMaps()
+{
+    mHfrError = 0;
+    mShapeError = 0;
+    for (int i = 0; i < mZones * mZones; i++)
+    {
+        const int *count = &mCount[i * Channels];
+        const float *mean = &mMean[i * Channels];
+        const float *varMean = &mVarMean[i * Channels];
+        if (count[0] == 0)
+        {
+            mHfr[i] = mEllipticity[i] = mTheta[i] = ZoneGrid::NoValue;
+            continue;
+        }
+        mHfr[i] = mean[0];
+        mEllipticity[i] = std::hypot(mean[1], mean[2]);
+        mTheta[i] = std::atan2(mean[2], mean[1]) * float(90 / M_PI);
+        if (count[0] > 1 && mean[0] > 0) mHfrError = std::max(mHfrError, 100 * std::sqrt(varMean[0]) / mean[0]);
+        if (count[1] > 1) mShapeError = std::max(mShapeError, std::sqrt(varMean[1] + varMean[2]));
+    }
+}
+
+bool ZoneAccumulator::converged(float target) const
+{
+    return mFrames >= 3 && mHfrError <= target && 100 * mShapeError <= target;
+}
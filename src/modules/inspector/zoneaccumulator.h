@@ -0,0 +1,103 @@
+/**
+ * @file zoneaccumulator.h
+ * @brief Multi-frame averaging of the inspector zone maps
+ *
+ * A single frame zone map is dominated by seeing. ZoneAccumulator keeps, for
+ * every zone, the mean and variance of the HFR and of the shape vector
+ * (e.cos 2θ, e.sin 2θ) over the last N frames (sliding window) or with an
+ * exponential weight of about N frames. Averaging the shape as a vector
+ * lets random elongations cancel while a constant tilt or coma adds up.
+ *
+ * The standard error of each mean tells when more frames stop changing the
+ * picture: hfrError() is the worst zone, in percent of its HFR,
+ * shapeError() the worst zone, in ellipticity units.
+ */
+
+#pragma once
+
+#include <vector>
+
+class ZoneGrid;
+
+class ZoneAccumulator
+{
+    public:
+        enum Mode
+        {
+            Off = 0,
+            Window = 1,
+            Exponential = 2
+        };
+
+        /// Change mode, window length or number of zones, drops everything accumulated
+        void setup(Mode mode, int frames, int zones);
+        /// Drop everything accumulated, keep setup
+        void clear();
+        /// Add the maps of one frame
+        void add(const ZoneGrid &grid);
+
+        Mode mode() const
+        {
+            return mMode;
+        }
+        int zones() const
+        {
+            return mZones;
+        }
+        int frames() const
+        {
+            return mFrames;
+        }
+        /// Averaged maps, ZoneGrid::NoValue where no frame had stars
+        const float *hfr() const
+        {
+            return mHfr.data();
+        }
+        const float *ellipticity() const
+        {
+            return mEllipticity.data();
+        }
+        const float *theta() const
+        {
+            return mTheta.data();
+        }
+        /// Worst zone standard error of the mean HFR, % of the HFR
+        float hfrError() const
+        {
+            return mHfrError;
+        }
+        /// Worst zone standard error of the mean shape vector
+        float shapeError() const
+        {
+            return mShapeError;
+        }
+        /// Enough frames and both errors under target (%, shape in hundredths)
+        bool converged(float target) const;
+
+    private:
+        static const int Channels = 3;   ///< hfr, e.cos 2θ, e.sin 2θ
+
+        void updateWindow();
+        void updateMaps();
+
+        Mode mMode = Off;
+        int mLength = 10;
+        int mZones = 1;
+        int mFrames = 0;
+        float mHfrError = 0;
+        float mShapeError = 0;
+
+        /* sliding window : ring of Channels * zones² samples per frame */
+        std::vector<std::vector<float>> mRing;
+        int mNext = 0;
+
+        /* per zone and channel statistics */
+        std::vector<int> mCount;
+        std::vector<float> mMean;
+        std::vector<float> mVar;       ///< exponential mode, variance of the samples
+        std::vector<float> mVarMean;   ///< variance of the mean
+
+        std::vector<float> mHfr;
+        std::vector<float> mEllipticity;
+        std::vector<float> mTheta;
+};
@@ -0,0 +1,164 @@
+#include "axisfit.h"
+
+#include <cmath>
+
+namespace
+{
+// Jacobi eigen decomposition of a symmetric 3x3 matrix, vectors in columns of v
+void jacobi(double a[3][3], double d[3], double v[3][3])
+{
+    for (int i = 0; i < 3; i++)
+        for (int j = 0; j < 3; j++) v[i][j] = (i == j) ? 1 : 0;
+    for (int sweep = 0; sweep < 50; sweep++)
+    {
+        double off = std::fabs(a[0][1]) + std::fabs(a[0][2]) + std::fabs(a[1][2]);
+        if (off < 1e-30) break;
+        for (int p = 0; p < 2; p++)
+        {
+            for (int q = p + 1; q < 3; q++)
+            {
+                if (std::fabs(a[p][q]) < 1e-300) continue;
+                double theta = (a[q][q] - a[p][p]) / (2 * a[p][q]);
+                double t = (theta >= 0 ? 1 : -1) / (std::fabs(theta) + std::sqrt(theta * theta + 1));
+                double c = 1 / std::sqrt(t * t + 1);
+                double s = t * c;
+                for (int k = 0; k < 3; k++)
+                {
+                    double akp = a[k][p], akq = a[k][q];
+                    a[k][p] = c * akp - s * akq;
+                    a[k][q] = s * akp + c * akq;
+                }
+                for (int k = 0; k < 3; k++)
+                {
+                    double apk = a[p][k], aqk = a[q][k];
+                    a[p][k] = c * apk - s * aqk;
+                    a[q][k] = s * apk + c * aqk;
+                }
+                for (int k = 0; k < 3; k++)
+                {
+                    double vkp = v[k][p], vkq = v[k][q];
+                    v[k][p] = c * vkp - s * vkq;
+                    v[k][q] = s * vkp + c * vkq;
+                }
+            }
+        }
+    }
+    for (int i = 0; i < 3; i++) d[i] = a[i][i];
+}
+double dot(const Rotations::V3 &a, const Rotations::V3 &b)
+{
+    return a.x() * b.x() + a.y() * b.y() + a.z() * b.z();
+}
+}
+
+void AxisFit::clear()
+{
+    mPoints.clear();
+    mResiduals.clear();
+    mRejected = -1;
+    mRms = 0;
+    mDof = 0;
+}
+
+void AxisFit::addPoint(const Rotations::V3 &point)
+{
+    mPoints.append(point);
+}
+
+bool AxisFit::fit(const QList<Rotations::V3> &points)
+{
+    int n = points.size();
+    if (n < 3) return false;
+    double m[3] = {0, 0, 0};
+    for (const Rotations::V3 &p : points)
+    {
+        m[0] += p.x() / n;
+        m[1] += p.y() / n;
+        m[2] += p.z() / n;
+    }
+    double s[3][3] = {};
+    for (const Rotations::V3 &p : points)
+    {
+        double d[3] = {p.x() - m[0], p.y() - m[1], p.z() - m[2]};
+        for (int i = 0; i < 3; i++)
+            for (int j = 0; j < 3; j++) s[i][j] += d[i] * d[j];
+    }
+    double v[3][3];
+    jacobi(s, mEigen, v);
+
+    // sort ascending : smallest eigenvector is the plane normal
+    int order[3] = {0, 1, 2};
+    for (int i = 0; i < 3; i++)
+        for (int j = i + 1; j < 3; j++)
+            if (mEigen[order[j]] < mEigen[order[i]]) std::swap(order[i], order[j]);
+    double eigen[3];
+    for (int i = 0; i < 3; i++)
+    {
+        eigen[i] = mEigen[order[i]];
+        mVectors[i] = Rotations::V3(v[0][order[i]], v[1][order[i]], v[2][order[i]]);
+    }
+    for (int i = 0; i < 3; i++) mEigen[i] = eigen[i];
+    // two points only span a line, the normal would be arbitrary
+    if (mEigen[1] < 1e-14) return false;
+
+    mAxis = mVectors[0];
+    mOffset = dot(mAxis, Rotations::V3(m[0], m[1], m[2]));
+    // angular radius of the circle, residual distances are scaled by it
+    mCircle = std::sqrt(std::fmax(1 - mOffset * mOffset, 1e-12));
+    return true;
+}
+
+bool AxisFit::solve()
+{
+    mRejected = -1;
+    if (!fit(mPoints)) return false;
+
+    QList<Rotations::V3> kept = mPoints;
+    auto residual = [this](const Rotations::V3 & p)
+    {
+        return (dot(mAxis, p) - mOffset) / mCircle;
+    };
+
+    if (mPoints.size() >= 6)
+    {
+        int worst = 0;
+        for (int i = 1; i < mPoints.size(); i++)
+        {
+            if (std::fabs(residual(mPoints[i])) > std::fabs(residual(mPoints[worst]))) worst = i;
+        }
+        // leave-one-out : compare the worst point with the scatter of the others around their own fit
+        kept.removeAt(worst);
+        double sum = 0;
+        if (fit(kept))
+        {
+            for (const Rotations::V3 &p : kept) sum += residual(p) * residual(p);
+        }
+        double sigma = std::fmax(std::sqrt(sum / (kept.size() - 3)), Rotations::d2r(1.0 / 3600));
+        if (std::fabs(residual(mPoints[worst])) > 4 * sigma) mRejected = worst;
+        else
+        {
+            kept = mPoints;
+            fit(kept);
+        }
+    }
+
+    mResiduals.clear();
+    double sum = 0;
+    for (int i = 0; i < mPoints.size(); i++)
+    {
+        double r = residual(mPoints[i]);
+        mResiduals.append(Rotations::r2d(r) * 3600);
+        if (i != mRejected) sum += r * r;
+    }
+    mDof = kept.size() - 3;
+    double sigma = mDof > 0 ? std::sqrt(sum / mDof) : 0;
+    mRms = Rotations::r2d(sigma) * 3600;
+
+    // normal tilts around in-plane eigenvectors, variance sigma² / lambda (circle scaled)
+    for (int i = 0; i < 2; i++)
+    {
+        mErrorDir[i] = mVectors[i + 1];
+        mErrorSigma[i] = mEigen[i + 1] > 0 ? sigma * mCircle / std::sqrt(mEigen[i + 1]) : 0;
+    }
+    return true;
+}
@@ -0,0 +1,80 @@
+/**
+ * @file axisfit.h
+ * @brief Least squares rotation axis from N >= 3 pointing directions
+ *
+ * Points taken while rotating around the RA axis lie on a small circle,
+ * i.e. on a plane whose normal is the axis. The plane is fitted by total
+ * least squares (smallest eigenvector of the scatter matrix). With more than
+ * three points, residuals give the angular noise and the standard error of
+ * the axis direction. From six points, the worst point is rejected once when
+ * it is off by more than 4 sigma of the others.
+ */
+
+#pragma once
+
+#include <QList>
+#include "rotations.h"
+
+class AxisFit
+{
+    public:
+        void clear();
+        void addPoint(const Rotations::V3 &point);
+        int count() const
+        {
+            return mPoints.size();
+        }
+
+        bool solve();
+
+        /// Unit axis, sign as given by the fit
+        const Rotations::V3 &axis() const
+        {
+            return mAxis;
+        }
+        /// Angular residual of each point off the fitted circle, arcsec (rejected point included)
+        const QList<double> &residuals() const
+        {
+            return mResiduals;
+        }
+        /// Rms of residuals of kept points, arcsec, 0 with 3 points
+        double rms() const
+        {
+            return mRms;
+        }
+        /// Index of the rejected point, -1 if none
+        int rejected() const
+        {
+            return mRejected;
+        }
+        /// Degrees of freedom left for the error estimate
+        int dof() const
+        {
+            return mDof;
+        }
+        /// Axis standard error : direction i (unit, orthogonal to axis) and sigma (radians)
+        const Rotations::V3 &errorDirection(int i) const
+        {
+            return mErrorDir[i];
+        }
+        double errorSigma(int i) const
+        {
+            return mErrorSigma[i];
+        }
+
+    private:
+        bool fit(const QList<Rotations::V3> &points);
+
+        QList<Rotations::V3> mPoints;
+        Rotations::V3 mAxis;
+        double mOffset = 0;
+        double mCircle = 1;
+        double mEigen[3] = {0, 0, 0};
+        Rotations::V3 mVectors[3];
+        QList<double> mResiduals;
+        double mRms = 0;
+        int mRejected = -1;
+        int mDof = 0;
+        Rotations::V3 mErrorDir[2];
+        double mErrorSigma[2] = {0, 0};
+};
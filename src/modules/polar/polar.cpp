@@ -1,5 +1,8 @@
 #include "polar.h"
 #include "rotations.h"
+#include "axisfit.h"
+#include <algorithm>
+#include <cmath>
 #include <QPainter>
 #include "versionModule.cc"
 
@@ -121,7 +124,8 @@ void Polar::newBLOB(INDI::PropertyBlob  bp)
         (QString(bp.getDeviceName()) == getString("devices", "camera")) && (_machine.isRunning())
     )
     {
-        delete image;
+        // frames waiting for the solver belong to the queue
+        if (image != mSolveImage) delete image;
         image = new fileio();
         image->loadBlob(bp, 64);
         QImage rawImage = image->getRawQImage();
@@ -147,19 +151,23 @@ void Polar::buildStateMachine(void)
     auto *RequestExposure      = new QState(Polar);
     auto *WaitExposure         = new QState(Polar);
     auto *FindStars            = new QState(Polar);
-    auto *Compute              = new QState(Polar);
+    auto *WaitSolves           = new QState(Polar);
     auto *RequestMove          = new QState(Polar);
     auto *WaitMove             = new QState(Polar);
     auto *FinalCompute         = new QState(Polar);
+    auto *RefineExposure       = new QState(Polar);
+    auto *RefineWait           = new QState(Polar);
+    auto *RefineTrack          = new QState(Polar);
 
     connect(InitInit, &QState::entered, this, &Polar::SMInit);
     connect(RequestFrameReset, &QState::entered, this, &Polar::SMRequestFrameReset);
     connect(RequestExposure, &QState::entered, this, &Polar::SMRequestExposure);
     connect(RequestMove, &QState::entered, this, &Polar::SMRequestMove);
     connect(FindStars, &QState::entered, this, &Polar::SMFindStars);
-    connect(Compute, &QState::entered, this, &Polar::SMCompute);
     connect(FinalCompute, &QState::entered, this, &Polar::SMComputeFinal);
     connect(Abort,               &QState::entered, this, &Polar::SMAbort);
+    connect(RefineExposure, &QState::entered, this, &Polar::SMRefineExposure);
+    connect(RefineTrack, &QState::entered, this, &Polar::SMRefineTrack);
 
     Polar->               addTransition(this, &Polar::Abort, Abort);
     Abort->               addTransition(this, &Polar::AbortDone, End);
@@ -169,12 +177,17 @@ void Polar::buildStateMachine(void)
     WaitFrameReset->      addTransition(this, &Polar::FrameResetDone, RequestExposure);
     RequestExposure->     addTransition(this, &Polar::RequestExposureDone, WaitExposure);
     WaitExposure->        addTransition(this, &Polar::ExposureDone, FindStars);
-    FindStars->           addTransition(this, &Polar::FindStarsDone, Compute);
-    Compute->             addTransition(this, &Polar::ComputeDone, RequestMove);
-    Compute->             addTransition(this, &Polar::PolarDone, FinalCompute);
+    // slew to the next point starts as soon as a frame is downloaded, solving runs meanwhile
+    FindStars->           addTransition(this, &Polar::ComputeDone, RequestMove);
+    FindStars->           addTransition(this, &Polar::PolarDone, WaitSolves);
+    WaitSolves->          addTransition(this, &Polar::FindStarsDone, FinalCompute);
     RequestMove->         addTransition(this, &Polar::RequestMoveDone, WaitMove);
     WaitMove->            addTransition(this, &Polar::MoveDone, RequestExposure);
     FinalCompute->        addTransition(this, &Polar::ComputeFinalDone, End);
+    FinalCompute->        addTransition(this, &Polar::RefineStart, RefineExposure);
+    RefineExposure->      addTransition(this, &Polar::RequestExposureDone, RefineWait);
+    RefineWait->          addTransition(this, &Polar::ExposureDone, RefineTrack);
+    RefineTrack->         addTransition(this, &Polar::RefineDone, RefineExposure);
 
     Polar->setInitialState(InitInit);
 
@@ -236,6 +249,11 @@ void Polar::SMInit()
     }
 
     _itt = 0;
+    mSolved = 0;
+    mPointCount = std::max(3, getInt("measure", "points"));
+    mSolvedPoints.clear();
+    clearSolveQueue();
+    mRefining = false;
     _ra0 = 0;
     _de0 = 0;
     _t0 = 0;
@@ -282,7 +300,7 @@ void Polar::SMRequestExposure()
     getEltLight("states", "idle")->setValue(OST::Idle, false);
     getEltLight("states", "moving")->setValue(OST::Idle, false);
     getEltLight("states", "shooting")->setValue(OST::Busy, false);
-    getEltLight("states", "solving")->setValue(OST::Idle, false);
+    getEltLight("states", "solving")->setValue(mSolveImage != nullptr ? OST::Busy : OST::Idle, false);
     getEltLight("states", "compute")->setValue(OST::Idle, true);
 
     double t = QDateTime::currentDateTime().currentMSecsSinceEpoch();
@@ -314,7 +332,7 @@ void Polar::SMRequestMove()
     getEltLight("states", "idle")->setValue(OST::Idle, false);
     getEltLight("states", "moving")->setValue(OST::Busy, false);
     getEltLight("states", "shooting")->setValue(OST::Idle, false);
-    getEltLight("states", "solving")->setValue(OST::Idle, false);
+    getEltLight("states", "solving")->setValue(mSolveImage != nullptr ? OST::Busy : OST::Idle, false);
     getEltLight("states", "compute")->setValue(OST::Idle, true);
 
     sendMessage("SMRequestMove");
@@ -330,14 +348,15 @@ void Polar::SMRequestMove()
     }
     sendMessage("SMRequestMove oldRA=" + QString::number(oldRA));
 
+    double step = getFloat("measure", "step");
     if (_mountPointingWest)
     {
-        newRA = oldRA - 0.25;
+        newRA = oldRA - step;
         if (newRA < 0) newRA = newRA + 24;
     }
     else
     {
-        newRA = oldRA + +0.25;
+        newRA = oldRA + step;
         if (newRA >= 24) newRA = newRA - 24;
     }
 
@@ -351,14 +370,9 @@ void Polar::SMRequestMove()
     emit RequestMoveDone();
 
 }
-void Polar::SMCompute()
+void Polar::SMCompute(int point)
 {
-    sendMessage("SMCompute");
-    getEltLight("states", "idle")->setValue(OST::Idle, false);
-    getEltLight("states", "moving")->setValue(OST::Idle, false);
-    getEltLight("states", "shooting")->setValue(OST::Idle, false);
-    getEltLight("states", "solving")->setValue(OST::Idle, false);
-    getEltLight("states", "compute")->setValue(OST::Busy, true);
+    sendMessage("SMCompute " + QString::number(point));
 
     INDI::IEquatorialCoordinates coord2000, coordNow;
     coordNow.rightascension = _solver.stellarSolver.getSolution().ra * 24 / 360;
@@ -367,14 +381,15 @@ void Polar::SMCompute()
     //coord2000.rightascension=_solver.stellarSolver.getSolution().ra;
     //coord2000.declination=_solver.stellarSolver.getSolution().dec;
 
-    OST::ImgData dta = image->ImgStats();
-    dta.starsCount = _solver.stars.size();
-    dta.solverRA = _solver.stellarSolver.getSolution().ra;
-    dta.solverDE = _solver.stellarSolver.getSolution().dec;
-    dta.isSolved = true;
-    getEltImg("image", "image")->setValue(dta, true);
+    mSolvedPoints.append(QPointF(_solver.stellarSolver.getSolution().ra, _solver.stellarSolver.getSolution().dec));
+    if (point == mPointCount - 1)
+    {
+        // last point is where the mount stays : reference for live refinement
+        mAnchorPlate = currentPlate();
+        mTracker.setReference(_solver.stars);
+    }
 
-    if (_itt == 0)
+    if (point == 0)
     {
         //INDI::ObservedToJ2000(&coordNow,_t0,&coord2000);
         //_ra0=coord2000.rightascension;
@@ -385,7 +400,7 @@ void Polar::SMCompute()
         sendMessage("de0=" + QString::number(_de0));
 
     }
-    if (_itt == 1)
+    if (point == 1)
     {
         //INDI::ObservedToJ2000(&coordNow,_t1,&coord2000);
         //_ra1=coord2000.rightascension;
@@ -395,7 +410,7 @@ void Polar::SMCompute()
         sendMessage("ra1=" + QString::number(_ra1));
         sendMessage("de1=" + QString::number(_de1));
     }
-    if (_itt == 2)
+    if (point == 2)
     {
         //INDI::ObservedToJ2000(&coordNow,_t2,&coord2000);
         //_ra2=coord2000.rightascension;
@@ -416,10 +431,6 @@ void Polar::SMCompute()
     getEltFloat("values", "de2")->setValue(_de2, false);
     getEltFloat("values", "t2")->setValue(_t2, true);
 
-    _itt++;
-    if (_itt < 3) emit ComputeDone();
-    else emit PolarDone();
-
 }
 void Polar::SMComputeFinal()
 {
@@ -444,21 +455,27 @@ void Polar::SMComputeFinal()
     BOOST_LOG_TRIVIAL(debug) << "SMComputeFinal DRA1-0 = " << dra1;
     BOOST_LOG_TRIVIAL(debug) << "SMComputeFinal DRA2-0 = " << dra2;*/
 
-    Rotations::V3 p0(Rotations::azAlt2xyz(QPointF(_ra0, _de0)));
-    Rotations::V3 p1(Rotations::azAlt2xyz(QPointF(_ra1, _de1)));
-    Rotations::V3 p2(Rotations::azAlt2xyz(QPointF(_ra2, _de2)));
     //Rotations::V3 p0(Rotations::haDec2xyz(QPointF(_ra0, _de0),0));
     //Rotations::V3 p1(Rotations::haDec2xyz(QPointF(_ra1, _de1),0));
     //Rotations::V3 p2(Rotations::haDec2xyz(QPointF(_ra2, _de2),0));
-    Rotations::V3 axis = Rotations::getAxis(p0, p1, p2);
-
-    if (axis.length() < 0.9)
+    AxisFit fit;
+    for (const QPointF &point : mSolvedPoints)
     {
-        // It failed to normalize the vector, something's wrong.
-        sendWarning("Normal vector too short. findAxis failed.");
+        fit.addPoint(Rotations::azAlt2xyz(point));
+    }
+    if (!fit.solve())
+    {
+        // Points don't define a plane, something's wrong.
+        sendWarning("Axis fit failed on " + QString::number(fit.count()) + " points.");
         emit Abort();
         return;
     }
+    Rotations::V3 axis = fit.axis();
+    if (fit.rejected() >= 0)
+    {
+        sendWarning(QString("Point %1 rejected, %2'' off the others").arg(fit.rejected() + 1)
+                    .arg(fit.residuals()[fit.rejected()], 0, 'f', 0));
+    }
 
     // Need to make sure we're pointing to the right pole.
     //if ((northernHemisphere() && (axis.x() < 0)) || (!northernHemisphere() && axis.x() > 0))
@@ -466,26 +483,8 @@ void Polar::SMComputeFinal()
     {
         axis = Rotations::V3(-axis.x(), -axis.y(), -axis.z());
     }
-
-    //BOOST_LOG_TRIVIAL(debug) << "axis.x() " << axis.x();
-    //BOOST_LOG_TRIVIAL(debug) << "axis.y() " << axis.y();
-    //BOOST_LOG_TRIVIAL(debug) << "axis.z() " << axis.z();
-    QPointF azAlt = Rotations::xyz2azAlt(axis);
-    //azimuthCenter = azAlt.x();
-    //altitudeCenter = azAlt.y();
-    _erraz = azAlt.x();
-    _erralt = 90 - azAlt.y();
-    //_erralt=azAlt.y();
-    _errtot = sqrt(square(_erraz) + square(_erralt));
-    //BOOST_LOG_TRIVIAL(debug) << "azimuthCenter "  << _erraz;
-    //BOOST_LOG_TRIVIAL(debug) << "altitudeCenter " << _erralt;
-    //BOOST_LOG_TRIVIAL(debug) << "PA error °"       << _errtot;
-    qDebug() << _erraz;
-    qDebug() << _erralt;
-    qDebug() << _errtot;
-    getEltFloat("errors", "erraz")->setValue(_erraz, false);
-    getEltFloat("errors", "erralt")->setValue(_erralt, false);
-    getEltFloat("errors", "errtot")->setValue(_errtot, true);
+    setErrors(axis);
+    setConfidence(fit, axis);
 
     getEltLight("states", "idle")->setValue(OST::Idle, false);
     getEltLight("states", "moving")->setValue(OST::Idle, false);
@@ -493,59 +492,162 @@ void Polar::SMComputeFinal()
     getEltLight("states", "solving")->setValue(OST::Idle, false);
     getEltLight("states", "compute")->setValue(OST::Busy, true);
 
+    if (getBool("refine", "enabled"))
+    {
+        sendMessage("Live refinement : adjust alt/az knobs, abort when done");
+        mRefiner.setAnchor(axis, mAnchorPlate);
+        mRefineFrame = 0;
+        mRefineLost = false;
+        mRefining = true;
+        emit RefineStart();
+        return;
+    }
+
     emit ComputeFinalDone();
     return;
 
 }
 void Polar::SMFindStars()
 {
-
-    getEltLight("states", "idle")->setValue(OST::Idle, false);
-    getEltLight("states", "moving")->setValue(OST::Idle, false);
-    getEltLight("states", "shooting")->setValue(OST::Idle, false);
-    getEltLight("states", "solving")->setValue(OST::Busy, false);
-    getEltLight("states", "compute")->setValue(OST::Idle, true);
-
     sendMessage("SMFindStars");
 
-    /* get mount DEC */
-    if (!getModNumber(getString("devices", "mount"), "EQUATORIAL_EOD_COORD", "DEC", _mountDEC))
+    /* mount position of this frame, before next slew */
+    PendingFrame frame;
+    if (!getModNumber(getString("devices", "mount"), "EQUATORIAL_EOD_COORD", "DEC", frame.mountDEC))
     {
         emit Abort();
         return;
     }
-
-    /* get mount RA */
-    if (!getModNumber(getString("devices", "mount"), "EQUATORIAL_EOD_COORD", "RA", _mountRA))
+    if (!getModNumber(getString("devices", "mount"), "EQUATORIAL_EOD_COORD", "RA", frame.mountRA))
     {
         emit Abort();
         return;
     }
+    frame.point = _itt;
+    // the queue owns the frame from now on
+    frame.image = image;
+    image = nullptr;
+    mPending.append(frame);
+    if (mSolveImage == nullptr) solveNext();
 
-    mStats = image->getStats();
-    _solver.ResetSolver(mStats, image->getImageBuffer());
+    _itt++;
+    if (_itt < mPointCount) emit ComputeDone();
+    else emit PolarDone();
+}
+void Polar::solveNext()
+{
+    // already solving (deferred call racing with a new frame)
+    if (mPending.isEmpty() || mSolveImage != nullptr) return;
+    const PendingFrame &frame = mPending.first();
+
+    getEltLight("states", "solving")->setValue(OST::Busy, true);
+    mSolveImage = frame.image;
+    mStats = mSolveImage->getStats();
+    _mountRA = frame.mountRA;
+    _mountDEC = frame.mountDEC;
+
+    // first point around mount position, next ones around previous solution moved by the mount RA change
+    mSolveHinted = true;
+    if (frame.point == 0)
+    {
+        mHintRA = _mountRA * 360 / 24;
+        mHintDEC = _mountDEC;
+        mHintRadius = getFloat("solver", "mountradius");
+    }
+    else
+    {
+        // shortest way across 0h/24h
+        double deltaRA = std::remainder((_mountRA - mPrevMountRA) * 360 / 24, 360);
+        if (deltaRA == -180) deltaRA = 180;
+        mHintRA = std::fmod(mSolvedPoints.last().x() + deltaRA + 360, 360);
+        mHintDEC = mSolvedPoints.last().y();
+        mHintRadius = getFloat("solver", "predictradius");
+    }
+    mPrevMountRA = _mountRA;
+
+    connect(&_solver, &Solver::successSolve, this, &Polar::OnSucessSolve);
+    connect(&_solver, &Solver::solverLog, this, &Polar::OnSolverLog);
+    startSolve();
+}
+void Polar::clearSolveQueue()
+{
+    // the solver must be done with the buffers before they are freed
+    if (!mPending.isEmpty() && mSolveImage == mPending.first().image) stopSolver();
+    for (const PendingFrame &frame : mPending)
+    {
+        delete frame.image;
+    }
+    mPending.clear();
+    mSolveImage = nullptr;
+}
+void Polar::startSolve()
+{
+    // deferred retry after an abort
+    if (mSolveImage == nullptr) return;
+    _solver.ResetSolver(mStats, mSolveImage->getImageBuffer());
     QStringList folders;
     folders.append("/usr/share/astrometry");
     _solver.stellarSolver.setIndexFolderPaths(folders);
-    connect(&_solver, &Solver::successSolve, this, &Polar::OnSucessSolve);
-    connect(&_solver, &Solver::solverLog, this, &Polar::OnSolverLog);
     _solver.stars.clear();
     SSolver::Parameters params = _solver.stellarSolverProfiles[0];
-    params.minwidth = 0.1 * _ccdFov / 3600;
-    params.maxwidth = 1.1 * _ccdFov / 3600;
-    params.search_radius = 2;
-    //BOOST_LOG_TRIVIAL(debug) << "minwidth " << params.minwidth;
-    //BOOST_LOG_TRIVIAL(debug) << "maxidth " << params.maxwidth;
-    //_solver.setSearchScale(0.1*_ccdFov/3600,1.1*_ccdFov/3600,ScaleUnits::DEG_WIDTH);
-    //_solver.setSearchPositionInDegrees(_mountRA*360/24,_mountDEC);
-    _solver.stellarSolver.setSearchPositionInDegrees(_mountRA * 360 / 24, _mountDEC);
+    if (mSolveHinted)
+    {
+        // pixel scale is known from camera and optic, position is predicted
+        double tolerance = getFloat("solver", "scaletolerance") / 100;
+        _solver.stellarSolver.setSearchScale(_ccdSampling * (1 - tolerance), _ccdSampling * (1 + tolerance),
+                                             SSolver::ARCSEC_PER_PIX);
+        params.search_radius = mHintRadius;
+        _solver.stellarSolver.setSearchPositionInDegrees(mHintRA, mHintDEC);
+    }
+    else
+    {
+        _solver.stellarSolver.setProperty("UseScale", false);
+        params.minwidth = 0.1 * _ccdFov / 3600;
+        params.maxwidth = 1.1 * _ccdFov / 3600;
+        params.search_radius = getFloat("solver", "wideradius");
+        _solver.stellarSolver.setSearchPositionInDegrees(_mountRA * 360 / 24, _mountDEC);
+    }
+
+    disconnect(mSolveFinished);
+    mSolveFinished = connect(&_solver.stellarSolver, &StellarSolver::finished, this, &Polar::OnSolveFinished);
+    mSolveTimer.start();
     _solver.SolveStars(params);
 }
+void Polar::OnSolveFinished()
+{
+    disconnect(mSolveFinished);
+    if (!_solver.stellarSolver.failed())
+    {
+        sendMessage(QString("Solved in %1 ms").arg(mSolveTimer.elapsed()) + (mSolveHinted ? "" : " (wide search)"));
+        return;
+    }
+    if (mSolveHinted && getBool("solver", "fallback"))
+    {
+        sendWarning("Hinted solve failed, retrying with wide search");
+        mSolveHinted = false;
+        // not from within the solver's own signal
+        QTimer::singleShot(0, this, &Polar::startSolve);
+        return;
+    }
+
+    sendWarning("Solve failed");
+    disconnect(&_solver, &Solver::successSolve, this, &Polar::OnSucessSolve);
+    disconnect(&_solver, &Solver::successSolve, this, &Polar::OnRefineSolve);
+    disconnect(&_solver, &Solver::solverLog, this, &Polar::OnSolverLog);
+    if (mRefining)
+    {
+        mSolveImage = nullptr;
+        mRefineLost = true;
+        emit RefineDone();
+        return;
+    }
+    emit Abort();
+}
 void Polar::OnSucessSolve()
 {
 
     sendMessage("SEP finished");
-    OST::ImgData dta = image->ImgStats();
+    OST::ImgData dta = mSolveImage->ImgStats();
     dta.mUrlJpeg = getModuleName() + ".jpeg";
     dta.starsCount = _solver.stars.size();
     dta.solverRA = _solver.stellarSolver.getSolution().ra;
@@ -555,14 +657,38 @@ void Polar::OnSucessSolve()
 
     disconnect(&_solver, &Solver::successSolve, this, &Polar::OnSucessSolve);
     disconnect(&_solver, &Solver::solverLog, this, &Polar::OnSolverLog);
-    emit FindStarsDone();
+    getEltLight("states", "solving")->setValue(OST::Idle, true);
+
+    PendingFrame frame = mPending.takeFirst();
+    SMCompute(frame.point);
+    delete frame.image;
+    mSolveImage = nullptr;
+
+    // join : final computation once every point is solved
+    mSolved++;
+    if (mSolved == mPointCount) emit FindStarsDone();
+    // not from within the solver's own signal
+    else QTimer::singleShot(0, this, &Polar::solveNext);
 }
 void Polar::OnSolverLog(QString &text)
 {
     //sendMessage(text);
 }
+void Polar::stopSolver()
+{
+    disconnect(&_solver, &Solver::successSolve, this, &Polar::OnSucessSolve);
+    disconnect(&_solver, &Solver::successSolve, this, &Polar::OnRefineSolve);
+    disconnect(&_solver, &Solver::successSEP, this, &Polar::OnRefineSEP);
+    disconnect(&_solver, &Solver::solverLog, this, &Polar::OnSolverLog);
+    disconnect(mSolveFinished);
+    // the frame it reads (queued point or refine frame) is freed right after
+    if (_solver.stellarSolver.isRunning()) _solver.stellarSolver.abortAndWait();
+}
 void Polar::SMAbort()
 {
+    stopSolver();
+    clearSolveQueue();
+    mSolveImage = nullptr;
     emit AbortDone();
     _machine.stop();
     getEltLight("states", "idle")->setValue(OST::Idle, false);
@@ -572,3 +698,135 @@ void Polar::SMAbort()
     getEltLight("states", "compute")->setValue(OST::Idle, true);
 
 }
+void Polar::setErrors(Rotations::V3 axis)
+{
+    QPointF azAlt = Rotations::xyz2azAlt(axis);
+    _erraz = azAlt.x();
+    _erralt = 90 - azAlt.y();
+    _errtot = sqrt(square(_erraz) + square(_erralt));
+    getEltFloat("errors", "erraz")->setValue(_erraz, false);
+    getEltFloat("errors", "erralt")->setValue(_erralt, false);
+    getEltFloat("errors", "errtot")->setValue(_errtot, true);
+}
+PolarRefiner::Plate Polar::currentPlate()
+{
+    PolarRefiner::Plate plate;
+    FITSImage::Solution solution = _solver.stellarSolver.getSolution();
+    plate.ra = solution.ra;
+    plate.dec = solution.dec;
+    plate.orientation = solution.orientation;
+    plate.pixscale = solution.pixscale;
+    plate.flipped = solution.parity == FITSImage::NEGATIVE;
+    plate.width = mStats.width;
+    plate.height = mStats.height;
+    return plate;
+}
+void Polar::SMRefineExposure()
+{
+    getEltLight("states", "idle")->setValue(OST::Idle, false);
+    getEltLight("states", "moving")->setValue(OST::Idle, false);
+    getEltLight("states", "shooting")->setValue(OST::Busy, false);
+    getEltLight("states", "solving")->setValue(OST::Idle, false);
+    getEltLight("states", "compute")->setValue(OST::Idle, true);
+
+    if (!requestCapture(getString("devices", "camera"), getFloat("refine", "exposure"), getInt("parms", "gain"),
+                        getInt("parms", "offset")))
+    {
+        emit Abort();
+        return;
+    }
+    emit RequestExposureDone();
+}
+void Polar::SMRefineTrack()
+{
+    getEltLight("states", "shooting")->setValue(OST::Idle, false);
+    getEltLight("states", "solving")->setValue(OST::Busy, true);
+
+    mStats = image->getStats();
+    mRefineFrame++;
+    int resolve = getInt("refine", "resolve");
+    if (mRefineLost || !mTracker.hasReference() || (resolve > 0 && mRefineFrame % resolve == 0))
+    {
+        // full solve re-anchors the estimate, field moved by the user's adjustments only
+        mSolveHinted = true;
+        mHintRA = mAnchorPlate.ra;
+        mHintDEC = mAnchorPlate.dec;
+        mHintRadius = getFloat("solver", "mountradius");
+        mSolveImage = image;
+        connect(&_solver, &Solver::successSolve, this, &Polar::OnRefineSolve);
+        connect(&_solver, &Solver::solverLog, this, &Polar::OnSolverLog);
+        startSolve();
+        return;
+    }
+    _solver.ResetSolver(mStats, image->getImageBuffer());
+    connect(&_solver, &Solver::successSEP, this, &Polar::OnRefineSEP);
+    _solver.FindStars(_solver.stellarSolverProfiles[0]);
+}
+void Polar::OnRefineSEP()
+{
+    disconnect(&_solver, &Solver::successSEP, this, &Polar::OnRefineSEP);
+    getEltLight("states", "solving")->setValue(OST::Idle, true);
+
+    QList<StarTracker::Match> matches;
+    if (mTracker.track(_solver.stars, matches) && mRefiner.update(matches))
+    {
+        setErrors(mRefiner.axis());
+        getEltInt("live", "frame")->setValue(mRefineFrame, false);
+        getEltInt("live", "stars")->setValue(matches.size(), false);
+        getEltFloat("live", "rotation")->setValue(mRefiner.rotation(), true);
+    }
+    else
+    {
+        sendWarning("Star field lost, full solve on next frame");
+        mRefineLost = true;
+    }
+    emit RefineDone();
+}
+void Polar::OnRefineSolve()
+{
+    mSolveImage = nullptr;
+    disconnect(&_solver, &Solver::successSolve, this, &Polar::OnRefineSolve);
+    disconnect(&_solver, &Solver::solverLog, this, &Polar::OnSolverLog);
+    getEltLight("states", "solving")->setValue(OST::Idle, true);
+
+    if (mRefiner.reanchor(currentPlate()))
+    {
+        mAnchorPlate = currentPlate();
+        mTracker.setReference(_solver.stars);
+        mRefineLost = false;
+        setErrors(mRefiner.axis());
+        getEltInt("live", "frame")->setValue(mRefineFrame, false);
+        getEltInt("live", "stars")->setValue(_solver.stars.size(), false);
+        getEltFloat("live", "rotation")->setValue(mRefiner.rotation(), true);
+    }
+    emit RefineDone();
+}
+void Polar::setConfidence(const AxisFit &fit, const Rotations::V3 &axis)
+{
+    // 95% interval : Student t on the fit degrees of freedom, axis standard error projected on az/alt errors
+    static const double student[] = {0, 12.71, 4.30, 3.18, 2.78, 2.57, 2.45, 2.36, 2.31, 2.26, 2.23};
+    double ciaz = 99;
+    double cialt = 99;
+    if (fit.dof() > 0)
+    {
+        double t = fit.dof() <= 10 ? student[fit.dof()] : 2;
+        QPointF center = Rotations::xyz2azAlt(axis);
+        double varaz = 0;
+        double varalt = 0;
+        for (int i = 0; i < 2; i++)
+        {
+            const Rotations::V3 &e = fit.errorDirection(i);
+            double k = fit.errorSigma(i);
+            QPointF moved = Rotations::xyz2azAlt(Rotations::V3(axis.x() + k * e.x(), axis.y() + k * e.y(), axis.z() + k * e.z()));
+            double daz = std::remainder(moved.x() - center.x(), 360);
+            varaz += daz * daz;
+            varalt += (moved.y() - center.y()) * (moved.y() - center.y());
+        }
+        ciaz = t * sqrt(varaz);
+        cialt = t * sqrt(varalt);
+    }
+    getEltFloat("errors", "ciaz")->setValue(ciaz, false);
+    getEltFloat("errors", "cialt")->setValue(cialt, false);
+    getEltFloat("errors", "rms")->setValue(fit.rms(), false);
+    getEltInt("errors", "rejected")->setValue(fit.rejected() + 1, true);
+}
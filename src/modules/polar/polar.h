@@ -3,6 +3,10 @@
 #include <indimodule.h>
 #include <fileio.h>
 #include <solver.h>
+#include "refiner.h"
+#include "startracker.h"
+
+class AxisFit;
 
 #if defined(POLAR_MODULE)
 #  define MODULE_INIT Q_DECL_EXPORT
@@ -39,12 +43,17 @@ class MODULE_INIT Polar : public IndiModule
         void PolarDone();
         void RequestMoveDone();
         void MoveDone();
+        void RefineStart();
+        void RefineDone();
 
 
     public slots:
         void OnMyExternalEvent(const QString &pEventType, const QString  &pEventModule, const QString  &pEventKey,
                                const QVariantMap &pEventData) override;
         void OnSucessSolve();
+        void OnRefineSEP();
+        void OnRefineSolve();
+        void OnSolveFinished();
         void OnSolverLog(QString &text);
     private:
         void updateProperty(INDI::Property property) override;
@@ -91,6 +100,35 @@ class MODULE_INIT Polar : public IndiModule
         double _errtot = 0;
         int _itt = 0;
 
+        // downloaded frames waiting for the solver, first one is being solved
+        struct PendingFrame
+        {
+            fileio *image = nullptr;
+            int point = 0;
+            double mountRA = 0;
+            double mountDEC = 0;
+        };
+        QList<PendingFrame> mPending;
+        fileio *mSolveImage = nullptr;
+        int mSolved = 0;
+        int mPointCount = 3;
+        QList<QPointF> mSolvedPoints;
+
+        PolarRefiner mRefiner;
+        PolarRefiner::Plate mAnchorPlate;
+        StarTracker mTracker;
+        int mRefineFrame = 0;
+        bool mRefineLost = false;
+        bool mRefining = false;
+
+        bool mSolveHinted = true;
+        double mHintRA = 0;
+        double mHintDEC = 0;
+        double mHintRadius = 2;
+        double mPrevMountRA = 0;
+        QElapsedTimer mSolveTimer;
+        QMetaObject::Connection mSolveFinished;
+
 
         QString _camera  = "CCD Simulator";
         QString _mount  = "Telescope Simulator";
@@ -105,11 +143,20 @@ class MODULE_INIT Polar : public IndiModule
         void SMInit();
         void SMRequestExposure();
         void SMFindStars();
-        void SMCompute();
+        void SMCompute(int point);
         void SMComputeFinal();
         void SMRequestFrameReset();
         void SMRequestMove();
         void SMAbort();
+        void SMRefineExposure();
+        void SMRefineTrack();
+        void solveNext();
+        void stopSolver();
+        void clearSolveQueue();
+        void startSolve();
+        void setErrors(Rotations::V3 axis);
+        void setConfidence(const AxisFit &fit, const Rotations::V3 &axis);
+        PolarRefiner::Plate currentPlate();
 };
 
 extern "C" MODULE_INIT Polar *initialize(QString name, QString label, QString profile,
@@ -0,0 +1,143 @@
+#include "refiner.h"
+
+#include <cmath>
+
+namespace
+{
+using Rotations::V3;
+
+V3 add(const V3 &a, const V3 &b, double k = 1)
+{
+    return V3(a.x() + k * b.x(), a.y() + k * b.y(), a.z() + k * b.z());
+}
+double dot(const V3 &a, const V3 &b)
+{
+    return a.x() * b.x() + a.y() * b.y() + a.z() * b.z();
+}
+V3 cross(const V3 &a, const V3 &b)
+{
+    return V3(a.y() * b.z() - a.z() * b.y(), a.z() * b.x() - a.x() * b.z(), a.x() * b.y() - a.y() * b.x());
+}
+V3 normalized(V3 v)
+{
+    double l = v.length();
+    return l > 0 ? V3(v.x() / l, v.y() / l, v.z() / l) : v;
+}
+// rotation vector (radians) applied to v
+V3 rotate(const V3 &v, const V3 &w)
+{
+    double angle = V3(w).length();
+    if (angle == 0) return v;
+    return Rotations::rotateAroundAxis(v, normalized(w), Rotations::r2d(angle));
+}
+}
+
+void PolarRefiner::setAnchor(const Rotations::V3 &axis, const Plate &plate)
+{
+    mAnchorAxis = axis;
+    mAxis = axis;
+    mPlate = plate;
+    mRotation = 0;
+}
+
+Rotations::V3 PolarRefiner::pixelToSky(const Plate &plate, const QPointF &pixel) const
+{
+    V3 p = Rotations::azAlt2xyz(QPointF(plate.ra, plate.dec));
+    // local north and east (direction of increasing RA) at plate center
+    V3 north = normalized(add(V3(0, 0, 1), p, -p.z()));
+    V3 east = normalized(cross(p, V3(0, 0, 1)));
+    double o = Rotations::d2r(plate.orientation);
+    V3 up = add(V3(north.x() * cos(o), north.y() * cos(o), north.z() * cos(o)), east, sin(o));
+    // not flipped : east is left when north is up
+    V3 right = add(V3(north.x() * sin(o), north.y() * sin(o), north.z() * sin(o)), east, -cos(o));
+    if (plate.flipped) right = V3(-right.x(), -right.y(), -right.z());
+
+    double scale = Rotations::d2r(plate.pixscale / 3600);
+    double u = (pixel.x() - plate.width / 2) * scale;
+    double v = -(pixel.y() - plate.height / 2) * scale;
+    return normalized(add(add(p, right, u), up, v));
+}
+
+bool PolarRefiner::fitRotation(QList<Rotations::V3> from, const QList<Rotations::V3> &to, Rotations::V3 &axis)
+{
+    // small rotation w with to ~ from + w x from, linearized least squares, refined twice
+    double total = 0;
+    for (int pass = 0; pass < 3; pass++)
+    {
+        double m[3][3] = {};
+        double b[3] = {};
+        for (int i = 0; i < from.size(); i++)
+        {
+            const V3 &s = from[i];
+            V3 d = add(to[i], s, -1);
+            // (s x)^T (s x) = I - s s^T for unit s, (s x)^T d = d x s
+            double sv[3] = {s.x(), s.y(), s.z()};
+            for (int r = 0; r < 3; r++)
+                for (int c = 0; c < 3; c++) m[r][c] += (r == c ? 1 : 0) - sv[r] * sv[c];
+            V3 ds = cross(s, d);
+            b[0] += ds.x();
+            b[1] += ds.y();
+            b[2] += ds.z();
+        }
+        // 3x3 solve, Cramer
+        double det = m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1])
+                     - m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0])
+                     + m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+        if (std::fabs(det) < 1e-18) return false;
+        double w[3];
+        for (int k = 0; k < 3; k++)
+        {
+            double mk[3][3];
+            for (int r = 0; r < 3; r++)
+                for (int c = 0; c < 3; c++) mk[r][c] = (c == k) ? b[r] : m[r][c];
+            w[k] = (mk[0][0] * (mk[1][1] * mk[2][2] - mk[1][2] * mk[2][1])
+                    - mk[0][1] * (mk[1][0] * mk[2][2] - mk[1][2] * mk[2][0])
+                    + mk[0][2] * (mk[1][0] * mk[2][1] - mk[1][1] * mk[2][0])) / det;
+        }
+        V3 wv(w[0], w[1], w[2]);
+        for (int i = 0; i < from.size(); i++) from[i] = rotate(from[i], wv);
+        axis = rotate(axis, wv);
+        total += wv.length();
+    }
+    mRotation = Rotations::r2d(total) * 3600;
+    return true;
+}
+
+bool PolarRefiner::reanchor(const Plate &plate)
+{
+    // same pixels through both plates : M maps old plate directions to new ones
+    QList<V3> before;
+    QList<V3> after;
+    for (int i = 0; i < 3; i++)
+    {
+        for (int j = 0; j < 3; j++)
+        {
+            QPointF pixel(plate.width * (1 + i) / 4, plate.height * (1 + j) / 4);
+            before.append(pixelToSky(mPlate, pixel));
+            after.append(pixelToSky(plate, pixel));
+        }
+    }
+    V3 axis = mAnchorAxis;
+    if (!fitRotation(before, after, axis)) return false;
+    mAnchorAxis = axis;
+    mAxis = axis;
+    mPlate = plate;
+    return true;
+}
+
+bool PolarRefiner::update(const QList<StarTracker::Match> &matches)
+{
+    if (matches.size() < StarTracker::MinMatches) return false;
+    QList<V3> from;
+    QList<V3> to;
+    for (const StarTracker::Match &m : matches)
+    {
+        // true sky direction of the star, and where the anchor plate would put it now
+        to.append(pixelToSky(mPlate, m.first));
+        from.append(pixelToSky(mPlate, m.second));
+    }
+    V3 axis = mAnchorAxis;
+    if (!fitRotation(from, to, axis)) return false;
+    mAxis = axis;
+    return true;
+}
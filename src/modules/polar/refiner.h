@@ -0,0 +1,67 @@
+/**
+ * @file refiner.h
+ * @brief Live update of the measured mount axis while the user adjusts alt/az knobs
+ *
+ * The camera is rigidly attached to the mount : any knob adjustment is a
+ * rotation M applied to both the camera and the RA axis. M is estimated from
+ * sky directions of the same stars seen through the anchor plate model
+ * (last full solve) before and after the adjustment, then applied to the
+ * anchor axis. Re-anchoring on a new full solve uses the same fit between
+ * the old and new plate models.
+ *
+ * Vectors use the Rotations conventions (RA in azimuth, DEC in altitude).
+ * Plate model is gnomonic : center, orientation (image up, degrees E of N),
+ * scale ("/px), parity.
+ */
+
+#pragma once
+
+#include <QList>
+#include <QPointF>
+#include "rotations.h"
+#include "startracker.h"
+
+class PolarRefiner
+{
+    public:
+        struct Plate
+        {
+            double ra = 0;          ///< degrees
+            double dec = 0;         ///< degrees
+            double orientation = 0; ///< degrees E of N
+            double pixscale = 1;    ///< arcsec per pixel
+            bool flipped = false;   ///< mirrored image
+            double width = 0;       ///< pixels
+            double height = 0;      ///< pixels
+        };
+
+        /// Start from the axis measured with plate as current camera pointing
+        void setAnchor(const Rotations::V3 &axis, const Plate &plate);
+        /// New full solve : move the anchor axis by the rotation between old and new plates
+        bool reanchor(const Plate &plate);
+        /// Live axis from stars matched between anchor frame and current frame
+        bool update(const QList<StarTracker::Match> &matches);
+
+        const Rotations::V3 &anchorAxis() const
+        {
+            return mAnchorAxis;
+        }
+        const Rotations::V3 &axis() const
+        {
+            return mAxis;
+        }
+        /// Rotation of the last update / reanchor, arcsec
+        double rotation() const
+        {
+            return mRotation;
+        }
+
+    private:
+        Rotations::V3 pixelToSky(const Plate &plate, const QPointF &pixel) const;
+        bool fitRotation(QList<Rotations::V3> from, const QList<Rotations::V3> &to, Rotations::V3 &axis);
+
+        Plate mPlate;
+        Rotations::V3 mAnchorAxis;
+        Rotations::V3 mAxis;
+        double mRotation = 0;
+};
@@ -0,0 +1,129 @@
+#include "startracker.h"
+
+#include <algorithm>
+#include <cmath>
+
+void StarTracker::setReference(const QList<FITSImage::Star> &stars)
+{
+    mReference = brightest(stars, maxStars);
+}
+
+QList<QPointF> StarTracker::brightest(const QList<FITSImage::Star> &stars, int count)
+{
+    QList<FITSImage::Star> sorted = stars;
+    std::sort(sorted.begin(), sorted.end(), [](const FITSImage::Star & a, const FITSImage::Star & b)
+    {
+        return a.flux > b.flux;
+    });
+    QList<QPointF> points;
+    for (int i = 0; i < sorted.size() && i < count; i++) points.append(QPointF(sorted[i].x, sorted[i].y));
+    return points;
+}
+
+bool StarTracker::track(const QList<FITSImage::Star> &stars, QList<Match> &matches)
+{
+    matches.clear();
+    if (!hasReference()) return false;
+    QList<QPointF> current = brightest(stars, maxStars);
+    if (current.size() < MinMatches) return false;
+
+    // translation : the pair offset most other pairs agree with
+    int bestVotes = 0;
+    double tx = 0;
+    double ty = 0;
+    for (const QPointF &r : mReference)
+    {
+        for (const QPointF &c : current)
+        {
+            double dx = c.x() - r.x();
+            double dy = c.y() - r.y();
+            int votes = 0;
+            for (const QPointF &r2 : mReference)
+            {
+                for (const QPointF &c2 : current)
+                {
+                    if (std::fabs(c2.x() - r2.x() - dx) < tolerance && std::fabs(c2.y() - r2.y() - dy) < tolerance)
+                    {
+                        votes++;
+                        break;
+                    }
+                }
+            }
+            if (votes > bestVotes)
+            {
+                bestVotes = votes;
+                tx = dx;
+                ty = dy;
+            }
+        }
+    }
+    if (bestVotes < MinMatches) return false;
+
+    double cosr = 1;
+    double sinr = 0;
+    for (int pass = 0; pass < 2; pass++)
+    {
+        matchWith(current, cosr, sinr, tx, ty, matches);
+        if (matches.size() < MinMatches) return false;
+        fitRigid(matches, cosr, sinr, tx, ty);
+    }
+
+    mShiftX = tx;
+    mShiftY = ty;
+    mRotation = std::atan2(sinr, cosr) * 180 / M_PI;
+    return true;
+}
+
+void StarTracker::matchWith(const QList<QPointF> &current, double cosr, double sinr, double tx, double ty,
+                            QList<Match> &matches) const
+{
+    matches.clear();
+    for (const QPointF &r : mReference)
+    {
+        double px = cosr * r.x() - sinr * r.y() + tx;
+        double py = sinr * r.x() + cosr * r.y() + ty;
+        int best = -1;
+        double bestDist = tolerance * tolerance;
+        for (int j = 0; j < current.size(); j++)
+        {
+            double d = (current[j].x() - px) * (current[j].x() - px) + (current[j].y() - py) * (current[j].y() - py);
+            if (d < bestDist)
+            {
+                bestDist = d;
+                best = j;
+            }
+        }
+        if (best >= 0) matches.append(Match(r, current[best]));
+    }
+}
+
+void StarTracker::fitRigid(const QList<Match> &matches, double &cosr, double &sinr, double &tx, double &ty)
+{
+    // 2D Procrustes : rotation from centered cross products, then translation
+    double rx = 0, ry = 0, cx = 0, cy = 0;
+    for (const Match &m : matches)
+    {
+        rx += m.first.x();
+        ry += m.first.y();
+        cx += m.second.x();
+        cy += m.second.y();
+    }
+    rx /= matches.size();
+    ry /= matches.size();
+    cx /= matches.size();
+    cy /= matches.size();
+
+    double sxx = 0, sxy = 0;
+    for (const Match &m : matches)
+    {
+        double ax = m.first.x() - rx, ay = m.first.y() - ry;
+        double bx = m.second.x() - cx, by = m.second.y() - cy;
+        sxx += ax * bx + ay * by;
+        sxy += ax * by - ay * bx;
+    }
+    double angle = std::atan2(sxy, sxx);
+    cosr = std::cos(angle);
+    sinr = std::sin(angle);
+    tx = cx - (cosr * rx - sinr * ry);
+    ty = cy - (sinr * rx + cosr * ry);
+}
@@ -0,0 +1,61 @@
+/**
+ * @file startracker.h
+ * @brief Frame to frame star matching for live polar refinement
+ *
+ * The brightest stars of a frame are matched against a reference frame :
+ * translation is found by voting over all pair offsets, then pairs are
+ * refined with a rigid (rotation + translation) least squares fit and
+ * rematched once. Good for the small shifts and rotations produced by
+ * turning the alt/az knobs between two short exposures.
+ */
+
+#pragma once
+
+#include <QList>
+#include <QPointF>
+#include <QPair>
+#include <solver.h>
+
+class StarTracker
+{
+    public:
+        typedef QPair<QPointF, QPointF> Match;
+
+        void setReference(const QList<FITSImage::Star> &stars);
+        bool hasReference() const
+        {
+            return mReference.size() >= MinMatches;
+        }
+        /// Match stars with the reference, false if not enough stars agree
+        bool track(const QList<FITSImage::Star> &stars, QList<Match> &matches);
+
+        /// Rigid transform of the last successful track, reference -> current, pixels and degrees
+        double shiftX() const
+        {
+            return mShiftX;
+        }
+        double shiftY() const
+        {
+            return mShiftY;
+        }
+        double rotation() const
+        {
+            return mRotation;
+        }
+
+        static const int MinMatches = 4;
+        /// Stars used on each side
+        int maxStars = 30;
+        /// Match radius, pixels
+        double tolerance = 4;
+
+    private:
+        static QList<QPointF> brightest(const QList<FITSImage::Star> &stars, int count);
+        void matchWith(const QList<QPointF> &current, double cosr, double sinr, double tx, double ty, QList<Match> &matches) const;
+        static void fitRigid(const QList<Match> &matches, double &cosr, double &sinr, double &tx, double &ty);
+
+        QList<QPointF> mReference;
+        double mShiftX = 0;
+        double mShiftY = 0;
+        double mRotation = 0;
+};
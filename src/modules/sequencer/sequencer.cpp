@@ -49,6 +49,21 @@ void Sequencer::OnMyExternalEvent(const QString &eventType, const QString  &even
         return;
     }
 
+    // Focus drift monitor advises a refocus : done before the next light/flat frame
+    if (eventType == "focusadvised" && getModuleName() == eventModule)
+    {
+        if (isSequenceRunning && !mWaitingForFocus && getBool("parameters", "autofocusondrift"))
+        {
+            sendMessage("Focus module advises refocus : " + eventData["reason"].toString());
+            mFocusAdvised = true;
+        }
+        else if (!eventData["focusmodule"].toString().isEmpty())
+        {
+            emit moduleEvent("focusadvisedrejected", eventData["focusmodule"].toString(), "", QVariantMap());
+        }
+        return;
+    }
+
     if (getModuleName() == eventModule)
     {
         foreach(const QString &keyprop, eventData.keys())
@@ -66,6 +81,7 @@ void Sequencer::OnMyExternalEvent(const QString &eventType, const QString  &even
                         emit Abort();
                         isSequenceRunning = false;
                         mWaitingForFocus = false;
+                        mFocusAdvised = false;
                         mWaitingForGuidingSettle = false;
                         if (mGuidingSettleTimer->isActive())
                         {
@@ -152,6 +168,12 @@ void Sequencer::newBLOB(INDI::PropertyBlob pblob)
                 StartLine();
             }
         }
+        else if (mFocusAdvised && (currentFrameType == "L" || currentFrameType == "F"))
+        {
+            // Shoot() will be called after focus completes
+            mFocusAdvised = false;
+            requestFocus();
+        }
         else
         {
             Shoot();
@@ -272,6 +294,7 @@ void Sequencer::StartSequence()
 
     currentLine = -1;
     isSequenceRunning = true;
+    mFocusAdvised = false;
     mObjectName = getString("object", "label");
     mDate = QDateTime::currentDateTime().toString("yyyyMMdd-hh-mm-ss");
 
@@ -459,7 +482,7 @@ void Sequencer::refreshFilterLov()
 void Sequencer::requestFocus()
 {
     QString focusModule = getString("parameters", "focusmodule");
-    sendMessage("Filter changed - requesting autofocus from module: " + focusModule);
+    sendMessage("Requesting autofocus from module: " + focusModule);
 
     mWaitingForFocus = true;
 
@@ -92,6 +92,7 @@ class MODULE_INIT Sequencer: public IndiModule
         QVariantMap mActiveSeq;
         bool isSequenceRunning = false;
         bool mWaitingForFocus = false;
+        bool mFocusAdvised = false;
         bool mWaitingForGuidingSettle = false;
         QTimer *mGuidingSettleTimer = nullptr;
         QString mObjectName = "default";